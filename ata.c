@@ -0,0 +1,341 @@
+#include "ata.h"
+#include "block.h"
+#include "pci.h"
+#include "lib.h"
+#include "i8259.h"
+#include "paging.h"
+
+typedef struct {
+    uint16_t io; // task file base
+    uint16_t ctrl; // device control / alternate status
+    uint16_t bmide; // bus master registers, 0 if the controller has none
+    uint8_t irq;
+    prd_t * prdt; // one frame of descriptors
+    uint8_t * bounce[ATA_BOUNCE_FRAMES]; // staging frames for buffers outside identity-mapped memory
+    blk_request_t * active; // request the drive is working on, NULL when idle
+    blkdev_t * active_dev;
+    uint32_t bounced; // active request is staged through bounce
+} ata_channel_t;
+
+typedef struct {
+    ata_channel_t * chan;
+    blkdev_t * dev; // registered block device, NULL if no usable drive is here
+    uint32_t slave; // 0 master, 1 slave
+    uint32_t lba48; // drive takes the EXT commands
+} ata_drive_t;
+
+static ata_channel_t channels[ATA_CHANNELS] = {
+    {ATA_PRIMARY_IO, ATA_PRIMARY_CTRL, 0, ATA_PRIMARY_IRQ},
+    {ATA_SECONDARY_IO, ATA_SECONDARY_CTRL, 0, ATA_SECONDARY_IRQ},
+};
+static ata_drive_t drives[ATA_CHANNELS * ATA_DRIVES];
+static const int8_t * drive_names[ATA_CHANNELS * ATA_DRIVES] = {"hda", "hdb", "hdc", "hdd"};
+
+static int32_t ata_dispatch(blkdev_t * dev, blk_request_t * req);
+static void ata_poll(blkdev_t * dev);
+
+/* ata_delay
+* Inputs: - chan : channel
+* Outputs: none
+* Side Effects: reads alternate status four times, the 400ns a drive needs after a select
+*/
+static void ata_delay(ata_channel_t * chan) {
+    inb(chan->ctrl);
+    inb(chan->ctrl);
+    inb(chan->ctrl);
+    inb(chan->ctrl);
+}
+
+/* ata_wait
+* Inputs: - chan : channel
+          - want : status bit that must come up once BSY drops, 0 for none
+* Outputs: return 0 when ready ; return -1 on ERR/DF or timeout
+* Side Effects: polls the status register, only used for PIO probing and command setup
+*/
+static int32_t ata_wait(ata_channel_t * chan, uint8_t want) {
+    uint32_t i;
+    uint8_t status;
+
+    for (i = 0; i < ATA_TIMEOUT; i++) {
+        status = inb(chan->io + ATA_REG_STATUS);
+        if (status & ATA_SR_BSY) continue;
+        if (status & (ATA_SR_ERR | ATA_SR_DF)) return -1;
+        if ((status & want) == want) return 0;
+    }
+    return -1;
+}
+
+/* ata_identify
+* Inputs: - chan : channel
+          - slave : 0 for the master, 1 for the slave
+          - ident : ATA_IDENT_WORDS words to fill
+* Outputs: return 0 for an ATA disk ; return -1 if nothing (or an ATAPI device) is there
+* Side Effects: PIO IDENTIFY with the drive's interrupt masked
+*/
+static int32_t ata_identify(ata_channel_t * chan, uint32_t slave, uint16_t * ident) {
+    uint32_t i;
+
+    outb(ATA_CTRL_NIEN, chan->ctrl);
+    outb(ATA_DRIVE_CHS | (slave ? ATA_DRIVE_SLAVE : 0), chan->io + ATA_REG_DRIVE);
+    ata_delay(chan);
+    if (inb(chan->io + ATA_REG_STATUS) == ATA_FLOATING) return -1;
+
+    outb(0, chan->io + ATA_REG_SECCOUNT);
+    outb(0, chan->io + ATA_REG_LBA_LO);
+    outb(0, chan->io + ATA_REG_LBA_MID);
+    outb(0, chan->io + ATA_REG_LBA_HI);
+    outb(ATA_CMD_IDENTIFY, chan->io + ATA_REG_COMMAND);
+    if (inb(chan->io + ATA_REG_STATUS) == 0) return -1;
+
+    if (ata_wait(chan, 0) != 0) return -1;
+    // ATAPI and SATA signatures show up in the LBA registers instead of data
+    if (inb(chan->io + ATA_REG_LBA_MID) != 0 || inb(chan->io + ATA_REG_LBA_HI) != 0) return -1;
+    if (ata_wait(chan, ATA_SR_DRQ) != 0) return -1;
+
+    for (i = 0; i < ATA_IDENT_WORDS; i++) {
+        ident[i] = inw(chan->io + ATA_REG_DATA);
+    }
+    return 0;
+}
+
+/* prd_add
+* Inputs: - chan : channel whose table is being built
+          - n : entries already in the table
+          - addr, len : physically contiguous region
+* Outputs: entries in the table afterwards
+* Side Effects: splits the region at 64KB boundaries
+*/
+static uint32_t prd_add(ata_channel_t * chan, uint32_t n, uint32_t addr, uint32_t len) {
+    uint32_t chunk;
+
+    while (len > 0) {
+        chunk = PRD_BOUNDARY - (addr & (PRD_BOUNDARY - 1));
+        if (chunk > len) chunk = len;
+
+        chan->prdt[n].addr = addr;
+        chan->prdt[n].bytes = (uint16_t)chunk; // a full 64KB wraps to 0, which is what the controller wants
+        chan->prdt[n].flags = 0;
+        n++;
+        addr += chunk;
+        len -= chunk;
+    }
+    return n;
+}
+
+/* ata_dispatch
+* Inputs: - dev : registered drive
+          - req : first request of a run of at most ATA_MAX_SECTORS sectors
+* Outputs: BLK_STARTED ; BLK_BUSY if the channel has a transfer in flight ; -1 if the drive refuses
+* Side Effects: programs the PRD table and task file and starts the bus master,
+                the IRQ handler completes the request
+*/
+static int32_t ata_dispatch(blkdev_t * dev, blk_request_t * req) {
+    ata_drive_t * drive = (ata_drive_t *)dev->priv;
+    ata_channel_t * chan = drive->chan;
+    uint32_t bytes = req->total << BLK_SECTOR_SHIFT;
+    uint32_t n = 0;
+    uint32_t off, len, flags;
+    blk_request_t * seg;
+    uint8_t select = drive->slave ? ATA_DRIVE_SLAVE : 0;
+    uint8_t cmd;
+
+    if (req->total == 0 || req->total > ATA_MAX_SECTORS) return -1;
+
+    cli_and_save(flags);
+    if (chan->active != NULL) {
+        restore_flags(flags);
+        return BLK_BUSY;
+    }
+    chan->active = req;
+    chan->active_dev = dev;
+    req->status = BLK_PENDING;
+
+    // one descriptor per buffer of a merged run, or per bounce frame if any buffer is out of reach
+    chan->bounced = !blk_run_reachable(req);
+    if (!chan->bounced) {
+        for (seg = req; seg != NULL; seg = seg->merged) {
+            n = prd_add(chan, n, (uint32_t)seg->buf, seg->count << BLK_SECTOR_SHIFT);
+        }
+    } else {
+        if (req->dir == BLK_WRITE) blk_bounce(req, chan->bounce, 1);
+        for (off = 0; off < bytes; off += FOUR_KB) {
+            len = (bytes - off < FOUR_KB) ? bytes - off : FOUR_KB;
+            n = prd_add(chan, n, (uint32_t)chan->bounce[off / FOUR_KB], len);
+        }
+    }
+    chan->prdt[n - 1].flags = PRD_EOT;
+
+    // stop the engine, point it at the table and clear stale status
+    outb(0, chan->bmide + BM_REG_CMD);
+    outl((uint32_t)chan->prdt, chan->bmide + BM_REG_PRDT);
+    outb(BM_STAT_ERR | BM_STAT_IRQ, chan->bmide + BM_REG_STATUS);
+
+    if (ata_wait(chan, 0) != 0) {
+        chan->active = NULL;
+        restore_flags(flags);
+        return -1;
+    }
+
+    if (drive->lba48 && req->sector + req->total > ATA_LBA28_LIMIT) {
+        outb(ATA_DRIVE_LBA48 | select, chan->io + ATA_REG_DRIVE);
+        ata_delay(chan);
+        // high bytes first, each register is a two-deep FIFO
+        outb(req->total >> 8, chan->io + ATA_REG_SECCOUNT);
+        outb(req->sector >> 24, chan->io + ATA_REG_LBA_LO);
+        outb(0, chan->io + ATA_REG_LBA_MID);
+        outb(0, chan->io + ATA_REG_LBA_HI);
+        outb(req->total, chan->io + ATA_REG_SECCOUNT);
+        outb(req->sector, chan->io + ATA_REG_LBA_LO);
+        outb(req->sector >> 8, chan->io + ATA_REG_LBA_MID);
+        outb(req->sector >> 16, chan->io + ATA_REG_LBA_HI);
+        cmd = (req->dir == BLK_WRITE) ? ATA_CMD_WRITE_DMA_EXT : ATA_CMD_READ_DMA_EXT;
+    } else {
+        outb(ATA_DRIVE_LBA | select | ((req->sector >> 24) & 0x0F), chan->io + ATA_REG_DRIVE);
+        ata_delay(chan);
+        outb(req->total, chan->io + ATA_REG_SECCOUNT);
+        outb(req->sector, chan->io + ATA_REG_LBA_LO);
+        outb(req->sector >> 8, chan->io + ATA_REG_LBA_MID);
+        outb(req->sector >> 16, chan->io + ATA_REG_LBA_HI);
+        cmd = (req->dir == BLK_WRITE) ? ATA_CMD_WRITE_DMA : ATA_CMD_READ_DMA;
+    }
+    outb(cmd, chan->io + ATA_REG_COMMAND);
+    outb(BM_CMD_START | ((req->dir == BLK_READ) ? BM_CMD_READ : 0), chan->bmide + BM_REG_CMD);
+
+    restore_flags(flags);
+    return BLK_STARTED;
+}
+
+/* ata_finish
+* Inputs: - chan : channel
+* Outputs: none
+* Side Effects: if the bus master reports an interrupt, stops it, acks the drive,
+                copies bounced reads out and completes the active request, then restarts
+                the queue of every drive on the channel
+*/
+static void ata_finish(ata_channel_t * chan) {
+    blk_request_t * req = chan->active;
+    uint32_t i;
+    uint8_t bm, status;
+
+    bm = inb(chan->bmide + BM_REG_STATUS);
+    if (!(bm & BM_STAT_IRQ)) return;
+
+    outb(0, chan->bmide + BM_REG_CMD);
+    status = inb(chan->io + ATA_REG_STATUS); // reading status lowers the drive's IRQ
+    outb(BM_STAT_ERR | BM_STAT_IRQ, chan->bmide + BM_REG_STATUS);
+
+    if (req == NULL) return;
+    chan->active = NULL;
+
+    if ((bm & BM_STAT_ERR) || (status & (ATA_SR_ERR | ATA_SR_DF))) {
+        blk_complete(chan->active_dev, req, BLK_ERROR);
+    } else {
+        if (chan->bounced && req->dir == BLK_READ) blk_bounce(req, chan->bounce, 0);
+        blk_complete(chan->active_dev, req, BLK_DONE);
+    }
+
+    // ata_dispatch turned the other drive away with BLK_BUSY while this transfer ran
+    for (i = 0; i < ATA_CHANNELS * ATA_DRIVES; i++) {
+        if (drives[i].chan == chan && drives[i].dev != NULL) blk_kick(drives[i].dev);
+    }
+}
+
+/* ata_poll
+* Inputs: - dev : drive
+* Outputs: none
+* Side Effects: completes the channel's transfer if the bus master has finished it
+*/
+static void ata_poll(blkdev_t * dev) {
+    ata_finish(((ata_drive_t *)dev->priv)->chan);
+}
+
+/*
+ata_primary_interrupt:
+functionality: IRQ 14, finishes the primary channel's transfer
+input: None
+output: None
+Effects: wakes whoever is sleeping on the request
+*/
+void ata_primary_interrupt() {
+    ata_finish(&channels[0]);
+    send_eoi(ATA_PRIMARY_IRQ);
+}
+
+/*
+ata_secondary_interrupt:
+functionality: IRQ 15, finishes the secondary channel's transfer
+input: None
+output: None
+Effects: wakes whoever is sleeping on the request
+*/
+void ata_secondary_interrupt() {
+    ata_finish(&channels[1]);
+    send_eoi(ATA_SECONDARY_IRQ);
+}
+
+/* init_channel
+* Inputs: - chan : channel
+* Outputs: return 0 if the DMA frames were allocated ; return -1 if the pool ran dry
+* Side Effects: takes one PRD frame and ATA_BOUNCE_FRAMES staging frames, unmasks the
+                channel's IRQ at the PIC
+*/
+static int32_t init_channel(ata_channel_t * chan) {
+    uint32_t i;
+
+    if (chan->prdt != NULL) return 0;
+
+    chan->prdt = (prd_t *)alloc_frame();
+    if (chan->prdt == NULL) return -1;
+    for (i = 0; i < ATA_BOUNCE_FRAMES; i++) {
+        chan->bounce[i] = (uint8_t *)alloc_frame();
+        if (chan->bounce[i] == NULL) return -1;
+    }
+
+    enable_irq(chan->irq);
+    return 0;
+}
+
+/*
+init_ata:
+functionality: finds the PIIX IDE function over PCI, enables bus mastering and
+IDENTIFYs the four legacy drive positions
+input: None
+output: None
+Effects: every DMA capable disk found is registered as a block device, hda-hdd
+*/
+void init_ata() {
+    uint16_t ident[ATA_IDENT_WORDS];
+    pci_dev_t pci;
+    uint32_t bm, c, d, sectors;
+    ata_drive_t * drive;
+
+    pci = pci_find_class(IDE_CLASS, IDE_SUBCLASS, PCI_DEV(0, 0, 0));
+    if (pci == PCI_NONE) return;
+    bm = pci_io_bar(pci, BM_BAR);
+    if (bm == 0) return;
+    pci_enable_master(pci);
+
+    for (c = 0; c < ATA_CHANNELS; c++) {
+        channels[c].bmide = bm + c * BM_CHANNEL_STRIDE;
+
+        for (d = 0; d < ATA_DRIVES; d++) {
+            if (ata_identify(&channels[c], d, ident) != 0) continue;
+            if (!(ident[ATA_IDENT_CAPS] & ATA_CAP_DMA)) continue;
+            if (init_channel(&channels[c]) != 0) return;
+
+            drive = &drives[c * ATA_DRIVES + d];
+            drive->chan = &channels[c];
+            drive->slave = d;
+            drive->lba48 = (ident[ATA_IDENT_CMDSET] & ATA_CMDSET_LBA48) != 0;
+            if (drive->lba48) {
+                sectors = ident[ATA_IDENT_LBA48] | (ident[ATA_IDENT_LBA48 + 1] << 16);
+            } else {
+                sectors = ident[ATA_IDENT_LBA28] | (ident[ATA_IDENT_LBA28 + 1] << 16);
+            }
+            drive->dev = register_blkdev(drive_names[c * ATA_DRIVES + d], sectors, ATA_MAX_SECTORS,
+                                         ATA_MAX_SEGMENTS, ata_dispatch, NULL, ata_poll, drive);
+        }
+        // IDENTIFY left nIEN set, clear it once a drive is using the channel
+        if (channels[c].prdt != NULL) outb(0, channels[c].ctrl);
+    }
+}
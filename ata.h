@@ -0,0 +1,94 @@
+#ifndef ATA_H
+#define ATA_H
+
+#include "types.h"
+
+// legacy ports and IRQs of the two PIIX channels
+#define ATA_PRIMARY_IO 0x1F0
+#define ATA_PRIMARY_CTRL 0x3F6
+#define ATA_PRIMARY_IRQ 14
+#define ATA_SECONDARY_IO 0x170
+#define ATA_SECONDARY_CTRL 0x376
+#define ATA_SECONDARY_IRQ 15
+#define ATA_CHANNELS 2
+#define ATA_DRIVES 2 // master and slave per channel
+
+// task file registers, offsets from the channel's io base
+#define ATA_REG_DATA 0
+#define ATA_REG_ERROR 1
+#define ATA_REG_SECCOUNT 2
+#define ATA_REG_LBA_LO 3
+#define ATA_REG_LBA_MID 4
+#define ATA_REG_LBA_HI 5
+#define ATA_REG_DRIVE 6
+#define ATA_REG_STATUS 7 // reads status, writes command
+#define ATA_REG_COMMAND 7
+
+// status register bits
+#define ATA_SR_ERR 0x01
+#define ATA_SR_DRQ 0x08
+#define ATA_SR_DF 0x20
+#define ATA_SR_BSY 0x80
+#define ATA_FLOATING 0xFF // status read back from a channel with nothing on it
+
+// device control register
+#define ATA_CTRL_NIEN 0x02 // mask the drive's interrupt
+
+// drive/head register
+#define ATA_DRIVE_CHS 0xA0 // IDENTIFY select, CHS addressing
+#define ATA_DRIVE_LBA 0xE0 // LBA28, low nibble is LBA bits 24-27
+#define ATA_DRIVE_LBA48 0x40
+#define ATA_DRIVE_SLAVE 0x10
+
+// commands
+#define ATA_CMD_IDENTIFY 0xEC
+#define ATA_CMD_READ_DMA 0xC8
+#define ATA_CMD_WRITE_DMA 0xCA
+#define ATA_CMD_READ_DMA_EXT 0x25
+#define ATA_CMD_WRITE_DMA_EXT 0x35
+
+// IDENTIFY words
+#define ATA_IDENT_WORDS 256
+#define ATA_IDENT_CAPS 49 // bit 8 set if the drive does DMA
+#define ATA_IDENT_LBA28 60 // two words of LBA28 capacity
+#define ATA_IDENT_CMDSET 83 // bit 10 set if the drive does LBA48
+#define ATA_IDENT_LBA48 100 // four words of LBA48 capacity, only the low two are used
+#define ATA_CAP_DMA 0x100
+#define ATA_CMDSET_LBA48 0x400
+#define ATA_LBA28_LIMIT 0x10000000 // first sector LBA28 can't address
+
+// bus master IDE registers, offsets from BAR4 (+8 for the secondary channel)
+#define BM_CHANNEL_STRIDE 8
+#define BM_REG_CMD 0
+#define BM_REG_STATUS 2
+#define BM_REG_PRDT 4
+#define BM_CMD_START 0x01
+#define BM_CMD_READ 0x08 // device to memory
+#define BM_STAT_ERR 0x02
+#define BM_STAT_IRQ 0x04 // the drive raised its interrupt, write 1 to clear
+#define BM_BAR 4
+#define IDE_CLASS 0x01 // mass storage
+#define IDE_SUBCLASS 0x01
+
+// physical region descriptors
+#define PRD_EOT 0x8000 // last entry of the table
+#define PRD_BOUNDARY 0x10000 // an entry may not cross 64KB
+
+#define ATA_MAX_SECTORS 128 // 64KB per request
+#define ATA_MAX_SEGMENTS 64 // buffers per merged run, each needs at most two PRD entries
+#define ATA_BOUNCE_FRAMES (ATA_MAX_SECTORS * 512 / 4096) // 4KB frames for buffers DMA can't reach
+#define ATA_TIMEOUT 1000000 // status polls before a PIO wait gives up
+
+typedef struct {
+    uint32_t addr; // physical address
+    uint16_t bytes; // 0 means 64KB
+    uint16_t flags; // PRD_EOT on the last entry
+} __attribute__((packed)) prd_t;
+
+// find the IDE controller, IDENTIFY each drive and register it as hda-hdd
+extern void init_ata();
+// IRQ 14/15 handlers, reached from interruptHandler.S
+extern void ata_primary_interrupt();
+extern void ata_secondary_interrupt();
+
+#endif
@@ -0,0 +1,540 @@
+#include "bcache.h"
+#include "lib.h"
+#include "sys_call.h"
+#include "paging.h"
+
+bcache_stats_t bcache_stats;
+
+static buf_t bufs[BCACHE_MAX_BUFS];
+static buf_t * bcache_hash[BCACHE_HASH_SIZE];
+static uint32_t num_bufs = 0;
+static uint32_t clock_hand = 0; // next buffer the CLOCK sweep looks at
+static buf_t * flush_batch[BCACHE_FLUSH_BATCH]; // one writeback pass, in (device, block) order
+static uint32_t flush_ticks = 0; // timer ticks since the last timed writeback
+
+/* bcache_slot
+* Inputs: - dev, block : cache key
+* Outputs: the hash chain the key lives on
+* Side Effects: none
+*/
+static uint32_t bcache_slot(blkdev_t * dev, uint32_t block) {
+    // devices are entries of one array, so the low bits of their address don't spread
+    return (block ^ ((uint32_t)dev >> 4)) % BCACHE_HASH_SIZE;
+}
+
+/*
+init_bcache:
+functionality: gives the cache a share of the frames the drivers left free, one per buffer
+input: None
+output: None
+Effects: the cache starts empty ; with no frames at all every bread fails
+*/
+void init_bcache() {
+    uint32_t want;
+
+    memset(bufs, 0, sizeof(bufs));
+    memset(bcache_hash, 0, sizeof(bcache_hash));
+    memset(&bcache_stats, 0, sizeof(bcache_stats));
+    clock_hand = 0;
+
+    want = (NUM_FRAMES - frames_in_use()) / BCACHE_POOL_SHARE;
+    if (want > BCACHE_MAX_BUFS) want = BCACHE_MAX_BUFS;
+    for (num_bufs = 0; num_bufs < want; num_bufs++) {
+        bufs[num_bufs].data = (uint8_t *)alloc_frame();
+        if (bufs[num_bufs].data == NULL) break;
+    }
+    bcache_stats.bufs = num_bufs;
+}
+
+/* bcache_unhash
+* Inputs: - b : buffer on a hash chain, interrupts off
+* Outputs: none
+* Side Effects: the buffer's block can no longer be found, unwritten data in it is dropped
+*/
+static void bcache_unhash(buf_t * b) {
+    buf_t ** link = &bcache_hash[bcache_slot(b->dev, b->block)];
+
+    while (*link != NULL && *link != b) link = &(*link)->hash_next;
+    if (*link != NULL) *link = b->hash_next;
+    b->hash_next = NULL;
+    b->dev = NULL;
+    b->valid = 0;
+    if (b->dirty) {
+        b->dirty = 0;
+        bcache_stats.dirty--;
+    }
+}
+
+/* bcache_reap
+* Inputs: - b : buffer, interrupts off
+* Outputs: none
+* Side Effects: if the buffer's transfer has finished, records how it went and drops the
+                reference the transfer held ; a failed write leaves the block dirty
+*/
+static void bcache_reap(buf_t * b) {
+    if (!b->busy || b->req.status == BLK_PENDING) return;
+
+    if (b->req.dir == BLK_READ) {
+        b->valid = (b->req.status == BLK_DONE);
+        if (!b->valid) bcache_stats.read_errors++;
+    } else if (b->req.status == BLK_DONE) {
+        bcache_stats.writes++;
+    } else {
+        // the data is still the newest copy, the next pass tries again
+        bcache_stats.write_errors++;
+        b->dirty = 1;
+        bcache_stats.dirty++;
+    }
+    b->busy = 0;
+    b->refcount--;
+}
+
+/* bcache_start
+* Inputs: - b : buffer named for its block and not busy, interrupts off
+          - dir : BLK_READ for a buffer that isn't valid, BLK_WRITE for a dirty one
+* Outputs: return 0 if the transfer was queued ; return -1 if the block is past the end of the device
+* Side Effects: the transfer holds a reference until bcache_reap sees it finish ; a write
+                cleans the buffer as it starts, so a failure has to dirty it again
+*/
+static int32_t bcache_start(buf_t * b, uint32_t dir) {
+    b->req.sector = b->block * BCACHE_BLOCK_SECTORS;
+    b->req.count = BCACHE_BLOCK_SECTORS;
+    b->req.buf = b->data;
+    b->req.dir = dir;
+    b->busy = 1;
+    b->refcount++;
+    if (dir == BLK_WRITE) {
+        b->dirty = 0;
+        bcache_stats.dirty--;
+    }
+    if (blk_submit(b->dev, &b->req) != 0) {
+        b->busy = 0;
+        b->refcount--;
+        if (dir == BLK_WRITE) {
+            b->dirty = 1;
+            bcache_stats.dirty++;
+        }
+        return -1;
+    }
+    return 0;
+}
+
+/* bcache_before
+* Inputs: - a, b : named buffers
+* Outputs: return 1 if a sorts before b by device, then block
+* Side Effects: none
+*/
+static int32_t bcache_before(buf_t * a, buf_t * b) {
+    if (a->dev != b->dev) return (uint32_t)a->dev < (uint32_t)b->dev;
+    return a->block < b->block;
+}
+
+/* bcache_writeback
+* Inputs: - dev : device to write back, NULL for every device ; interrupts off
+* Outputs: writes started, BCACHE_FLUSH_BATCH means more may be waiting
+* Side Effects: gathers up to a batch of dirty buffers nobody holds, sorts them, and starts
+                their writes with each device plugged so neighbouring blocks merge into
+                single transfers in one elevator sweep. Held buffers wait for a later pass
+*/
+static uint32_t bcache_writeback(blkdev_t * dev) {
+    buf_t * b;
+    uint32_t i, j, n = 0;
+
+    for (i = 0; i < num_bufs && n < BCACHE_FLUSH_BATCH; i++) {
+        b = &bufs[i];
+        bcache_reap(b);
+        if (!b->dirty || b->busy || b->refcount != 0) continue;
+        if (dev != NULL && b->dev != dev) continue;
+        for (j = n; j > 0 && bcache_before(b, flush_batch[j - 1]); j--) flush_batch[j] = flush_batch[j - 1];
+        flush_batch[j] = b;
+        n++;
+    }
+
+    for (i = 0; i < n; i++) {
+        b = flush_batch[i];
+        if (i == 0 || b->dev != flush_batch[i - 1]->dev) blk_plug(b->dev);
+        bcache_start(b, BLK_WRITE);
+        if (i == n - 1 || flush_batch[i + 1]->dev != b->dev) blk_unplug(b->dev);
+    }
+    if (n > 0) bcache_stats.flushes++;
+    return n;
+}
+
+/* bcache_busy
+* Inputs: none, interrupts off
+* Outputs: a buffer with a transfer in flight ; NULL if the devices are idle
+* Side Effects: none
+*/
+static buf_t * bcache_busy() {
+    uint32_t i;
+
+    for (i = 0; i < num_bufs; i++) {
+        if (bufs[i].busy) return &bufs[i];
+    }
+    return NULL;
+}
+
+/* bcache_victim
+* Inputs: none, interrupts off
+* Outputs: an unheld, clean buffer ; NULL if every buffer is held or dirty
+* Side Effects: CLOCK sweep: a buffer used since the hand last passed gets its bit cleared
+                and another lap before it is taken, so blocks read once go before hot ones.
+                Finished transfers met on the way are reaped so their buffers can be taken
+*/
+static buf_t * bcache_victim() {
+    buf_t * b;
+    uint32_t n;
+
+    // two laps clear every bit the first one meets
+    for (n = 0; n < 2 * num_bufs; n++) {
+        b = &bufs[clock_hand];
+        clock_hand = (clock_hand + 1) % num_bufs;
+        bcache_reap(b);
+        if (b->refcount != 0 || b->dirty) continue;
+        if (b->referenced) {
+            b->referenced = 0;
+            continue;
+        }
+        return b;
+    }
+    return NULL;
+}
+
+/* bcache_find
+* Inputs: - dev, block : cache key, interrupts off
+* Outputs: the key's buffer ; NULL if it isn't cached
+* Side Effects: reaps the buffer's read if it has finished
+*/
+static buf_t * bcache_find(blkdev_t * dev, uint32_t block) {
+    buf_t * b;
+
+    for (b = bcache_hash[bcache_slot(dev, block)]; b != NULL; b = b->hash_next) {
+        if (b->dev == dev && b->block == block) {
+            bcache_reap(b);
+            return b;
+        }
+    }
+    return NULL;
+}
+
+/* bcache_claim
+* Inputs: - dev, block : key that isn't cached, interrupts off
+* Outputs: the CLOCK victim renamed to the key, unheld and not valid ; NULL if every buffer
+           is held or dirty
+* Side Effects: whatever the victim held is dropped
+*/
+static buf_t * bcache_claim(blkdev_t * dev, uint32_t block) {
+    buf_t * b = bcache_victim();
+    uint32_t slot = bcache_slot(dev, block);
+
+    if (b == NULL) return NULL;
+    if (b->dev != NULL) {
+        if (b->valid) bcache_stats.evictions++;
+        bcache_unhash(b);
+    }
+    b->dev = dev;
+    b->block = block;
+    b->ahead = 0;
+    b->hash_next = bcache_hash[slot];
+    bcache_hash[slot] = b;
+    return b;
+}
+
+/* bcache_lookup
+* Inputs: - dev, block : cache key
+* Outputs: the key's buffer with a reference held, possibly not read yet ; NULL if every
+           buffer is held
+* Side Effects: on a miss the CLOCK victim is renamed to the key ; with nothing clean to
+                take, writes back a batch and sleeps until a transfer frees a buffer
+*/
+static buf_t * bcache_lookup(blkdev_t * dev, uint32_t block) {
+    buf_t * b;
+    buf_t * w;
+    uint32_t flags;
+
+    if (dev == NULL || num_bufs == 0) return NULL;
+
+    cli_and_save(flags);
+    b = bcache_find(dev, block);
+    if (b != NULL && (b->valid || b->busy)) {
+        bcache_stats.hits++;
+        if (b->ahead) bcache_stats.readahead_hits++;
+    } else {
+        bcache_stats.misses++;
+        while (b == NULL && (b = bcache_claim(dev, block)) == NULL) {
+            bcache_writeback(NULL);
+            w = bcache_busy();
+            if (w == NULL) {
+                restore_flags(flags);
+                return NULL;
+            }
+            restore_flags(flags);
+            blk_wait(w->dev, &w->req);
+            cli_and_save(flags);
+            // another caller may have brought the block in meanwhile
+            b = bcache_find(dev, block);
+        }
+    }
+    b->refcount++;
+    b->referenced = 1;
+    b->ahead = 0;
+    restore_flags(flags);
+    return b;
+}
+
+/* bcache_settle
+* Inputs: - b : held buffer
+* Outputs: none
+* Side Effects: sleeps until a transfer in flight on the buffer finishes, then reaps it
+*/
+static void bcache_settle(buf_t * b) {
+    uint32_t flags;
+
+    if (b->busy) blk_wait(b->dev, &b->req);
+    cli_and_save(flags);
+    bcache_reap(b);
+    restore_flags(flags);
+}
+
+/* bread
+* Inputs: - dev : block device
+          - block : BCACHE_BLOCK_SIZE block of the device
+* Outputs: the buffer holding the block, release with brelse ; NULL if every buffer is held
+           or the device failed the read
+* Side Effects: a miss sleeps until the read completes ; a block already on its way in,
+                from readahead or another reader, is waited for instead of read again
+*/
+buf_t * bread(blkdev_t * dev, uint32_t block) {
+    buf_t * b;
+    uint32_t flags;
+    int32_t ret = 0;
+
+    b = bcache_lookup(dev, block);
+    if (b == NULL) return NULL;
+
+    cli_and_save(flags);
+    if (!b->valid && !b->busy) ret = bcache_start(b, BLK_READ);
+    restore_flags(flags);
+
+    if (ret == 0) bcache_settle(b);
+    if (!b->valid) {
+        brelse(b);
+        return NULL;
+    }
+    return b;
+}
+
+/* bget
+* Inputs: - dev, block : as bread
+* Outputs: the buffer for the block, release with brelse ; NULL if every buffer is held
+* Side Effects: nothing is read, data is only meaningful if the block was already cached, so
+                the caller must fill all of it and bdirty or bwrite. A transfer already in
+                flight is waited out so it can't mix with the caller's data
+*/
+buf_t * bget(blkdev_t * dev, uint32_t block) {
+    buf_t * b = bcache_lookup(dev, block);
+
+    if (b != NULL) bcache_settle(b);
+    return b;
+}
+
+/* breadahead
+* Inputs: - dev : block device
+          - block : first block wanted soon
+          - count : blocks
+* Outputs: reads started, fewer than asked if some were cached or the cache ran out of buffers
+* Side Effects: the reads go in under one plug so neighbours merge into a few transfers ;
+                their buffers start with the reference bit clear so readahead nobody uses
+                is the first thing the CLOCK sweep takes back
+*/
+uint32_t breadahead(blkdev_t * dev, uint32_t block, uint32_t count) {
+    buf_t * b;
+    uint32_t flags, i, started = 0;
+
+    if (dev == NULL || num_bufs == 0) return 0;
+
+    blk_plug(dev);
+    for (i = 0; i < count; i++) {
+        cli_and_save(flags);
+        if (bcache_find(dev, block + i) == NULL) {
+            b = bcache_claim(dev, block + i);
+            if (b == NULL) {
+                restore_flags(flags);
+                break;
+            }
+            b->referenced = 0;
+            b->ahead = 1;
+            if (bcache_start(b, BLK_READ) != 0) {
+                bcache_unhash(b);
+                restore_flags(flags);
+                break;
+            }
+            started++;
+        }
+        restore_flags(flags);
+    }
+    blk_unplug(dev);
+
+    bcache_stats.readahead += started;
+    return started;
+}
+
+/* bwrite
+* Inputs: - b : buffer from bread or bget, still held
+* Outputs: return 0 for success ; return -1 if the device failed the write
+* Side Effects: sleeps in blk_write until the block is on the device ; after a failure the
+                buffer stays dirty so writeback tries again
+*/
+int32_t bwrite(buf_t * b) {
+    uint32_t flags;
+
+    if (b == NULL || b->dev == NULL) return -1;
+
+    if (blk_write(b->dev, b->block * BCACHE_BLOCK_SECTORS, BCACHE_BLOCK_SECTORS, b->data) != 0) {
+        bcache_stats.write_errors++;
+        bdirty(b);
+        return -1;
+    }
+    cli_and_save(flags);
+    b->valid = 1;
+    if (b->dirty) {
+        b->dirty = 0;
+        bcache_stats.dirty--;
+    }
+    bcache_stats.writes++;
+    restore_flags(flags);
+    return 0;
+}
+
+/* bdirty
+* Inputs: - b : buffer from bread or bget, still held, its data changed
+* Outputs: none
+* Side Effects: the block reaches the device in a later writeback pass ; crossing the dirty
+                limit starts one now, so readers keep finding clean buffers to evict
+*/
+void bdirty(buf_t * b) {
+    uint32_t flags;
+
+    if (b == NULL || b->dev == NULL) return;
+
+    cli_and_save(flags);
+    b->valid = 1;
+    if (!b->dirty) {
+        b->dirty = 1;
+        bcache_stats.dirty++;
+    }
+    if (bcache_stats.dirty > num_bufs / BCACHE_DIRTY_SHARE) bcache_writeback(NULL);
+    restore_flags(flags);
+}
+
+/* brelse
+* Inputs: - b : buffer from bread or bget
+* Outputs: none
+* Side Effects: once nothing holds it, the buffer can be taken by the CLOCK sweep
+*/
+void brelse(buf_t * b) {
+    uint32_t flags;
+
+    if (b == NULL) return;
+    cli_and_save(flags);
+    if (b->refcount > 0) b->refcount--;
+    restore_flags(flags);
+}
+
+/* bflush
+* Inputs: - dev : block device, NULL for all of them
+* Outputs: return 0 once everything that was dirty is on the device ; return -1 if a write failed
+* Side Effects: writes back in sorted batches and sleeps until every write has completed ;
+                blocks held by someone else at the time are left for a later pass
+*/
+int32_t bflush(blkdev_t * dev) {
+    buf_t * b;
+    uint32_t flags, i, errors = bcache_stats.write_errors;
+
+    cli_and_save(flags);
+    // the writes a pass starts are busy, so the next pass skips them
+    while (bcache_writeback(dev) == BCACHE_FLUSH_BATCH) continue;
+    restore_flags(flags);
+
+    for (i = 0; i < num_bufs; i++) {
+        b = &bufs[i];
+        if (b->busy && b->req.dir == BLK_WRITE && (dev == NULL || b->dev == dev)) {
+            blk_wait(b->dev, &b->req);
+        }
+        cli_and_save(flags);
+        bcache_reap(b);
+        restore_flags(flags);
+    }
+    return (bcache_stats.write_errors == errors) ? 0 : -1;
+}
+
+/* bsync
+* Inputs: - dev, block : cache key
+* Outputs: return 0 if the device's copy is current ; return -1 if the write failed
+* Side Effects: sleeps while a dirty copy is written back
+*/
+int32_t bsync(blkdev_t * dev, uint32_t block) {
+    buf_t * b;
+    uint32_t flags;
+    int32_t ret = 0;
+
+    cli_and_save(flags);
+    b = bcache_find(dev, block);
+    if (b == NULL || (!b->dirty && !b->busy)) {
+        restore_flags(flags);
+        return 0;
+    }
+    b->refcount++;
+    restore_flags(flags);
+
+    // a write already on its way lands first
+    bcache_settle(b);
+    if (b->dirty) ret = bwrite(b);
+    brelse(b);
+    return ret;
+}
+
+/* binval
+* Inputs: - dev, block : cache key
+* Outputs: none
+* Side Effects: waits out a transfer in flight, then drops the buffer, unwritten data and all,
+                so neither a stale read nor a late writeback can touch the block
+*/
+void binval(blkdev_t * dev, uint32_t block) {
+    buf_t * b;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    b = bcache_find(dev, block);
+    if (b == NULL) {
+        restore_flags(flags);
+        return;
+    }
+    b->refcount++;
+    restore_flags(flags);
+
+    bcache_settle(b);
+    cli_and_save(flags);
+    b->refcount--;
+    if (b->dev == dev && b->block == block) bcache_unhash(b);
+    restore_flags(flags);
+}
+
+/* bcache_tick
+* Inputs: none, called from the RTC interrupt
+* Outputs: none
+* Side Effects: every BCACHE_FLUSH_TICKS calls starts a writeback pass without waiting for
+                it ; a full batch means more is dirty, so the next tick goes again
+*/
+void bcache_tick() {
+    uint32_t flags;
+
+    if (++flush_ticks < BCACHE_FLUSH_TICKS || num_bufs == 0) return;
+    flush_ticks = 0;
+
+    cli_and_save(flags);
+    if (bcache_stats.dirty > 0 && bcache_writeback(NULL) == BCACHE_FLUSH_BATCH) {
+        flush_ticks = BCACHE_FLUSH_TICKS - 1;
+    }
+    restore_flags(flags);
+}
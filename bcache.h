@@ -0,0 +1,69 @@
+#ifndef BCACHE_H
+#define BCACHE_H
+
+#include "types.h"
+#include "block.h"
+
+#define BCACHE_BLOCK_SIZE 4096 // one pool frame per buffer
+#define BCACHE_BLOCK_SECTORS (BCACHE_BLOCK_SIZE / BLK_SECTOR_SIZE)
+#define BCACHE_MAX_BUFS 256 // most buffers the cache grows to, 1MB
+#define BCACHE_POOL_SHARE 4 // the cache takes at most 1/4 of the frames free at boot
+#define BCACHE_HASH_SIZE 128 // chains the (device, block) lookup spreads over
+#define BCACHE_FLUSH_BATCH 64 // dirty blocks one writeback pass sorts and starts
+#define BCACHE_DIRTY_SHARE 2 // writeback starts early once over 1/2 of the buffers are dirty
+#define BCACHE_FLUSH_TICKS 1024 // RTC ticks between timed writebacks, a second at the fixed RTC_BASE_FREQ
+
+typedef struct buf {
+    blkdev_t * dev; // NULL while the buffer holds nothing
+    uint32_t block; // BCACHE_BLOCK_SIZE units from the start of the device
+    uint8_t * data; // pool frame
+    uint32_t refcount; // holders, a held buffer is never evicted
+    uint32_t referenced; // CLOCK second chance bit, set on every lookup
+    uint32_t ahead; // read in by breadahead and not looked up since
+    uint32_t valid; // data holds the block, at least as new as the device's copy
+    uint32_t dirty; // data is newer than the device's copy
+    uint32_t busy; // req is reading or writing data, and holds a reference until it is reaped
+    blk_request_t req; // the buffer's transfer, owned by the block layer while busy
+    struct buf * hash_next; // chain of buffers whose (dev, block) hash the same
+} buf_t;
+
+typedef struct {
+    uint32_t bufs; // buffers the cache was sized to at boot
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t evictions; // valid blocks dropped to make room
+    uint32_t writes; // blocks written back to their device
+    uint32_t dirty; // buffers waiting to be written back right now
+    uint32_t flushes; // writeback passes that started at least one write
+    uint32_t read_errors;
+    uint32_t write_errors; // failed writebacks, the block stays dirty and is retried
+    uint32_t readahead; // reads started ahead of any reader
+    uint32_t readahead_hits; // lookups that found a block readahead brought in
+} bcache_stats_t;
+
+extern bcache_stats_t bcache_stats;
+
+// size the cache from the frame pool, call after init_frames
+extern void init_bcache();
+// the block with its data read in and a reference held ; NULL if every buffer is held or the read failed
+extern buf_t * bread(blkdev_t * dev, uint32_t block);
+// the block with a reference held but not read, for a caller that overwrites all of it
+extern buf_t * bget(blkdev_t * dev, uint32_t block);
+// write the buffer to its device now and mark it valid ; 0 or -1
+extern int32_t bwrite(buf_t * b);
+// mark a held buffer's new contents for writeback later
+extern void bdirty(buf_t * b);
+// drop a reference from bread/bget
+extern void brelse(buf_t * b);
+// write back every dirty block of dev (of every device if NULL) and wait for them ; 0 or -1
+extern int32_t bflush(blkdev_t * dev);
+// write one block back now if the cache holds it dirty, before it is used in place ; 0 or -1
+extern int32_t bsync(blkdev_t * dev, uint32_t block);
+// forget the cached copy of a block, dirty or not, before it is used in place
+extern void binval(blkdev_t * dev, uint32_t block);
+// timer hook, starts a writeback pass every BCACHE_FLUSH_TICKS calls
+extern void bcache_tick();
+// start reads of whichever of count blocks aren't cached, without waiting ; returns reads started
+extern uint32_t breadahead(blkdev_t * dev, uint32_t block, uint32_t count);
+
+#endif
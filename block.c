@@ -0,0 +1,429 @@
+#include "block.h"
+#include "lib.h"
+#include "sys_call.h"
+#include "paging.h"
+
+static blkdev_t blkdevs[MAX_BLKDEVS];
+static uint32_t num_blkdevs = 0;
+
+static int32_t blk_transfer(blkdev_t * dev, uint32_t sector, uint32_t count, uint8_t * buf, uint32_t dir);
+static void blk_run_queue(blkdev_t * dev);
+
+/* read_tsc
+* Inputs: none
+* Outputs: low 32 bits of the time stamp counter, enough for latencies under a second
+* Side Effects: none
+*/
+static inline uint32_t read_tsc() {
+    uint32_t lo, hi;
+    asm volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return lo;
+}
+
+/* register_blkdev
+* Inputs: - name : device name, e.g. "hda"
+          - num_sectors : capacity in sectors
+          - max_sectors : largest run the driver takes at once
+          - max_segments : most buffers the driver can scatter one run over
+          - dispatch, unplug, poll : driver entry points, unplug may be NULL
+          - priv : driver state handed back through dev->priv
+* Outputs: the registered device ; NULL if the table is full, the name is bad or taken
+* Side Effects: none
+*/
+blkdev_t * register_blkdev(const int8_t * name, uint32_t num_sectors, uint32_t max_sectors,
+                           uint32_t max_segments,
+                           int32_t (*dispatch)(blkdev_t *, blk_request_t *),
+                           void (*unplug)(blkdev_t *), void (*poll)(blkdev_t *), void * priv) {
+    blkdev_t * dev;
+
+    if (name == NULL || dispatch == NULL || poll == NULL) return NULL;
+    if (max_sectors == 0 || max_segments == 0) return NULL;
+    if (num_blkdevs >= MAX_BLKDEVS || strlen(name) >= BLK_NAME_LEN) return NULL;
+    if (lookup_blkdev(name) != NULL) return NULL;
+
+    dev = &blkdevs[num_blkdevs++];
+    memset(dev, 0, sizeof(blkdev_t));
+    strncpy(dev->name, name, BLK_NAME_LEN);
+    dev->num_sectors = num_sectors;
+    dev->max_sectors = max_sectors;
+    dev->max_segments = max_segments;
+    dev->dispatch = dispatch;
+    dev->unplug = unplug;
+    dev->poll = poll;
+    dev->priv = priv;
+    return dev;
+}
+
+/* lookup_blkdev
+* Inputs: - name : device name
+* Outputs: the device ; NULL if not registered
+* Side Effects: none
+*/
+blkdev_t * lookup_blkdev(const int8_t * name) {
+    uint32_t i;
+
+    if (name == NULL) return NULL;
+    for (i = 0; i < num_blkdevs; i++) {
+        if (strncmp(blkdevs[i].name, name, BLK_NAME_LEN) == 0) return &blkdevs[i];
+    }
+    return NULL;
+}
+
+/* get_blkdev
+* Inputs: - n : registration order
+* Outputs: the device ; NULL past the last one
+* Side Effects: none
+*/
+blkdev_t * get_blkdev(uint32_t n) {
+    return (n < num_blkdevs) ? &blkdevs[n] : NULL;
+}
+
+/* blk_read
+* Inputs: - dev : block device
+          - sector : first sector
+          - count : sectors to read
+          - buf : kernel buffer of count * BLK_SECTOR_SIZE bytes
+* Outputs: return 0 for success ; return -1 for a bad range or a device error
+* Side Effects: sleeps in hlt until the device interrupts
+*/
+int32_t blk_read(blkdev_t * dev, uint32_t sector, uint32_t count, void * buf) {
+    return blk_transfer(dev, sector, count, (uint8_t *)buf, BLK_READ);
+}
+
+/* blk_write
+* Inputs: - dev : block device
+          - sector : first sector
+          - count : sectors to write
+          - buf : kernel buffer of count * BLK_SECTOR_SIZE bytes
+* Outputs: return 0 for success ; return -1 for a bad range or a device error
+* Side Effects: sleeps in hlt until the device interrupts
+*/
+int32_t blk_write(blkdev_t * dev, uint32_t sector, uint32_t count, const void * buf) {
+    return blk_transfer(dev, sector, count, (uint8_t *)buf, BLK_WRITE);
+}
+
+/* blk_joinable
+* Inputs: - dev : device
+          - a, b : first requests of two runs, a before b
+* Outputs: return 1 if b starts where a ends and the combined run fits the driver's limits
+* Side Effects: none
+*/
+static int32_t blk_joinable(blkdev_t * dev, blk_request_t * a, blk_request_t * b) {
+    if (a->dir != b->dir || a->sector + a->total != b->sector) return 0;
+    if (a->total + b->total > dev->max_sectors) return 0;
+    return a->segments + b->segments <= dev->max_segments;
+}
+
+/* blk_join
+* Inputs: - dev : device
+          - a, b : runs that passed blk_joinable, b already off the queue
+* Outputs: none
+* Side Effects: b's requests ride along at the end of a
+*/
+static void blk_join(blkdev_t * dev, blk_request_t * a, blk_request_t * b) {
+    a->tail->merged = b;
+    a->tail = b->tail;
+    a->total += b->total;
+    a->segments += b->segments;
+    dev->merges += b->segments;
+}
+
+/* blk_enqueue
+* Inputs: - dev : device with interrupts off
+          - req : new single-request run
+* Outputs: none
+* Side Effects: appends req to the run ending where it starts, or sorts it in as its own
+                run; either way the run it landed in then swallows the next one if they now touch
+*/
+static void blk_enqueue(blkdev_t * dev, blk_request_t * req) {
+    blk_request_t ** link = &dev->queue;
+    blk_request_t * prev = NULL;
+    blk_request_t * run;
+    blk_request_t * next;
+
+    while (*link != NULL && (*link)->sector <= req->sector) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+
+    if (prev != NULL && blk_joinable(dev, prev, req)) {
+        blk_join(dev, prev, req);
+        run = prev;
+    } else {
+        req->next = *link;
+        *link = req;
+        run = req;
+    }
+
+    next = run->next;
+    if (next != NULL && blk_joinable(dev, run, next)) {
+        run->next = next->next;
+        next->next = NULL;
+        blk_join(dev, run, next);
+    }
+}
+
+/* blk_submit
+* Inputs: - dev : block device
+          - req : sector, count, buf and dir filled in, count at most max_sectors
+* Outputs: return 0 once queued ; return -1 for a bad range
+* Side Effects: merges or sorts req into the queue and, unless the device is plugged,
+                dispatches whatever the driver will take
+*/
+int32_t blk_submit(blkdev_t * dev, blk_request_t * req) {
+    uint32_t flags;
+
+    if (dev == NULL || req == NULL || req->buf == NULL) return -1;
+    if (req->count == 0 || req->count > dev->max_sectors) return -1;
+    if (req->sector >= dev->num_sectors || req->count > dev->num_sectors - req->sector) return -1;
+
+    req->status = BLK_PENDING;
+    req->total = req->count;
+    req->segments = 1;
+    req->merged = NULL;
+    req->tail = req;
+    req->next = NULL;
+    req->queued_at = read_tsc();
+
+    cli_and_save(flags);
+    dev->depth++;
+    if (dev->depth > dev->max_depth) dev->max_depth = dev->depth;
+
+    blk_enqueue(dev, req);
+    if (dev->plugged == 0) blk_run_queue(dev);
+    restore_flags(flags);
+    return 0;
+}
+
+/* blk_plug
+* Inputs: - dev : block device
+* Outputs: none
+* Side Effects: requests submitted from now on wait in the queue, where later ones can merge into them
+*/
+void blk_plug(blkdev_t * dev) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    dev->plugged++;
+    restore_flags(flags);
+}
+
+/* blk_unplug
+* Inputs: - dev : block device
+* Outputs: none
+* Side Effects: when the last plug is pulled, dispatches the queue
+*/
+void blk_unplug(blkdev_t * dev) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (dev->plugged > 0 && --dev->plugged == 0) blk_run_queue(dev);
+    restore_flags(flags);
+}
+
+/* blk_run_queue
+* Inputs: - dev : device with interrupts off
+* Outputs: none
+* Side Effects: hands runs to the driver in C-LOOK order until it reports busy: the next run
+                at or past head_pos, wrapping to the lowest sector at the end of a sweep
+*/
+static void blk_run_queue(blkdev_t * dev) {
+    blk_request_t ** link;
+    blk_request_t * run;
+    uint32_t started = 0;
+    int32_t ret;
+
+    while (dev->queue != NULL) {
+        link = &dev->queue;
+        while (*link != NULL && (*link)->sector < dev->head_pos) link = &(*link)->next;
+        if (*link == NULL) link = &dev->queue;
+        run = *link;
+
+        ret = dev->dispatch(dev, run);
+        if (ret == BLK_BUSY) break;
+
+        *link = run->next;
+        run->next = NULL;
+        if (ret != BLK_STARTED) {
+            blk_complete(dev, run, BLK_ERROR);
+            continue;
+        }
+        dev->head_pos = run->sector + run->total;
+        dev->dispatches++;
+        started = 1;
+    }
+    if (started && dev->unplug != NULL) dev->unplug(dev);
+}
+
+/* blk_complete
+* Inputs: - dev : device the run executed on
+          - req : first request of the finished run
+          - status : BLK_DONE or BLK_ERROR
+* Outputs: none
+* Side Effects: accounts and wakes every request of the run, then refills the device from the queue
+*/
+void blk_complete(blkdev_t * dev, blk_request_t * req, int32_t status) {
+    blk_request_t * next;
+    uint32_t lat, flags;
+
+    cli_and_save(flags);
+    while (req != NULL) {
+        // the waiter may reuse req as soon as its status changes, so read the link first
+        next = req->merged;
+
+        lat = read_tsc() - req->queued_at;
+        dev->lat_avg += ((int32_t)(lat - dev->lat_avg)) >> BLK_LAT_WEIGHT;
+        if (lat > dev->lat_max) dev->lat_max = lat;
+        dev->depth--;
+
+        if (status != BLK_DONE) {
+            dev->errors++;
+        } else if (req->dir == BLK_WRITE) {
+            dev->writes++;
+            dev->sectors_written += req->count;
+        } else {
+            dev->reads++;
+            dev->sectors_read += req->count;
+        }
+        req->status = status;
+        req = next;
+    }
+    if (dev->plugged == 0) blk_run_queue(dev);
+    restore_flags(flags);
+}
+
+/* blk_kick
+* Inputs: - dev : block device
+* Outputs: none
+* Side Effects: dispatches the queue unless it is plugged, for a driver whose devices share
+                hardware and turned dev away while another one had it
+*/
+void blk_kick(blkdev_t * dev) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    if (dev->plugged == 0) blk_run_queue(dev);
+    restore_flags(flags);
+}
+
+/* blk_dma_reachable
+* Inputs: - buf, len : buffer
+* Outputs: return 1 if a bus master can use the buffer in place ; return 0 if it must be bounced
+* Side Effects: none
+*/
+int32_t blk_dma_reachable(const uint8_t * buf, uint32_t len) {
+    uint32_t start = (uint32_t)buf;
+
+    // descriptors need even addresses and lengths
+    if (start & 1) return 0;
+    // the kernel page and the frame pool are identity mapped in every page directory
+    if (start >= FOUR_MB && start + len <= 2 * FOUR_MB) return 1;
+    if (start >= FRAME_POOL_START && start + len <= FRAME_POOL_START + FOUR_MB) return 1;
+    return 0;
+}
+
+/* blk_run_reachable
+* Inputs: - req : first request of a run
+* Outputs: return 1 if the device can DMA straight into every buffer of the run ; return 0 otherwise
+* Side Effects: none
+*/
+int32_t blk_run_reachable(blk_request_t * req) {
+    for (; req != NULL; req = req->merged) {
+        if (!blk_dma_reachable(req->buf, req->count << BLK_SECTOR_SHIFT)) return 0;
+    }
+    return 1;
+}
+
+/* blk_bounce
+* Inputs: - req : first request of a run
+          - frames : 4KB frames, enough for the run's total
+          - to_frames : 1 to gather the buffers into the frames, 0 to scatter the frames back out
+* Outputs: none
+* Side Effects: the run's bytes are laid end to end across the frames
+*/
+void blk_bounce(blk_request_t * req, uint8_t ** frames, uint32_t to_frames) {
+    uint32_t pos = 0; // byte offset into the frames
+    uint32_t off, len;
+    uint8_t * frame;
+
+    for (; req != NULL; req = req->merged) {
+        for (off = 0; off < (req->count << BLK_SECTOR_SHIFT); off += len, pos += len) {
+            len = FOUR_KB - pos % FOUR_KB;
+            if (len > (req->count << BLK_SECTOR_SHIFT) - off) len = (req->count << BLK_SECTOR_SHIFT) - off;
+            frame = frames[pos / FOUR_KB] + pos % FOUR_KB;
+            if (to_frames) {
+                memcpy(frame, req->buf + off, len);
+            } else {
+                memcpy(req->buf + off, frame, len);
+            }
+        }
+    }
+}
+
+/* blk_transfer
+* Inputs: - dev, sector, count, buf : as blk_read/blk_write
+          - dir : BLK_READ or BLK_WRITE
+* Outputs: return 0 for success ; return -1 if any chunk failed
+* Side Effects: splits the range into max_sectors chunks and keeps up to BLK_BATCH of them
+                queued; the first batch goes in plugged so the driver sees it all at once
+*/
+static int32_t blk_transfer(blkdev_t * dev, uint32_t sector, uint32_t count, uint8_t * buf, uint32_t dir) {
+    blk_request_t reqs[BLK_BATCH];
+    blk_request_t * req;
+    uint32_t chunks, submitted, done, off;
+    int32_t failed = 0;
+
+    if (dev == NULL || buf == NULL) return -1;
+    if (sector >= dev->num_sectors || count > dev->num_sectors - sector) return -1;
+
+    chunks = (count + dev->max_sectors - 1) / dev->max_sectors;
+    submitted = 0;
+    done = 0;
+
+    blk_plug(dev);
+    while (done < chunks) {
+        while (!failed && submitted < chunks && submitted - done < BLK_BATCH) {
+            req = &reqs[submitted % BLK_BATCH];
+            off = submitted * dev->max_sectors;
+            req->sector = sector + off;
+            req->count = (count - off < dev->max_sectors) ? count - off : dev->max_sectors;
+            req->buf = buf + (off << BLK_SECTOR_SHIFT);
+            req->dir = dir;
+            if (blk_submit(dev, req) != 0) {
+                failed = 1;
+                break;
+            }
+            submitted++;
+        }
+        if (done == 0) blk_unplug(dev);
+        // after a failure only drain what is already queued
+        if (done == submitted) break;
+
+        if (blk_wait(dev, &reqs[done % BLK_BATCH]) != 0) failed = 1;
+        done++;
+    }
+    return failed ? -1 : 0;
+}
+
+/* blk_wait
+* Inputs: - dev : device the request was submitted to
+          - req : request to wait for
+* Outputs: return 0 if it completed ; return -1 if it failed
+* Side Effects: halts until the IRQ handler completes req ; polls the device
+                instead if the caller had interrupts off
+*/
+int32_t blk_wait(blkdev_t * dev, blk_request_t * req) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    while (req->status == BLK_PENDING) {
+        if (flags & IF_FLAG) {
+            // sti only takes effect after hlt, so the completion can't slip in between the check and the halt
+            asm volatile ("sti; hlt; cli" ::: "memory");
+        } else {
+            dev->poll(dev);
+        }
+    }
+    restore_flags(flags);
+    return (req->status == BLK_DONE) ? 0 : -1;
+}
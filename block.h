@@ -0,0 +1,102 @@
+#ifndef BLOCK_H
+#define BLOCK_H
+
+#include "types.h"
+
+#define BLK_SECTOR_SIZE 512 // every block device is addressed in 512-byte sectors
+#define BLK_SECTOR_SHIFT 9
+#define MAX_BLKDEVS 16 // block devices that can register, disks plus one ramdisk per layer
+#define BLK_BATCH 16 // requests one transfer keeps queued on a device at once
+#define BLK_NAME_LEN 16 // longest device name, including the terminator
+#define BLK_LAT_WEIGHT 3 // latency average moves 1/8 of the way to each new sample
+
+// request direction
+#define BLK_READ 0
+#define BLK_WRITE 1
+
+// request status, written by blk_complete
+#define BLK_PENDING 0
+#define BLK_DONE 1
+#define BLK_ERROR -1
+
+// dispatch() results
+#define BLK_STARTED 0 // the device took the request, completion comes from the IRQ
+#define BLK_BUSY 1 // the device can't take another request until one in flight completes
+
+typedef struct blk_request {
+    uint32_t sector; // first sector
+    uint32_t count; // sectors in this request's own buffer
+    uint8_t * buf; // kernel address, count * BLK_SECTOR_SIZE bytes
+    uint32_t dir; // BLK_READ or BLK_WRITE
+    volatile int32_t status; // BLK_PENDING until the transfer carrying it completes
+    // owned by the block layer while the request is queued or in flight
+    uint32_t total; // sectors of the whole merged run, valid on its first request
+    uint32_t segments; // requests in the run, valid on its first request
+    uint32_t queued_at; // TSC when blk_submit took it, for latency
+    struct blk_request * next; // queue link, kept in sector order
+    struct blk_request * merged; // next request of the run, starting where this one ends
+    struct blk_request * tail; // last request of the run, valid on its first request
+} blk_request_t;
+
+typedef struct blkdev {
+    int8_t name[BLK_NAME_LEN]; // e.g. "hda"
+    uint32_t num_sectors; // capacity
+    uint32_t max_sectors; // largest run dispatch() accepts
+    uint32_t max_segments; // most buffers one run may scatter over
+    // start a run, walking req->merged for its buffers ; BLK_STARTED, BLK_BUSY,
+    // or -1 if it can never succeed
+    int32_t (*dispatch)(struct blkdev * dev, blk_request_t * req);
+    // tell the device about everything dispatched since the last call, NULL if dispatch starts it already
+    void (*unplug)(struct blkdev * dev);
+    // finish transfers from the status registers, for callers running with interrupts off
+    void (*poll)(struct blkdev * dev);
+    void * priv; // driver state
+    // request queue
+    blk_request_t * queue; // waiting runs, lowest sector first
+    uint32_t plugged; // nested blk_plug calls holding the queue back
+    uint32_t head_pos; // sector just past the last dispatched run, where the elevator sweeps from
+    // counters
+    uint32_t reads; // completed requests, before merging
+    uint32_t writes;
+    uint32_t sectors_read;
+    uint32_t sectors_written;
+    uint32_t errors;
+    uint32_t merges; // requests that rode along in another's run
+    uint32_t dispatches; // runs handed to the driver
+    uint32_t depth; // requests queued or in flight right now
+    uint32_t max_depth;
+    uint32_t lat_avg; // TSC cycles from blk_submit to completion, moving average
+    uint32_t lat_max;
+} blkdev_t;
+
+// add a block device, returns it or NULL if the table is full or the name is taken
+extern blkdev_t * register_blkdev(const int8_t * name, uint32_t num_sectors, uint32_t max_sectors,
+                                  uint32_t max_segments,
+                                  int32_t (*dispatch)(blkdev_t *, blk_request_t *),
+                                  void (*unplug)(blkdev_t *), void (*poll)(blkdev_t *), void * priv);
+// find a block device by name, NULL if nothing registered it
+extern blkdev_t * lookup_blkdev(const int8_t * name);
+// the n-th registered block device, NULL past the end
+extern blkdev_t * get_blkdev(uint32_t n);
+// synchronous transfers of count sectors, split to the device's max_sectors ; 0 or -1
+extern int32_t blk_read(blkdev_t * dev, uint32_t sector, uint32_t count, void * buf);
+extern int32_t blk_write(blkdev_t * dev, uint32_t sector, uint32_t count, const void * buf);
+// queue a request, merging it with waiting runs it touches ; 0 or -1 for a bad range
+extern int32_t blk_submit(blkdev_t * dev, blk_request_t * req);
+// hold submitted requests back so they can merge / release them to the driver
+extern void blk_plug(blkdev_t * dev);
+extern void blk_unplug(blkdev_t * dev);
+// sleep until a submitted request completes, returns 0 or -1 if it failed
+extern int32_t blk_wait(blkdev_t * dev, blk_request_t * req);
+// 1 if the buffer is identity mapped so a device can DMA to it directly, 0 if it needs a bounce
+extern int32_t blk_dma_reachable(const uint8_t * buf, uint32_t len);
+// 1 if every buffer of a run is DMA reachable
+extern int32_t blk_run_reachable(blk_request_t * req);
+// copy a run's buffers into (to_frames) or out of consecutive 4KB bounce frames
+extern void blk_bounce(blk_request_t * req, uint8_t ** frames, uint32_t to_frames);
+// called by a driver, usually from its IRQ handler, when a run finishes
+extern void blk_complete(blkdev_t * dev, blk_request_t * req, int32_t status);
+// called by a driver when something that made it report BLK_BUSY for dev is free again
+extern void blk_kick(blkdev_t * dev);
+
+#endif
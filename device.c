@@ -0,0 +1,156 @@
+#include "device.h"
+#include "lib.h"
+#include "types.h"
+
+// every registered device, chained per bucket through device_t.next
+static device_t devices[MAX_DEVICES];
+static uint32_t num_devices = 0;
+static int32_t dev_hash[DEV_HASH_SIZE];
+
+// dentry filetype -> driver jumptable, so open() never switches on the type
+static filetype_ops_t filetypes[NUM_FILETYPES];
+
+static int32_t null_read(int32_t fd, void * buf, int32_t nbytes);
+static int32_t null_write(int32_t fd, const void * buf, int32_t nbytes);
+static int32_t zero_read(int32_t fd, void * buf, int32_t nbytes);
+static int32_t mem_open(const uint8_t * filename);
+static int32_t mem_close(int32_t fd);
+
+const fops null_fops = {mem_open, mem_close, null_read, null_write};
+const fops zero_fops = {mem_open, mem_close, zero_read, null_write};
+
+/* init_devices
+* Inputs: none
+* Outputs: none
+* Side Effects: empties the registry and registers /dev/null and /dev/zero
+*/
+void init_devices() {
+    int i;
+
+    num_devices = 0;
+    for (i = 0; i < DEV_HASH_SIZE; i++) {
+        dev_hash[i] = NO_DEVICE;
+    }
+    memset(filetypes, 0, sizeof(filetypes));
+
+    register_device((int8_t *)"/dev/null", MAJOR_MEM, MINOR_NULL, &null_fops);
+    register_device((int8_t *)"/dev/zero", MAJOR_MEM, MINOR_ZERO, &zero_fops);
+}
+
+/* register_device
+* Inputs: - name : path open() should resolve to this device
+          - major, minor : device number
+          - ops : driver jumptable
+* Outputs: return 0 for success ; return -1 if full, the name is too long or already taken
+* Side Effects: links the device into its hash bucket
+*/
+int32_t register_device(const int8_t * name, uint32_t major, uint32_t minor, const fops * ops) {
+    uint32_t bucket;
+    device_t * dev;
+
+    if (name == NULL || ops == NULL || num_devices >= MAX_DEVICES) return -1;
+    if (strlen(name) >= DEV_NAME_LEN) return -1;
+    if (lookup_device((const uint8_t *)name) != NULL) return -1;
+
+    bucket = strhash(name, DEV_NAME_LEN) & (DEV_HASH_SIZE - 1);
+
+    dev = &devices[num_devices];
+    strncpy(dev->name, name, DEV_NAME_LEN);
+    dev->devno = MKDEV(major, minor);
+    dev->ops = ops;
+    dev->next = dev_hash[bucket];
+    dev_hash[bucket] = num_devices;
+
+    num_devices++;
+    return 0;
+}
+
+/* register_filetype
+* Inputs: - filetype : dentry filetype value (RTC_TYPE, FOLDER_TYPE, FILE_TYPE, ...)
+          - ops : jumptable for dentries of that type
+          - devno : device number the dentry stands for, 0 for plain files
+* Outputs: return 0 for success ; return -1 for a bad filetype
+* Side Effects: replaces any earlier binding for the filetype
+*/
+int32_t register_filetype(uint32_t filetype, const fops * ops, uint32_t devno) {
+    if (filetype >= NUM_FILETYPES || ops == NULL) return -1;
+
+    filetypes[filetype].ops = ops;
+    filetypes[filetype].devno = devno;
+    return 0;
+}
+
+/* lookup_device
+* Inputs: - name : device path
+* Outputs: pointer to the registered device ; NULL if not found
+* Side Effects: none
+*/
+device_t * lookup_device(const uint8_t * name) {
+    int32_t i;
+
+    i = dev_hash[strhash((const int8_t *)name, DEV_NAME_LEN) & (DEV_HASH_SIZE - 1)];
+    while (i != NO_DEVICE) {
+        if (strncmp(devices[i].name, (const int8_t *)name, DEV_NAME_LEN) == 0) {
+            return &devices[i];
+        }
+        i = devices[i].next;
+    }
+    return NULL;
+}
+
+/* lookup_filetype
+* Inputs: - filetype : dentry filetype value
+* Outputs: binding for the filetype ; NULL if no driver registered it
+* Side Effects: none
+*/
+const filetype_ops_t * lookup_filetype(uint32_t filetype) {
+    if (filetype >= NUM_FILETYPES || filetypes[filetype].ops == NULL) return NULL;
+    return &filetypes[filetype];
+}
+
+/* null_read
+* Inputs: unused
+* Outputs: return 0, the null device is always at end of file
+* Side Effects: none
+*/
+static int32_t null_read(int32_t fd, void * buf, int32_t nbytes) {
+    return 0;
+}
+
+/* null_write
+* Inputs: - nbytes : number of bytes "written"
+* Outputs: return nbytes, everything written is discarded
+* Side Effects: none
+*/
+static int32_t null_write(int32_t fd, const void * buf, int32_t nbytes) {
+    return nbytes;
+}
+
+/* zero_read
+* Inputs: - buf : buffer to fill
+          - nbytes : number of bytes to fill
+* Outputs: return nbytes
+* Side Effects: fills the buffer with zeros
+*/
+static int32_t zero_read(int32_t fd, void * buf, int32_t nbytes) {
+    memset(buf, 0, nbytes);
+    return nbytes;
+}
+
+/* mem_open
+* Inputs: unused
+* Outputs: return 0
+* Side Effects: none
+*/
+static int32_t mem_open(const uint8_t * filename) {
+    return 0;
+}
+
+/* mem_close
+* Inputs: unused
+* Outputs: return 0
+* Side Effects: none
+*/
+static int32_t mem_close(int32_t fd) {
+    return 0;
+}
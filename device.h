@@ -0,0 +1,51 @@
+#ifndef DEVICE_H
+#define DEVICE_H
+
+#include "types.h"
+#include "sys_call.h"
+
+// registry sizes
+#define MAX_DEVICES 32 // devices that can register
+#define DEV_HASH_SIZE 64 // buckets in the /dev name table (power of two)
+#define DEV_NAME_LEN 32 // longest device path, including the terminator
+#define NUM_FILETYPES 8 // filetype values a dentry can carry
+#define NO_DEVICE -1 // end of a hash chain / empty bucket
+
+// major numbers, one per driver
+#define MAJOR_MEM 1 // minor 0 is null, minor 1 is zero
+#define MAJOR_TTY 4 // minor 0 is the console, minor 64 is COM1
+#define MAJOR_RTC 10
+#define MINOR_NULL 0
+#define MINOR_ZERO 1
+#define MINOR_CONSOLE 0
+#define MINOR_SERIAL 64
+
+// pack/unpack a device number
+#define MKDEV(major, minor) (((major) << 8) | (minor))
+#define DEV_MAJOR(dev) ((dev) >> 8)
+#define DEV_MINOR(dev) ((dev) & 0xFF)
+
+typedef struct {
+    int8_t name[DEV_NAME_LEN]; // path that open() resolves, e.g. "/dev/null"
+    uint32_t devno; // MKDEV(major, minor)
+    const fops * ops; // driver jumptable shared by every open of the device
+    int32_t next; // next device in the same hash bucket
+} device_t;
+
+typedef struct {
+    const fops * ops; // jumptable for dentries of this filetype
+    uint32_t devno; // device behind the filetype, 0 for plain files and folders
+} filetype_ops_t;
+
+// clear the registry and register the memory devices
+extern void init_devices();
+// add a named device, returns 0 or -1 if the table is full or the name is taken
+extern int32_t register_device(const int8_t * name, uint32_t major, uint32_t minor, const fops * ops);
+// bind a dentry filetype to a jumptable (and optionally the device it stands for)
+extern int32_t register_filetype(uint32_t filetype, const fops * ops, uint32_t devno);
+// resolve a device path through the name hash, NULL if nothing is registered there
+extern device_t * lookup_device(const uint8_t * name);
+// jumptable entry for a dentry filetype, NULL if no driver claimed it
+extern const filetype_ops_t * lookup_filetype(uint32_t filetype);
+
+#endif
@@ -2,183 +2,1815 @@
 #include "types.h"
 #include "lib.h"
 #include "sys_call.h"
+#include "device.h"
+#include "lz4.h"
+#include "bcache.h"
+#include "ramdisk.h"
+
+const fops dir_fops = {dir_open, dir_close, dir_read, dir_write};
+const fops file_fops = {file_open, file_close, file_read, file_write};
 
 static uint32_t file_begin; //start of the filesystem
 static uint32_t boot_begin; //start of the bootblock
 static uint32_t inode_begin; //start of the inodes
 static uint32_t data_begin; //start of the data blocks
+static blkdev_t * data_dev; // device under the current layer
+static uint32_t data_start; // its block holding data block 0
+static journal_t * journal; // current layer's metadata log
+
+// mounted modules. Everything below that describes "the image" (boot_begin through
+// block_bitmap) is the current layer's, set by use_layer
+static fs_layer_t layers[MAX_LAYERS];
+static uint32_t num_layers = 0;
+static fs_layer_t * layer = NULL; // current layer
+static uint32_t layer_bits = 0; // current layer's number in inode position, tags cache entries
+
+// root names visible through the union, the later layer's wherever two layers share a name
+static union_entry_t union_dir[MAX_UNION_DENTRY];
+static uint16_t union_hash[UNION_HASH_SIZE];
+static uint32_t union_count = 0;
+
+// static uint32_t total_dirs;
+// static uint32_t total_inodes;
+// static uint32_t total_data;
+
+fstats_t file_stats; // holds data about the file MOVEC TO HEADER
+dentry_t * dentry_arr = NULL; // array of the data entries
+inode_t * inode_arr; // array of inodes MOVED TO HEADER
+
+fs_stats_t fs_stats;
+
+static uint32_t * inode_bitmap; // set for inodes in use
+static uint32_t * block_bitmap; // set for data blocks in use
+
+static uint32_t fs_version; // FS_VERSION_1 or FS_VERSION_2
+
+static run_list_t run_cache[RUN_CACHE_SIZE]; // per-inode block run lists
+static uint32_t run_cache_clock = 0; // bumped on every lookup, orders slots for LRU
+
+static uint32_t fs_features = 0; // FS_FEATURE_* flags of a version 1 image
+static ind_cache_t ind_cache[IND_CACHE_SIZE]; // recently used indirect blocks
+static uint32_t ind_cache_clock = 0; // bumped on every lookup, orders slots for LRU
+
+static frame_cache_t frame_cache[FRAME_CACHE_SIZE]; // decompressed blocks of compressed files
+static uint32_t frame_cache_clock = 0; // bumped on every lookup, orders slots for LRU
+static uint8_t frame_scratch[LZ4_BOUND(SIZE_OF_BLOCKS)]; // one stored frame on its way in
+
+static dcache_entry_t dcache[DCACHE_SIZE]; // direct mapped by (directory, name)
+
+/* extent_inode
+* Inputs: - inode : index of inode
+* Outputs: the inode viewed in the version 2 layout
+* Side Effects: none
+*/
+static inode_v2_t * extent_inode(uint32_t inode) {
+    return (inode_v2_t *)&inode_arr[inode];
+}
+
+/* is_compressed
+* Inputs: - inode : index of inode
+* Outputs: nonzero if the file is stored as LZ4 frames
+* Side Effects: none
+*/
+static uint32_t is_compressed(uint32_t inode) {
+    return fs_version == FS_VERSION_2 && (extent_inode(inode)->flags & INODE_COMPRESSED);
+}
+
+/* file_blocks
+* Inputs: - inode : index of inode
+* Outputs: number of data blocks holding the file's contents
+* Side Effects: none
+*/
+static uint32_t file_blocks(uint32_t inode) {
+    inode_v2_t * node;
+    uint32_t i, blocks;
+
+    // a compressed file takes fewer blocks than its length says, and all of them are in extents
+    if(is_compressed(inode)) {
+        node = extent_inode(inode);
+        blocks = 0;
+        for(i = 0; i < node->num_extents && i < NUM_EXTENTS; ++i) {
+            blocks += node->extents[i].length;
+        }
+        return blocks;
+    }
+    return (inode_arr[inode].length + SIZE_OF_BLOCKS - 1) / SIZE_OF_BLOCKS;
+}
+
+/* use_layer
+* Inputs: - n : mounted layer
+* Outputs: none
+* Side Effects: points the image globals (boot block, inodes, data, bitmaps) at the layer, so
+                the helpers below work on it
+*/
+static void use_layer(uint32_t n) {
+    if(layer == &layers[n]) {
+        return;
+    }
+    layer = &layers[n];
+    layer_bits = n << LAYER_SHIFT;
+
+    boot_begin = layer->boot_begin;
+    inode_begin = layer->inode_begin;
+    data_begin = layer->data_begin;
+    data_dev = layer->dev;
+    data_start = layer->data_start;
+    journal = &layer->journal;
+    fs_version = layer->version;
+    fs_features = layer->features;
+    inode_bitmap = layer->inode_bitmap;
+    block_bitmap = layer->block_bitmap;
+
+    memcpy(&file_stats, (void*) boot_begin, STATS_SIZE);
+    dentry_arr = (dentry_t *)(boot_begin + STATS_SIZE);
+    inode_arr = (inode_t *)(inode_begin);
+}
+
+/* enter_layer
+* Inputs: - inode : inode number as handed out, layer included
+* Outputs: the inode within its layer ; NO_INODE (past every layer's inodes) if there is no
+           such layer
+* Side Effects: makes the inode's layer the current one
+*/
+static uint32_t enter_layer(uint32_t inode) {
+    if(LAYER_OF(inode) >= num_layers) {
+        return NO_INODE;
+    }
+    use_layer(LAYER_OF(inode));
+    return LOCAL_INODE(inode);
+}
+
+/* global_inode
+* Inputs: - n : layer
+          - inode : inode within the layer, as dentries store it
+* Outputs: the inode number handed out for it
+* Side Effects: none
+*/
+static uint32_t global_inode(uint32_t n, uint32_t inode) {
+    // an inode too big to tag stays out of range rather than aliasing a real one
+    return (inode >> LAYER_SHIFT) ? NO_INODE : (n << LAYER_SHIFT) | inode;
+}
+
+/* union_dentry
+* Inputs: - entry : a name in the merged root index
+* Outputs: the dentry it stands for, in its layer's boot block
+* Side Effects: none
+*/
+static dentry_t * union_dentry(const union_entry_t * entry) {
+    return &((dentry_t *)(layers[entry->layer].boot_begin + STATS_SIZE))[entry->index];
+}
+
+/* union_find
+* Inputs: - fname : name in the root directory, at most MAX_ENTRY_LEN characters
+* Outputs: index of the visible dentry in union_dir ; UNION_HASH_END if no layer has the name
+* Side Effects: none
+*/
+static uint32_t union_find(const uint8_t* fname) {
+    uint32_t i;
+
+    i = union_hash[strhash((const int8_t *)fname, MAX_ENTRY_LEN) & (UNION_HASH_SIZE - 1)];
+    while(i != UNION_HASH_END) {
+        fs_stats.dentries_scanned++;
+        if(strncmp(union_dentry(&union_dir[i])->filename, (const int8_t *)fname, MAX_ENTRY_LEN) == 0) {
+            return i;
+        }
+        i = union_dir[i].next;
+    }
+    return UNION_HASH_END;
+}
+
+/* build_union
+* Inputs: none
+* Outputs: none
+* Side Effects: rehashes every layer's root dentries into the merged index, from the top layer
+                down so a name already taken there hides the same name below
+*/
+static void build_union() {
+    uint32_t n, i, bucket;
+
+    union_count = 0;
+    for(i = 0; i < UNION_HASH_SIZE; ++i) {
+        union_hash[i] = UNION_HASH_END;
+    }
+    for(n = num_layers; n-- > 0; ) {
+        use_layer(n);
+        for(i = 0; i < file_stats.total_dirs && i < MAX_NUM_DENTRY; ++i) {
+            if(union_find((uint8_t *)dentry_arr[i].filename) != UNION_HASH_END) continue;
+
+            bucket = strhash(dentry_arr[i].filename, MAX_ENTRY_LEN) & (UNION_HASH_SIZE - 1);
+            union_dir[union_count].layer = n;
+            union_dir[union_count].index = i;
+            union_dir[union_count].next = union_hash[bucket];
+            union_hash[bucket] = union_count++;
+        }
+    }
+}
+
+/* root_lookup
+* Inputs: - * fname : name of an entry in the root directory
+          - * dentry : pointer to a dentry
+* Outputs: return 0 for success ; return -1 for failure
+* Side Effects: copies the appropriate data into the dentry struct based on if the file is found
+*/
+static int32_t root_lookup(const uint8_t* fname, dentry_t* dentry){
+    uint32_t i;
+
+    if(strlen((const int8_t *)fname) > MAX_ENTRY_LEN || (i = union_find(fname)) == UNION_HASH_END) {
+        return FS_FAIL;
+    }
+    return read_dentry_by_index(i, dentry);
+}
+
+/* read_dentry_by_index
+* Inputs: - index: index into the root directory, as the union shows it
+          - * dentry : pointer to a dentry
+* Outputs: return 0 for success ; return -1 for failure
+* Side Effects: copies the appropriate data into the dentry struct
+*/
+int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry) {
+    dentry_t * entry;
+    int32_t ret_val = FS_FAIL;
+
+    if(index < union_count) {
+        //copy the appropriate data into the dentry based on the dentry arr element
+        entry = union_dentry(&union_dir[index]);
+        dentry->filetype = entry->filetype;
+        dentry->inode_index = global_inode(union_dir[index].layer, entry->inode_index);
+        strncpy(dentry->filename, (const int8_t *)entry->filename, MAX_ENTRY_LEN);
+        ret_val = FS_SUCCESS;
+    }
+
+    return ret_val;
+}
+
+/* layer_entry
+* Inputs: - index: index into the current layer's own root directory
+          - * dentry : pointer to a dentry
+* Outputs: return 0 for success ; return -1 past the end
+* Side Effects: same as read_dentry_by_index, whether or not a later layer hides the name
+*/
+static int32_t layer_entry(uint32_t index, dentry_t* dentry) {
+    if(index >= file_stats.total_dirs || index >= MAX_NUM_DENTRY) {
+        return FS_FAIL;
+    }
+    dentry->filetype = dentry_arr[index].filetype;
+    dentry->inode_index = global_inode(LAYER_OF(layer_bits), dentry_arr[index].inode_index);
+    strncpy(dentry->filename, (const int8_t *)dentry_arr[index].filename, MAX_ENTRY_LEN);
+    return FS_SUCCESS;
+}
+
+/* dir_size
+* Inputs: - dir : directory inode, ROOT_INODE for the root
+* Outputs: number of dentries in the directory
+* Side Effects: none
+*/
+static uint32_t dir_size(uint32_t dir) {
+    if(dir == ROOT_INODE) {
+        return union_count;
+    }
+    dir = enter_layer(dir);
+    if(dir >= file_stats.total_inodes) {
+        return 0;
+    }
+    return inode_arr[dir].length / sizeof(dentry_t);
+}
+
+/* dir_entry
+* Inputs: - dir : directory inode, ROOT_INODE for the root
+          - index : which dentry
+          - dentry : pointer to a dentry
+* Outputs: return 0 for success ; return -1 if the index is past the end
+* Side Effects: copies the dentry out of the boot block or the directory's data
+*/
+static int32_t dir_entry(uint32_t dir, uint32_t index, dentry_t* dentry) {
+    if(dir == ROOT_INODE) {
+        return read_dentry_by_index(index, dentry);
+    }
+    if(index >= dir_size(dir) ||
+       read_data(dir, index * sizeof(dentry_t), (uint8_t *)dentry, sizeof(dentry_t)) != sizeof(dentry_t)) {
+        return FS_FAIL;
+    }
+    // a subdirectory only ever names inodes of its own layer
+    dentry->inode_index = global_inode(LAYER_OF(dir), dentry->inode_index);
+    return FS_SUCCESS;
+}
+
+/* subdir_lookup
+* Inputs: - dir : inode of a subdirectory
+          - fname : name of an entry in it
+          - dentry : pointer to a dentry
+* Outputs: return 0 for success ; return -1 for failure
+* Side Effects: binary searches the directory's dentries, which are kept in name order
+*/
+static int32_t subdir_lookup(uint32_t dir, const uint8_t* fname, dentry_t* dentry) {
+    uint32_t lo, hi, mid;
+    int32_t cmp;
+
+    lo = 0;
+    hi = dir_size(dir);
+    while(lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if(dir_entry(dir, mid, dentry) != FS_SUCCESS) {
+            return FS_FAIL;
+        }
+        fs_stats.dentries_scanned++;
+        cmp = strncmp(dentry->filename, (const int8_t *)fname, MAX_ENTRY_LEN);
+        if(cmp == 0) {
+            return FS_SUCCESS;
+        }
+        if(cmp < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return FS_FAIL;
+}
+
+/* dcache_slot
+* Inputs: - parent : directory searched
+          - fname : name searched for
+* Outputs: the cache slot the pair maps to
+* Side Effects: none
+*/
+static dcache_entry_t * dcache_slot(uint32_t parent, const uint8_t* fname) {
+    return &dcache[(strhash((const int8_t *)fname, MAX_ENTRY_LEN) + parent * DCACHE_MIX) & (DCACHE_SIZE - 1)];
+}
+
+/* dcache_forget
+* Inputs: - parent : directory that changed
+          - fname : name added to or removed from it
+* Outputs: none
+* Side Effects: drops the cached answer for the pair, found or not
+*/
+static void dcache_forget(uint32_t parent, const uint8_t* fname) {
+    dcache_entry_t * entry = dcache_slot(parent, fname);
+
+    if(entry->parent == parent && strncmp(entry->name, (const int8_t *)fname, MAX_ENTRY_LEN) == 0) {
+        entry->state = DCACHE_EMPTY;
+    }
+}
+
+/* dir_lookup
+* Inputs: - parent : directory to search, ROOT_INODE for the root
+          - fname : one path component, at most MAX_ENTRY_LEN characters
+          - dentry : pointer to a dentry
+* Outputs: return 0 for success ; return -1 for failure
+* Side Effects: answers from the dentry cache when it can, otherwise searches the directory
+                and caches the result, a miss included
+*/
+static int32_t dir_lookup(uint32_t parent, const uint8_t* fname, dentry_t* dentry) {
+    dcache_entry_t * entry = dcache_slot(parent, fname);
+    int32_t ret_val;
+
+    if(entry->state != DCACHE_EMPTY && entry->parent == parent &&
+       strncmp(entry->name, (const int8_t *)fname, MAX_ENTRY_LEN) == 0) {
+        if(entry->state == DCACHE_NEGATIVE) {
+            fs_stats.dcache_negative_hits++;
+            return FS_FAIL;
+        }
+        fs_stats.dcache_hits++;
+        memcpy(dentry->filename, entry->name, MAX_ENTRY_LEN);
+        dentry->filetype = entry->filetype;
+        dentry->inode_index = entry->inode_index;
+        return FS_SUCCESS;
+    }
+
+    fs_stats.dcache_misses++;
+    if(parent == ROOT_INODE) {
+        ret_val = root_lookup(fname, dentry);
+    } else {
+        ret_val = subdir_lookup(parent, fname, dentry);
+    }
+
+    entry->state = (ret_val == FS_SUCCESS) ? DCACHE_POSITIVE : DCACHE_NEGATIVE;
+    entry->parent = parent;
+    strncpy(entry->name, (const int8_t *)fname, MAX_ENTRY_LEN);
+    entry->filetype = (ret_val == FS_SUCCESS) ? dentry->filetype : 0;
+    entry->inode_index = (ret_val == FS_SUCCESS) ? dentry->inode_index : 0;
+    return ret_val;
+}
+
+/* walk_path
+* Inputs: - * fname : '/' separated path, relative to the root whether or not it starts with '/'
+          - * dentry : pointer to a dentry
+* Outputs: return 0 for success ; return -1 for failure
+* Side Effects: looks up one component at a time, descending into each subdirectory. "."
+                stays put, ".." goes back up (and stops at the root). An empty path is the
+                root directory itself
+*/
+static int32_t walk_path(const uint8_t* fname, dentry_t* dentry) {
+    uint32_t parents[MAX_PATH_DEPTH];
+    uint32_t depth, dir, len;
+    uint8_t name[MAX_ENTRY_LEN + 1];
+
+    depth = 0;
+    dir = ROOT_INODE;
+    memset(dentry, 0, sizeof(dentry_t));
+    dentry->filetype = FOLDER_TYPE;
+    dentry->inode_index = ROOT_INODE;
+    dentry->filename[0] = '.';
+
+    while(1) {
+        while(*fname == '/') fname++;
+        if(*fname == '\0') {
+            return FS_SUCCESS;
+        }
+        // only a directory has anything under it
+        if(dentry->filetype != FOLDER_TYPE) {
+            return FS_FAIL;
+        }
+
+        for(len = 0; fname[len] != '\0' && fname[len] != '/'; ++len);
+        if(len > MAX_ENTRY_LEN) {
+            return FS_FAIL;
+        }
+        memcpy(name, fname, len);
+        name[len] = '\0';
+        fname += len;
+
+        if(strncmp((int8_t *)name, ".", 2) == 0) {
+            continue;
+        }
+        if(strncmp((int8_t *)name, "..", 3) == 0) {
+            if(depth > 0) dir = parents[--depth];
+            memset(dentry, 0, sizeof(dentry_t));
+            dentry->filetype = FOLDER_TYPE;
+            dentry->inode_index = dir;
+            dentry->filename[0] = '.';
+            continue;
+        }
+
+        if(dir_lookup(dir, name, dentry) != FS_SUCCESS) {
+            return FS_FAIL;
+        }
+        // "." never gets this far, so any folder found is a subdirectory to descend into
+        if(dentry->filetype == FOLDER_TYPE) {
+            if(depth == MAX_PATH_DEPTH || enter_layer(dentry->inode_index) >= file_stats.total_inodes) {
+                return FS_FAIL;
+            }
+            parents[depth++] = dir;
+            dir = dentry->inode_index;
+        }
+    }
+}
+
+/* read_dentry_by_name
+* Inputs: - * fname : '/' separated path from the root directory
+          - * dentry : pointer to a dentry
+* Outputs: return 0 for success ; return -1 for failure
+* Side Effects: copies the appropriate data into the dentry struct based on if the file is found
+*/
+int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry) {
+    fs_stats.lookups++;
+    if(fname == NULL || dentry == NULL || walk_path(fname, dentry) != FS_SUCCESS) {
+        fs_stats.lookup_misses++;
+        return FS_FAIL;
+    }
+    return FS_SUCCESS;
+}
+
+/* data_table
+* Inputs: - block : data block holding block numbers
+* Outputs: the block viewed as an indirect table ; NULL if the block is out of range
+* Side Effects: none ; tables are metadata and are used in place in the image, only file
+                data goes through the buffer cache
+*/
+static uint32_t * data_table(uint32_t block) {
+    return (block < file_stats.total_data) ? (uint32_t *)((block_data_t *)data_begin + block) : NULL;
+}
+
+/* data_buf
+* Inputs: - block : data block of the current layer
+          - fill : 1 to read the block in on a miss, 0 if the caller overwrites all of it
+* Outputs: the block's cache buffer, release with brelse ; NULL if the block is out of range,
+           the cache has no free buffer or the read failed
+* Side Effects: may sleep on the layer's device
+*/
+static buf_t * data_buf(uint32_t block, uint32_t fill) {
+    if(block >= file_stats.total_data) {
+        return NULL;
+    }
+    return fill ? bread(data_dev, data_start + block) : bget(data_dev, data_start + block);
+}
+
+/* indirect_table
+* Inputs: - inode : index of inode
+          - key : IND_SINGLE, or 1 + index into the inode's double indirect block
+* Outputs: the indirect block ; NULL if its block number is out of range
+* Side Effects: caches the answer in the least recently used slot on a miss
+*/
+static uint32_t * indirect_table(uint32_t inode, uint32_t key) {
+    ind_cache_t * victim = &ind_cache[0];
+    uint32_t * table;
+    int i;
+
+    ind_cache_clock++;
+    for(i = 0; i < IND_CACHE_SIZE; ++i) {
+        if(ind_cache[i].inode == (layer_bits | inode) && ind_cache[i].key == key) {
+            ind_cache[i].last_used = ind_cache_clock;
+            fs_stats.ind_cache_hits++;
+            return ind_cache[i].table;
+        }
+        if(ind_cache[i].inode == IND_CACHE_EMPTY || ind_cache[i].last_used < victim->last_used) {
+            victim = &ind_cache[i];
+        }
+    }
+
+    fs_stats.ind_cache_misses++;
+    if(key == IND_SINGLE) {
+        table = data_table(inode_arr[inode].node_data[SINGLE_INDIRECT]);
+    } else {
+        table = data_table(inode_arr[inode].node_data[DOUBLE_INDIRECT]);
+        table = (table == NULL) ? NULL : data_table(table[key - 1]);
+    }
+    if(table == NULL) {
+        return NULL;
+    }
+
+    victim->inode = layer_bits | inode;
+    victim->key = key;
+    victim->table = table;
+    victim->last_used = ind_cache_clock;
+    return table;
+}
+
+/* invalidate_indirect
+* Inputs: - inode : index of inode
+* Outputs: none
+* Side Effects: drops the inode's cached indirect blocks, for when they are freed
+*/
+static void invalidate_indirect(uint32_t inode) {
+    int i;
+    for(i = 0; i < IND_CACHE_SIZE; ++i) {
+        if(ind_cache[i].inode == (layer_bits | inode)) {
+            ind_cache[i].inode = IND_CACHE_EMPTY;
+        }
+    }
+}
+
+/* indirect_slot
+* Inputs: - file_block : block of the file, past the direct ones
+          - key : set to the indirect_table key that holds it
+* Outputs: index of the block number in that table ; NO_BLOCK past the double indirect range
+* Side Effects: none
+*/
+static uint32_t indirect_slot(uint32_t file_block, uint32_t * key) {
+    file_block -= NUM_DIRECT_BLOCKS;
+    if(file_block < PTRS_PER_BLOCK) {
+        *key = IND_SINGLE;
+        return file_block;
+    }
+    file_block -= PTRS_PER_BLOCK;
+    if(file_block / PTRS_PER_BLOCK >= PTRS_PER_BLOCK) {
+        return NO_BLOCK;
+    }
+    *key = 1 + file_block / PTRS_PER_BLOCK;
+    return file_block % PTRS_PER_BLOCK;
+}
+
+/* inode_block
+* Inputs: - inode : index of a version 1 inode
+          - file_block : block of the file
+* Outputs: data block holding file_block ; NO_BLOCK if the inode can't address it
+* Side Effects: none
+*/
+static uint32_t inode_block(uint32_t inode, uint32_t file_block) {
+    uint32_t key, slot;
+    uint32_t * table;
+
+    if(!(fs_features & FS_FEATURE_INDIRECT)) {
+        return (file_block < NUM_DATA_BLOCKS) ? inode_arr[inode].node_data[file_block] : NO_BLOCK;
+    }
+    if(file_block < NUM_DIRECT_BLOCKS) {
+        return inode_arr[inode].node_data[file_block];
+    }
+
+    slot = indirect_slot(file_block, &key);
+    if(slot == NO_BLOCK) {
+        return NO_BLOCK;
+    }
+    table = indirect_table(inode, key);
+    return (table == NULL) ? NO_BLOCK : table[slot];
+}
+
+/* walk_run
+* Inputs: - inode : index of inode
+          - file_block : block of the file
+          - run : set to the longest run of back-to-back data blocks starting at file_block
+* Outputs: return 0 for success ; return -1 if file_block is past the end of the file or
+           its block number is out of range
+* Side Effects: version 1 walks the block numbers forward from file_block; version 2 finds
+                the extent holding file_block, which is already the whole run
+*/
+static int32_t walk_run(uint32_t inode, uint32_t file_block, block_run_t * run) {
+    uint32_t num_blocks, skip, i;
+    inode_v2_t * node;
+
+    num_blocks = file_blocks(inode);
+    if(file_block >= num_blocks) {
+        return FS_FAIL;
+    }
+    run->file_block = file_block;
+
+    if(fs_version == FS_VERSION_2) {
+        node = extent_inode(inode);
+        skip = file_block;
+        for(i = 0; i < node->num_extents && i < NUM_EXTENTS; ++i) {
+            if(skip < node->extents[i].length) {
+                run->data_block = node->extents[i].start + skip;
+                run->length = node->extents[i].length - skip;
+                if(run->length > num_blocks - file_block) {
+                    run->length = num_blocks - file_block;
+                }
+                return (run->data_block < file_stats.total_data &&
+                        run->length <= file_stats.total_data - run->data_block) ? FS_SUCCESS : FS_FAIL;
+            }
+            skip -= node->extents[i].length;
+        }
+        return FS_FAIL;
+    }
+
+    run->data_block = inode_block(inode, file_block);
+    if(run->data_block >= file_stats.total_data) {
+        return FS_FAIL;
+    }
+    run->length = 1;
+    while(file_block + run->length < num_blocks &&
+          inode_block(inode, file_block + run->length) == run->data_block + run->length) {
+        run->length++;
+    }
+    return FS_SUCCESS;
+}
+
+/* block_of
+* Inputs: - inode : index of inode
+          - file_block : block of the file
+* Outputs: data block holding file_block ; NO_BLOCK if the file doesn't have one there
+* Side Effects: none
+*/
+static uint32_t block_of(uint32_t inode, uint32_t file_block) {
+    block_run_t run;
+
+    if(fs_version == FS_VERSION_1) {
+        return inode_block(inode, file_block);
+    }
+    return (walk_run(inode, file_block, &run) == FS_SUCCESS) ? run.data_block : NO_BLOCK;
+}
+
+/* build_extent_runs
+* Inputs: - inode : index of a version 2 inode
+          - list : cache slot to fill
+          - num_blocks : blocks the file's length covers
+* Outputs: return 0 for success ; return -1 if an extent is out of range or the extents
+           don't cover the file
+* Side Effects: one run per extent, or RUNS_OVERFLOW past MAX_RUNS of them
+*/
+static int32_t build_extent_runs(uint32_t inode, run_list_t * list, uint32_t num_blocks) {
+    inode_v2_t * node = extent_inode(inode);
+    uint32_t i, file_block = 0;
+    block_run_t * run;
+
+    for(i = 0; i < node->num_extents && i < NUM_EXTENTS && file_block < num_blocks; ++i) {
+        if(node->extents[i].length == 0) continue;
+        if(node->extents[i].start >= file_stats.total_data ||
+           node->extents[i].length > file_stats.total_data - node->extents[i].start) {
+            list->inode = RUN_CACHE_EMPTY;
+            return FS_FAIL;
+        }
+
+        if(list->num_runs == MAX_RUNS) {
+            list->num_runs = RUNS_OVERFLOW;
+            return FS_SUCCESS;
+        }
+        run = &list->runs[list->num_runs++];
+        run->file_block = file_block;
+        run->data_block = node->extents[i].start;
+        run->length = node->extents[i].length;
+        file_block += run->length;
+    }
+
+    if(file_block < num_blocks) {
+        list->inode = RUN_CACHE_EMPTY;
+        return FS_FAIL;
+    }
+    return FS_SUCCESS;
+}
+
+/* build_runs
+* Inputs: - inode : index of inode
+          - list : cache slot to fill
+* Outputs: return 0 for success ; return -1 if a block number is out of range
+* Side Effects: fills list with the file's runs of back-to-back data blocks, or marks it
+                RUNS_OVERFLOW if there are more than MAX_RUNS of them
+*/
+static int32_t build_runs(uint32_t inode, run_list_t * list) {
+    uint32_t num_blocks, i, block;
+    block_run_t * run = NULL;
+
+    num_blocks = file_blocks(inode);
+    list->inode = layer_bits | inode;
+    list->num_runs = 0;
+
+    if(fs_version == FS_VERSION_2) {
+        return build_extent_runs(inode, list, num_blocks);
+    }
+
+    for(i = 0; i < num_blocks; ++i) {
+        block = inode_block(inode, i);
+        if(block >= file_stats.total_data) {
+            list->inode = RUN_CACHE_EMPTY;
+            return FS_FAIL;
+        }
+
+        // extend the current run while the next block follows the last one
+        if(run != NULL && block == run->data_block + run->length) {
+            run->length++;
+            continue;
+        }
+
+        if(list->num_runs == MAX_RUNS) {
+            list->num_runs = RUNS_OVERFLOW;
+            return FS_SUCCESS;
+        }
+        run = &list->runs[list->num_runs++];
+        run->file_block = i;
+        run->data_block = block;
+        run->length = 1;
+    }
+    return FS_SUCCESS;
+}
+
+/* get_runs
+* Inputs: - inode : index of inode
+* Outputs: the inode's cached run list, NULL if its blocks are invalid
+* Side Effects: builds the list into the least recently used slot on a miss
+*/
+static run_list_t * get_runs(uint32_t inode) {
+    run_list_t * victim = &run_cache[0];
+    int i;
+
+    run_cache_clock++;
+    for(i = 0; i < RUN_CACHE_SIZE; ++i) {
+        if(run_cache[i].inode == (layer_bits | inode)) {
+            run_cache[i].last_used = run_cache_clock;
+            fs_stats.run_cache_hits++;
+            return &run_cache[i];
+        }
+        if(run_cache[i].inode == RUN_CACHE_EMPTY || run_cache[i].last_used < victim->last_used) {
+            victim = &run_cache[i];
+        }
+    }
+
+    fs_stats.run_cache_misses++;
+    if(build_runs(inode, victim) == FS_FAIL) {
+        return NULL;
+    }
+    victim->last_used = run_cache_clock;
+    return victim;
+}
+
+/* find_run
+* Inputs: - inode : index of inode
+          - list : the inode's run list
+          - file_block : block of the file being read
+          - run : set to the run starting at file_block
+* Outputs: return 0 for success ; return -1 if a block number is out of range
+* Side Effects: binary searches a cached list; for a RUNS_OVERFLOW file falls back to
+                walk_run
+*/
+static int32_t find_run(uint32_t inode, run_list_t * list, uint32_t file_block, block_run_t * run) {
+    uint32_t lo, hi, mid;
+
+    if(list->num_runs != RUNS_OVERFLOW) {
+        lo = 0;
+        hi = list->num_runs;
+        while(hi - lo > 1) {
+            mid = (lo + hi) / 2;
+            if(list->runs[mid].file_block <= file_block) {
+                lo = mid;
+            } else {
+                hi = mid;
+            }
+        }
+        // trim the run so it starts at file_block
+        run->file_block = file_block;
+        run->data_block = list->runs[lo].data_block + (file_block - list->runs[lo].file_block);
+        run->length = list->runs[lo].length - (file_block - list->runs[lo].file_block);
+        return FS_SUCCESS;
+    }
+
+    return walk_run(inode, file_block, run);
+}
+
+/* invalidate_runs
+* Inputs: - inode : index of inode
+* Outputs: none
+* Side Effects: drops the inode's cached run list so the next read rebuilds it
+*/
+void invalidate_runs(uint32_t inode) {
+    int i;
+    for(i = 0; i < RUN_CACHE_SIZE; ++i) {
+        if(run_cache[i].inode == (layer_bits | inode)) {
+            run_cache[i].inode = RUN_CACHE_EMPTY;
+        }
+    }
+}
+
+/* copy_blocks
+* Inputs: - inode : index of inode
+          - offset : byte offset in the stored data
+          - *buf : buffer to fill
+          - length : number of bytes, the caller keeps it inside the file's blocks
+* Outputs: return length for success ; return -1 for failure
+* Side Effects: walks the file a run of back-to-back data blocks at a time, copying each
+                block out of the buffer cache once the run's misses are all on their way in
+*/
+static int32_t copy_blocks(uint32_t inode, uint32_t offset, uint8_t * buf, uint32_t length) {
+
+    uint32_t num_reads, run_end, byte_range, block_range;
+    run_list_t * list;
+    block_run_t run;
+    buf_t * b;
+
+    list = get_runs(inode);
+    if(list == NULL) {
+        return FS_FAIL;
+    }
+
+    // nothing read yet
+    num_reads = 0;
+    while(num_reads < length) {
+        if(find_run(inode, list, offset / SIZE_OF_BLOCKS, &run) == FS_FAIL) {
+            return FS_FAIL;
+        }
+
+        // copy up to the end of the run or the end of the request, whichever is first
+        run_end = (run.file_block + run.length) * SIZE_OF_BLOCKS;
+        byte_range = run_end - offset;
+        if(byte_range > length - num_reads) {
+            byte_range = length - num_reads;
+        }
+
+        fs_stats.runs_copied++;
+        block_range = (offset + byte_range - 1) / SIZE_OF_BLOCKS - offset / SIZE_OF_BLOCKS + 1;
+        fs_stats.blocks_read += block_range;
+
+        // start every missing block of the run at once so they reach the device as one transfer
+        if(block_range > 1 && run.data_block + block_range <= file_stats.total_data) {
+            breadahead(data_dev, data_start + run.data_block, block_range);
+        }
+
+        // the run's blocks sit next to each other on the device but each has its own buffer
+        for(; byte_range > 0; byte_range -= block_range) {
+            block_range = SIZE_OF_BLOCKS - (offset % SIZE_OF_BLOCKS);
+            if(block_range > byte_range) {
+                block_range = byte_range;
+            }
+
+            b = data_buf(run.data_block + (offset / SIZE_OF_BLOCKS - run.file_block), 1);
+            if(b == NULL) {
+                return FS_FAIL;
+            }
+            memcpy(buf + num_reads, b->data + (offset % SIZE_OF_BLOCKS), block_range);
+            brelse(b);
+
+            num_reads += block_range;
+            offset += block_range;
+        }
+    }
+
+    return num_reads;
+}
+
+/* get_frame
+* Inputs: - inode : index of a compressed inode
+          - frame : which 4kB of the file
+* Outputs: the decompressed block ; NULL if the stream is corrupt
+* Side Effects: decodes into the least recently used cache slot on a miss
+*/
+static uint8_t * get_frame(uint32_t inode, uint32_t frame) {
+    frame_cache_t * victim = &frame_cache[0];
+    uint32_t bounds[2], stored, expected, stream_size;
+    int i;
+
+    frame_cache_clock++;
+    for(i = 0; i < FRAME_CACHE_SIZE; ++i) {
+        if(frame_cache[i].inode == (layer_bits | inode) && frame_cache[i].frame == frame) {
+            frame_cache[i].last_used = frame_cache_clock;
+            fs_stats.frame_cache_hits++;
+            return frame_cache[i].data;
+        }
+        if(frame_cache[i].inode == FRAME_CACHE_EMPTY || frame_cache[i].last_used < victim->last_used) {
+            victim = &frame_cache[i];
+        }
+    }
+    fs_stats.frames_decompressed++;
+
+    // the frame's start and end sit next to each other in the offset table
+    stream_size = file_blocks(inode) * SIZE_OF_BLOCKS;
+    if((frame + 2) * sizeof(uint32_t) > stream_size ||
+       copy_blocks(inode, frame * sizeof(uint32_t), (uint8_t *)bounds, sizeof(bounds)) == FS_FAIL) {
+        return NULL;
+    }
+    stored = bounds[1] - bounds[0];
+    if(bounds[1] < bounds[0] || bounds[1] > stream_size || stored > sizeof(frame_scratch)) {
+        return NULL;
+    }
+
+    expected = inode_arr[inode].length - frame * SIZE_OF_BLOCKS;
+    if(expected > SIZE_OF_BLOCKS) {
+        expected = SIZE_OF_BLOCKS;
+    }
+
+    // the slot is only valid again once it holds the whole frame
+    victim->inode = FRAME_CACHE_EMPTY;
+    if(copy_blocks(inode, bounds[0], frame_scratch, stored) == FS_FAIL) {
+        return NULL;
+    }
+    if(stored == expected) {
+        memcpy(victim->data, frame_scratch, stored);
+    } else if(lz4_decompress(frame_scratch, stored, victim->data, expected) != expected) {
+        return NULL;
+    }
+
+    victim->inode = layer_bits | inode;
+    victim->frame = frame;
+    victim->last_used = frame_cache_clock;
+    return victim->data;
+}
+
+/* read_frames
+* Inputs: - inode : index of a compressed inode
+          - offset : byte offset in the file
+          - *buf : buffer to fill
+          - length : number of bytes, already clipped to the file
+* Outputs: return length for success ; return -1 for failure
+* Side Effects: decompresses (or reuses) each 4kB frame the range touches
+*/
+static int32_t read_frames(uint32_t inode, uint32_t offset, uint8_t * buf, uint32_t length) {
+    uint32_t num_reads, byte_range;
+    uint8_t * frame;
+
+    num_reads = 0;
+    while(num_reads < length) {
+        frame = get_frame(inode, offset / SIZE_OF_BLOCKS);
+        if(frame == NULL) {
+            return FS_FAIL;
+        }
+
+        byte_range = SIZE_OF_BLOCKS - (offset % SIZE_OF_BLOCKS);
+        if(byte_range > length - num_reads) {
+            byte_range = length - num_reads;
+        }
+        memcpy(buf + num_reads, frame + (offset % SIZE_OF_BLOCKS), byte_range);
+
+        num_reads += byte_range;
+        offset += byte_range;
+    }
+
+    return num_reads;
+}
+
+/* invalidate_frames
+* Inputs: - inode : index of inode
+* Outputs: none
+* Side Effects: drops the inode's decompressed blocks, for when the file goes away
+*/
+static void invalidate_frames(uint32_t inode) {
+    int i;
+    for(i = 0; i < FRAME_CACHE_SIZE; ++i) {
+        if(frame_cache[i].inode == (layer_bits | inode)) {
+            frame_cache[i].inode = FRAME_CACHE_EMPTY;
+        }
+    }
+}
+
+/* read_data
+* Inputs: - inode : index of inode
+          - offset : byte offset in the file
+          - *buf : buffer to hold certain data string
+          - length : number of bytes to read
+* Outputs: return number of bytes read for success ; return -1 for failure
+* Side Effects: writes the data to the buffer's location in memory, straight from the data
+                blocks or, for a compressed file, through the decompressed block cache
+*/
+int32_t read_data(uint32_t inode, uint32_t offset, uint8_t * buf, uint32_t length) {
+
+    uint32_t fsize;
+    int32_t num_reads;
+
+    fs_stats.reads++;
+
+    // check for invalid parameters - return FS_FAIL if invalid
+    inode = enter_layer(inode);
+    if(inode >= file_stats.total_inodes) {
+        return FS_FAIL;
+    }
+
+    // use inode_arr to get size of file
+    fsize = inode_arr[inode].length;
+
+    if(offset >= fsize || length == 0) return 0;
+
+    // length can't be bigger than the size of the file
+    if(length > fsize - offset) {
+        length = fsize - offset;
+    }
+
+    if(is_compressed(inode)) {
+        num_reads = read_frames(inode, offset, buf, length);
+    } else {
+        num_reads = copy_blocks(inode, offset, buf, length);
+    }
+    if(num_reads > 0) {
+        fs_stats.bytes_read += num_reads;
+    }
+
+    // returning num_reads indicates successful read_data
+    return num_reads;
+}
+
+/* check_invalid_block
+* Inputs: - inode : the inode index to check
+          - block_loc: the block to check
+* Outputs: return 1 if the data in the inode is bigger than the total data; return 0 else
+* Side Effects: none
+*/
+uint32_t check_invalid_block(uint32_t block_loc, uint32_t inode) {
+
+    inode = enter_layer(inode);
+    if(inode >= file_stats.total_inodes) {
+        return 1;
+    }
+    //if the data in the inode is bigger than the total data
+    return (block_of(inode, block_loc) >= file_stats.total_data) ? 1 : 0;
+
+}
+
+/* mark_run
+* Inputs: - block : first data block
+          - length : number of data blocks
+* Outputs: none
+* Side Effects: marks the blocks used in the free-block bitmap
+*/
+static void mark_run(uint32_t block, uint32_t length) {
+    for(; length > 0 && block < MAX_FS_BLOCKS; --length, ++block) {
+        bitmap_set(block_bitmap, block);
+    }
+}
+
+/* release_block
+* Inputs: - block : data block to give back
+* Outputs: none
+* Side Effects: clears it in the free-block bitmap if it was in use
+*/
+static void release_block(uint32_t block) {
+    if(block < file_stats.total_data && block < MAX_FS_BLOCKS && bitmap_test(block_bitmap, block)) {
+        bitmap_clear(block_bitmap, block);
+        fs_stats.free_blocks++;
+        journal_dirty_maps(journal);
+    }
+}
+
+/* indirect_blocks
+* Inputs: - inode : index of inode
+          - release : nonzero to free the blocks, zero to mark them used
+* Outputs: none
+* Side Effects: visits the single, double and every used second-level indirect block of a
+                FS_FEATURE_INDIRECT inode
+*/
+static void indirect_blocks(uint32_t inode, int32_t release) {
+    uint32_t num_blocks, used, i;
+    uint32_t * table;
+
+    if(fs_version != FS_VERSION_1 || !(fs_features & FS_FEATURE_INDIRECT)) {
+        return;
+    }
+
+    num_blocks = file_blocks(inode);
+    if(num_blocks <= NUM_DIRECT_BLOCKS) {
+        return;
+    }
+    if(release) release_block(inode_arr[inode].node_data[SINGLE_INDIRECT]);
+    else mark_run(inode_arr[inode].node_data[SINGLE_INDIRECT], 1);
+
+    if(num_blocks <= NUM_DIRECT_BLOCKS + PTRS_PER_BLOCK) {
+        return;
+    }
+    used = (num_blocks - NUM_DIRECT_BLOCKS - 1) / PTRS_PER_BLOCK;
+    table = data_table(inode_arr[inode].node_data[DOUBLE_INDIRECT]);
+    for(i = 0; table != NULL && i < used && i < PTRS_PER_BLOCK; ++i) {
+        if(release) release_block(table[i]);
+        else mark_run(table[i], 1);
+    }
+    if(release) release_block(inode_arr[inode].node_data[DOUBLE_INDIRECT]);
+    else mark_run(inode_arr[inode].node_data[DOUBLE_INDIRECT], 1);
+}
+
+/* mark_file
+* Inputs: - inode : index of a file or subdirectory inode
+* Outputs: return 0 if the inode was newly marked ; return -1 if it is bad or already marked
+* Side Effects: marks the inode and every block it references as used
+*/
+static int32_t mark_file(uint32_t inode) {
+    uint32_t j, num_blocks;
+    block_run_t run;
+
+    if(inode >= file_stats.total_inodes || bitmap_test(inode_bitmap, inode)) {
+        return FS_FAIL;
+    }
+    bitmap_set(inode_bitmap, inode);
+
+    num_blocks = file_blocks(inode);
+    for(j = 0; j < num_blocks && walk_run(inode, j, &run) == FS_SUCCESS; j += run.length) {
+        mark_run(run.data_block, run.length);
+    }
+    indirect_blocks(inode, 0);
+    return FS_SUCCESS;
+}
+
+/* mark_dir
+* Inputs: - dir : directory inode, ROOT_INODE for the current layer's root
+          - depth : how deep dir is in the tree
+* Outputs: none
+* Side Effects: marks every file and subdirectory under dir. A subdirectory that is already
+                marked (reachable twice) is not descended into again
+*/
+static void mark_dir(uint32_t dir, uint32_t depth) {
+    dentry_t dentry;
+    uint32_t i;
+
+    // the root is this layer's own boot block, not what the union shows
+    for(i = 0; ((dir == ROOT_INODE) ? layer_entry(i, &dentry) : dir_entry(dir, i, &dentry)) == FS_SUCCESS; ++i) {
+        if(dentry.filetype == FILE_TYPE) {
+            mark_file(enter_layer(dentry.inode_index));
+        } else if(dentry.filetype == FOLDER_TYPE && strncmp(dentry.filename, ".", 2) != 0 &&
+                  depth < MAX_PATH_DEPTH && mark_file(enter_layer(dentry.inode_index)) == FS_SUCCESS) {
+            mark_dir(dentry.inode_index, depth + 1);
+        }
+    }
+}
 
-// static uint32_t total_dirs;
-// static uint32_t total_inodes;
-// static uint32_t total_data;
+/* count_free
+* Inputs: none
+* Outputs: none
+* Side Effects: adds the current layer's unused inodes and blocks to the free counts
+*/
+static void count_free() {
+    uint32_t i;
 
-fstats_t file_stats; // holds data about the file MOVEC TO HEADER
-dentry_t * dentry_arr = NULL; // array of the data entries
-inode_t * inode_arr; // array of inodes MOVED TO HEADER
+    for(i = 0; i < file_stats.total_inodes && i < MAX_FS_INODES; ++i) {
+        if(!bitmap_test(inode_bitmap, i)) fs_stats.free_inodes++;
+    }
+    for(i = 0; i < file_stats.total_data && i < MAX_FS_BLOCKS; ++i) {
+        if(!bitmap_test(block_bitmap, i)) fs_stats.free_blocks++;
+    }
+}
+
+/* init_bitmaps
+* Inputs: none
+* Outputs: none
+* Side Effects: marks every inode reachable from the current layer's directory tree, and every
+                block those inodes reference, as used, and adds what is left to the free
+                counts. Inodes and blocks past the bitmap size stay used so they are never
+                handed out
+*/
+static void init_bitmaps() {
+    uint32_t i;
 
-uint8_t current_dir = 0;
+    memset(inode_bitmap, 0xFF, sizeof(layer->inode_bitmap));
+    memset(block_bitmap, 0xFF, sizeof(layer->block_bitmap));
+    for(i = 0; i < file_stats.total_inodes && i < MAX_FS_INODES; ++i) {
+        bitmap_clear(inode_bitmap, i);
+    }
+    for(i = 0; i < file_stats.total_data && i < MAX_FS_BLOCKS; ++i) {
+        bitmap_clear(block_bitmap, i);
+    }
 
-/* read_dentry_by_name
-* Inputs: - * fname : filename
-          - * dentry : pointer to a dentry
-* Outputs: return 0 for success ; return -1 for failure
-* Side Effects: copies the appropriate data into the dentry struct based on if the file is found
+    mark_dir(ROOT_INODE, 0);
+    count_free();
+}
+
+/* load_bitmaps
+* Inputs: - start : first block of the image's journal area
+          - len : blocks in it, 0 for an image without a journal
+* Outputs: none
+* Side Effects: with a journal, writes the committed tail of its log home and takes the
+                bitmaps from their homes, so mounting costs what changed since the last
+                checkpoint rather than a walk of every inode. Without one, or when its bitmaps
+                were never written home, falls back to init_bitmaps
 */
-int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry){
+static void load_bitmaps(uint32_t start, uint32_t len) {
+    uint32_t n = layer - layers;
+    int32_t replayed;
+
+    if(journal_open(journal, data_dev, start, len, inode_bitmap, sizeof(layer->inode_bitmap) >> BLK_SECTOR_SHIFT,
+                    block_bitmap, sizeof(layer->block_bitmap) >> BLK_SECTOR_SHIFT) == FS_FAIL) {
+        init_bitmaps();
+        return;
+    }
 
-    int i, copy_length;
-    int32_t ret_val;
-    int8_t * in_name; int8_t * curr_name;
+    replayed = journal_replay(journal);
+    if(replayed != 0) {
+        // the boot block may have been rewritten, reload our copy of the stats
+        layer = NULL;
+        use_layer(n);
+    }
+    if(replayed >= 0 && journal_load_maps(journal) == FS_SUCCESS) {
+        count_free();
+    } else {
+        init_bitmaps();
+    }
+    // the log starts over empty, and the bitmaps are home for the next mount
+    journal_checkpoint(journal);
+}
 
-    in_name = (int8_t *)fname; //filename passed in
-    ret_val = FS_FAIL; //set to -1 if not found or error
+/* log_block
+* Inputs: - addr : any address inside a metadata block of the current layer's image
+* Outputs: none
+* Side Effects: the block joins the layer's running journal transaction ; it is edited in
+                place, so it is logged as it stands when the transaction commits
+*/
+static void log_block(uint32_t addr) {
+    uint32_t block = (addr - boot_begin) / SIZE_OF_BLOCKS;
 
-    //go through dentry array
-    for(i = 0; i < MAX_NUM_DENTRY; ++i) {
+    journal_dirty(journal, block, (const void *)(boot_begin + block * SIZE_OF_BLOCKS), JOURNAL_BLOCK_SECTORS);
+}
 
-        curr_name = dentry_arr[i].filename; //the name of the current file in the dentry array to compare with passed in filename
-        copy_length = (strlen(in_name) == MAX_ENTRY_LEN) ? MAX_ENTRY_LEN : strlen(in_name) + 1; //set the copy length for strncmp (+1 for null character at end of string)
+/* log_dir
+* Inputs: none
+* Outputs: none
+* Side Effects: logs the current layer's root directory, which lives in the boot block
+*/
+static void log_dir() {
+    log_block(boot_begin);
+}
 
-        if(strncmp(curr_name, in_name, copy_length) != 0) {  //check if the filenames are the same
-            continue; // go to next element in dentry array
+/* alloc_block
+* Inputs: - hint : block the caller would like (the one after the file's previous block)
+          - want : free blocks the caller still needs, used to pick a run that fits them all
+* Outputs: return a free data block, or -1 if the image is full
+* Side Effects: the block is marked used and zeroed in the buffer cache, which writes it
+                back later ; no stale copy of its previous contents survives there
+*/
+static int32_t alloc_block(uint32_t hint, uint32_t want) {
+    uint32_t i, run, limit;
+    int32_t block = FS_FAIL;
+    buf_t * b;
+
+    limit = (file_stats.total_data < MAX_FS_BLOCKS) ? file_stats.total_data : MAX_FS_BLOCKS;
+
+    if(hint < limit && !bitmap_test(block_bitmap, hint)) {
+        // keeps the file contiguous with what it already has
+        block = hint;
+    } else {
+        // otherwise start a fresh run long enough for the rest of the write
+        run = 0;
+        for(i = 0; i < limit; ++i) {
+            run = bitmap_test(block_bitmap, i) ? 0 : run + 1;
+            if(run == want) {
+                block = i + 1 - want;
+                break;
+            }
+        }
+        // no run that long, take any free block
+        if(block == FS_FAIL) {
+            block = find_first_zero(block_bitmap, limit);
         }
+    }
+
+    if(block == FS_FAIL) {
+        return FS_FAIL;
+    }
 
-        dentry->filetype = dentry_arr[i].filetype; // fill in the dentry with the filetype
-        dentry->inode_index = dentry_arr[i].inode_index; //fill in the dentry with the inode index
-        strncpy(dentry->filename, (const int8_t *)curr_name, MAX_ENTRY_LEN); //copy the file name from the dentry array to the dentry
+    // claimed before the cache can sleep, so nobody else can take it meanwhile
+    bitmap_set(block_bitmap, block);
+    fs_stats.free_blocks--;
+    journal_dirty_maps(journal);
 
-        ret_val = FS_SUCCESS; //return 0
-        break; // the file was found so break the loop
+    b = data_buf(block, 0);
+    if(b == NULL) {
+        release_block(block);
+        return FS_FAIL;
     }
-    return ret_val;
+    memset(b->data, 0, SIZE_OF_BLOCKS);
+    bdirty(b);
+    brelse(b);
+    return block;
 }
 
-/* read_dentry_by_index
-* Inputs: - index: index into dentry array
-          - * dentry : pointer to a dentry
-* Outputs: return 0 for success ; return -1 for failure
-* Side Effects: copies the appropriate data into the dentry struct
+/* new_table
+* Inputs: - entry : where to store the new indirect block's number
+* Outputs: return 0 for success ; return -1 if the image is full
+* Side Effects: allocates a zeroed block from the first free spot, away from the file's
+                data so its run can keep growing. Tables are used in place, so the cached
+                copy is dropped before a writeback could land on top of them
 */
-int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry) {
-    int32_t ret_val = FS_FAIL;
+static int32_t new_table(uint32_t * entry) {
+    int32_t block = alloc_block(NO_BLOCK, 1);
 
-    // index is unsigned, so if it's less than 63, it's valid
-    if(index < MAX_NUM_DENTRY) {
-        //copy the appropriate data into the dentry based on the dentry arr element
-        dentry->filetype = dentry_arr[index].filetype;
-        dentry->inode_index = dentry_arr[index].inode_index;
-        strncpy(dentry->filename, (const int8_t *)dentry_arr[index].filename, MAX_ENTRY_LEN);
-        ret_val = FS_SUCCESS;
+    if(block == FS_FAIL) {
+        return FS_FAIL;
     }
-
-    return ret_val;
+    binval(data_dev, data_start + block);
+    memset(data_table(block), 0, SIZE_OF_BLOCKS);
+    log_block((uint32_t)data_table(block));
+    *entry = block;
+    return FS_SUCCESS;
 }
 
-/* read_data
+/* append_block
 * Inputs: - inode : index of inode
-          - offset : loc in dir entry array
-          - *buf : buffer to hold certain data string
-          - length : length of block
-* Outputs: return number of bytes read for success ; return -1 for failure
-* Side Effects: writes the data to the buffer's location in memory
+          - file_block : the file's current block count, where the new block goes
+          - block : data block to add
+* Outputs: return 0 for success ; return -1 if the inode has no room to record it
+* Side Effects: version 1 stores the block number, allocating the indirect block(s) that will
+                hold it when it is the first one behind them; version 2 grows the last extent
+                when block follows it and opens a new extent otherwise
 */
-int32_t read_data(uint32_t inode, uint32_t offset, uint8_t * buf, uint32_t length) {
-
-    uint32_t inode_block_loc_begin, inode_block_loc_end, num_reads, first_byte, last_byte, byte_range;
-    int32_t fsize;
-    int i;
-    block_data_t * curr_block;
-
-    // nothing read yet
-    num_reads = 0;
+static int32_t append_block(uint32_t inode, uint32_t file_block, uint32_t block) {
+    inode_v2_t * node;
+    extent_t * last;
+    uint32_t key, slot;
+    uint32_t * table;
+
+    if(fs_version == FS_VERSION_1) {
+        if(!(fs_features & FS_FEATURE_INDIRECT)) {
+            if(file_block >= NUM_DATA_BLOCKS) return FS_FAIL;
+            inode_arr[inode].node_data[file_block] = block;
+            return FS_SUCCESS;
+        }
+        if(file_block < NUM_DIRECT_BLOCKS) {
+            inode_arr[inode].node_data[file_block] = block;
+            return FS_SUCCESS;
+        }
 
-    // start of the inode block
-    inode_block_loc_begin = offset / SIZE_OF_BLOCKS;
+        slot = indirect_slot(file_block, &key);
+        if(slot == NO_BLOCK) return FS_FAIL;
+        if(file_block == NUM_DIRECT_BLOCKS && new_table(&inode_arr[inode].node_data[SINGLE_INDIRECT]) == FS_FAIL) {
+            return FS_FAIL;
+        }
+        if(key != IND_SINGLE && slot == 0) {
+            if(key == 1 && new_table(&inode_arr[inode].node_data[DOUBLE_INDIRECT]) == FS_FAIL) {
+                return FS_FAIL;
+            }
+            table = data_table(inode_arr[inode].node_data[DOUBLE_INDIRECT]);
+            if(table == NULL || new_table(&table[key - 1]) == FS_FAIL) {
+                // the file doesn't reach the double indirect block yet, so nothing else frees it
+                if(key == 1) release_block(inode_arr[inode].node_data[DOUBLE_INDIRECT]);
+                return FS_FAIL;
+            }
+            log_block((uint32_t)table);
+        }
 
-    // check for invalid parameters - return FS_FAIL if invalid
-    if( (inode >= file_stats.total_inodes) || check_invalid_block(inode_block_loc_begin, inode) ) {
-        return FS_FAIL;
+        table = indirect_table(inode, key);
+        if(table == NULL) return FS_FAIL;
+        table[slot] = block;
+        log_block((uint32_t)table);
+        return FS_SUCCESS;
     }
 
-    // use inode_arr to get size of file
-    fsize = inode_arr[inode].length;
+    node = extent_inode(inode);
+    if(node->num_extents > 0) {
+        last = &node->extents[node->num_extents - 1];
+        if(last->start + last->length == block) {
+            last->length++;
+            return FS_SUCCESS;
+        }
+    }
+    if(node->num_extents >= NUM_EXTENTS) return FS_FAIL;
 
-    if(offset > fsize - 1 || length == 0) return 0;
+    node->extents[node->num_extents].start = block;
+    node->extents[node->num_extents].length = 1;
+    node->num_extents++;
+    return FS_SUCCESS;
+}
 
-    // length can't be bigger than the size of the file
-    if(offset + length > fsize) {
-        length = fsize - offset;
+/* free_blocks
+* Inputs: - inode : index of inode
+* Outputs: none
+* Side Effects: returns every data block of the inode to the free bitmap and truncates it
+*/
+static void free_blocks(uint32_t inode) {
+    uint32_t i, j, num_blocks;
+    block_run_t run;
+
+    log_block((uint32_t)&inode_arr[inode]);
+    num_blocks = file_blocks(inode);
+    for(i = 0; i < num_blocks && walk_run(inode, i, &run) == FS_SUCCESS; i += run.length) {
+        for(j = 0; j < run.length; ++j) {
+            release_block(run.data_block + j);
+        }
+    }
+    indirect_blocks(inode, 1);
+    invalidate_indirect(inode);
+    invalidate_frames(inode);
+    inode_arr[inode].length = 0;
+    if(fs_version == FS_VERSION_2) {
+        extent_inode(inode)->num_extents = 0;
+        extent_inode(inode)->flags = 0;
     }
+    invalidate_runs(inode);
+}
 
-    // end of the inode block (given by length of block)
-    inode_block_loc_end = (offset + length) / SIZE_OF_BLOCKS;
+/* write_data
+* Inputs: - inode : index of inode
+          - offset : byte offset in the file, may be past the end (the gap reads as zeros)
+          - *buf : bytes to write
+          - length : number of bytes to write
+* Outputs: return number of bytes written ; return -1 for failure, also when the journal
+           commit this write triggered failed
+* Side Effects: allocates blocks for any part of the file that doesn't exist yet, preferring the
+                block right after the file's previous one, and grows the inode's length. The
+                bytes land in the buffer cache and reach the image at the next writeback
+*/
+int32_t write_data(uint32_t inode, uint32_t offset, const uint8_t * buf, uint32_t length) {
+    uint32_t num_blocks, last_block, i, hint, written, byte_range, max_size;
+    int32_t block;
+    buf_t * b;
+
+    // compressed files are read only
+    inode = enter_layer(inode);
+    if(inode >= file_stats.total_inodes || buf == NULL || is_compressed(inode)) {
+        return FS_FAIL;
+    }
+    if(length == 0) return 0;
+
+    // a plain version 1 inode has room for NUM_DATA_BLOCKS block numbers, indirect blocks and
+    // extents only run out when the image does
+    max_size = (fs_version == FS_VERSION_1 && !(fs_features & FS_FEATURE_INDIRECT)) ? NUM_DATA_BLOCKS : MAX_FS_BLOCKS;
+    max_size *= SIZE_OF_BLOCKS;
+    if(offset >= max_size) return FS_FAIL;
+    if(length > max_size - offset) {
+        length = max_size - offset;
+    }
 
-    // loop through entire set of inode block
-    for(i = inode_block_loc_begin; i < inode_block_loc_end + 1; ++i) {
-        // location
-        curr_block = (block_data_t *) boot_begin + (file_stats.total_inodes + 1 + (inode_arr[inode].node_data[i]));
+    // allocate every block between the current end of file and the end of the write
+    num_blocks = file_blocks(inode);
+    last_block = (offset + length - 1) / SIZE_OF_BLOCKS;
+    journal_begin(journal);
+    if(last_block >= num_blocks || offset + length > inode_arr[inode].length) {
+        log_block((uint32_t)&inode_arr[inode]);
+    }
+    for(i = num_blocks; i <= last_block; ++i) {
+        hint = (i > 0) ? block_of(inode, i - 1) + 1 : 0;
+        block = alloc_block(hint, last_block + 1 - i);
+        if(block != FS_FAIL && append_block(inode, i, block) == FS_FAIL) {
+            release_block(block);
+            block = FS_FAIL;
+        }
+        if(block == FS_FAIL) {
+            // image or inode full, write what fits
+            if(i * SIZE_OF_BLOCKS <= offset) {
+                journal_end(journal);
+                return FS_FAIL;
+            }
+            length = i * SIZE_OF_BLOCKS - offset;
+            break;
+        }
+    }
 
-        // assume entire block [0.4095]
-        first_byte = 0;
-        last_byte = SIZE_OF_BLOCKS;
+    // every block up to the end of the write exists now, and any gap was zeroed
+    if(offset + length > inode_arr[inode].length) {
+        inode_arr[inode].length = offset + length;
+    }
+    invalidate_runs(inode);
 
-        // check whether entire block will be iterated over - find proper first_byte locatoin
-        if(i * SIZE_OF_BLOCKS < offset) {
-            first_byte = offset - (i * SIZE_OF_BLOCKS);
+    written = 0;
+    while(written < length) {
+        byte_range = SIZE_OF_BLOCKS - (offset % SIZE_OF_BLOCKS);
+        if(byte_range > length - written) {
+            byte_range = length - written;
         }
 
-        // check whether entire block will be iterated over - find proper last_byte locatoin
-        if((++i) * SIZE_OF_BLOCKS > (offset + length)) {
-            last_byte = (offset + length) - (--i * SIZE_OF_BLOCKS);
-        } else {
-            --i;
+        // a whole block needn't be read in first
+        b = data_buf(block_of(inode, offset / SIZE_OF_BLOCKS), byte_range != SIZE_OF_BLOCKS);
+        if(b == NULL) {
+            break;
         }
+        memcpy(b->data + (offset % SIZE_OF_BLOCKS), buf + written, byte_range);
+        bdirty(b);
+        brelse(b);
 
-        // number of bytes read
-        byte_range = last_byte - first_byte;
+        written += byte_range;
+        offset += byte_range;
+    }
+    fs_stats.bytes_written += written;
+    if(journal_end(journal) == FS_FAIL) {
+        return FS_FAIL;
+    }
+    return (written > 0) ? (int32_t)written : FS_FAIL;
+}
 
-        // write the data to the buffer's location in memory!
-        memcpy( (char *)buf + num_reads, (char *)curr_block + first_byte, byte_range);
+/* create_file
+* Inputs: - fname : name of the new file, at most MAX_ENTRY_LEN characters and no '/'
+* Outputs: return 0 for success ; return -1 if the name is bad or taken, or the directory or
+           inode table is full, or the journal commit failed and the new file may not survive a crash
+* Side Effects: adds a FILE_TYPE dentry pointing at a free, empty inode of the top layer;
+                appended on a version 1 image, inserted in name order on a version 2 one
+*/
+int32_t create_file(const uint8_t* fname) {
+    dentry_t dentry;
+    dentry_t * new_entry;
+    int32_t inode, ret;
+    uint32_t limit, slot;
 
-        // increment number of bytes read
-        num_reads += byte_range;
+    if(fname == NULL || strlen((const int8_t *)fname) == 0 || strlen((const int8_t *)fname) > MAX_ENTRY_LEN) {
+        return FS_FAIL;
+    }
+    // files are only made in the root, so the name has to be a single component
+    for(slot = 0; fname[slot] != '\0'; ++slot) {
+        if(fname[slot] == '/') return FS_FAIL;
+    }
+    if(num_layers == 0 || root_lookup(fname, &dentry) == FS_SUCCESS) {
+        return FS_FAIL;
+    }
+    use_layer(num_layers - 1);
+    if(file_stats.total_dirs >= MAX_NUM_DENTRY) {
+        return FS_FAIL;
     }
 
-    // returning num_reads indicates successful read_data
-    return num_reads;
+    limit = (file_stats.total_inodes < MAX_FS_INODES) ? file_stats.total_inodes : MAX_FS_INODES;
+    inode = find_first_zero(inode_bitmap, limit);
+    if(inode == FS_FAIL) {
+        return FS_FAIL;
+    }
+    journal_begin(journal);
+    bitmap_set(inode_bitmap, inode);
+    fs_stats.free_inodes--;
+    journal_dirty_maps(journal);
+    log_block((uint32_t)&inode_arr[inode]);
+    inode_arr[inode].length = 0;
+    invalidate_runs(inode);
+
+    slot = file_stats.total_dirs;
+    if(fs_version == FS_VERSION_2) {
+        extent_inode(inode)->num_extents = 0;
+        extent_inode(inode)->flags = 0;
+        // shift every later name up one slot to keep the directory sorted
+        for(; slot > 0 && strncmp(dentry_arr[slot - 1].filename, (const int8_t *)fname, MAX_ENTRY_LEN) > 0; --slot) {
+            dentry_arr[slot] = dentry_arr[slot - 1];
+        }
+    }
+
+    new_entry = &dentry_arr[slot];
+    memset(new_entry, 0, sizeof(dentry_t));
+    strncpy(new_entry->filename, (const int8_t *)fname, MAX_ENTRY_LEN);
+    new_entry->filetype = FILE_TYPE;
+    new_entry->inode_index = inode;
+
+    // keep the boot block's copy of the stats in step with ours
+    file_stats.total_dirs++;
+    ((fstats_t *)boot_begin)->total_dirs = file_stats.total_dirs;
+    log_dir();
+    ret = journal_end(journal);
+    build_union();
+    dcache_forget(ROOT_INODE, fname);
+    return ret;
 }
 
-/* check_invalid_block
-* Inputs: - inode : the inode index to check
-          - block_loc: the block to check
-* Outputs: return 1 if the data in the inode is bigger than the total data; return 0 else
-* Side Effects: none
+/* delete_file
+* Inputs: - fname : name of a regular file in the root directory
+* Outputs: return 0 for success ; return -1 if there is no such regular file, or hold_inode
+           still has references on it, or the journal commit failed and the delete may not
+           survive a crash
+* Side Effects: frees the file's blocks and inode and packs the directory of the layer the
+                union shows it from, by moving the last dentry into the hole (version 1) or
+                shifting the later ones down so the order holds (version 2). A file of the
+                same name in an earlier layer shows through again
 */
-uint32_t check_invalid_block(uint32_t block_loc, uint32_t inode) {
+int32_t delete_file(const uint8_t* fname) {
+    uint32_t i, inode, last;
+    int32_t len, ret;
 
-    //if the data in the inode is bigger than the total data
-    return (inode_arr[inode].node_data[block_loc] >= file_stats.total_data) ? 1 : 0;
+    if(fname == NULL) {
+        return FS_FAIL;
+    }
+    len = strlen((const int8_t *)fname);
+    if(len == 0 || len > MAX_ENTRY_LEN) {
+        return FS_FAIL;
+    }
 
+    i = union_find(fname);
+    if(i == UNION_HASH_END || union_dentry(&union_dir[i])->filetype != FILE_TYPE) {
+        return FS_FAIL;
+    }
+    use_layer(union_dir[i].layer);
+    i = union_dir[i].index;
+
+    // freed blocks could be reused while a mapping still shows them
+    inode = dentry_arr[i].inode_index;
+    if(inode < MAX_FS_INODES && layer->inode_refs[inode] != 0) {
+        return FS_FAIL;
+    }
+    journal_begin(journal);
+
+    if(inode < file_stats.total_inodes) {
+        free_blocks(inode);
+        if(inode < MAX_FS_INODES && bitmap_test(inode_bitmap, inode)) {
+            bitmap_clear(inode_bitmap, inode);
+            fs_stats.free_inodes++;
+            journal_dirty_maps(journal);
+        }
+    }
+
+    last = file_stats.total_dirs - 1;
+    if(fs_version == FS_VERSION_2) {
+        for(; i < last; ++i) {
+            dentry_arr[i] = dentry_arr[i + 1];
+        }
+    } else if(i != last) {
+        dentry_arr[i] = dentry_arr[last];
+    }
+    memset(&dentry_arr[last], 0, sizeof(dentry_t));
+
+    file_stats.total_dirs--;
+    ((fstats_t *)boot_begin)->total_dirs = file_stats.total_dirs;
+    log_dir();
+    ret = journal_end(journal);
+    build_union();
+    dcache_forget(ROOT_INODE, fname);
+    return ret;
 }
 
 /* init_files
 * Inputs: - fstart: starting address of the file system
 * Outputs: none
-* Side Effects: initialize all globals in the filesystem to appropriate values
+* Side Effects: initialize all globals in the filesystem to appropriate values, with the image
+                at fs_start as the only layer
 */
 void init_files(uint32_t fs_start){
+    int i;
+
     file_begin = fs_start; //the starting address of the file system
-    boot_begin = file_begin; // boot block starting address
-    inode_begin = SIZE_OF_BLOCKS + boot_begin; // inode starting address
+    num_layers = 0;
+    layer = NULL;
+    fs_stats.free_inodes = 0;
+    fs_stats.free_blocks = 0;
+
+    // nothing cached from a previous image
+    for(i = 0; i < RUN_CACHE_SIZE; ++i) {
+        run_cache[i].inode = RUN_CACHE_EMPTY;
+        run_cache[i].last_used = 0;
+    }
+    for(i = 0; i < IND_CACHE_SIZE; ++i) {
+        ind_cache[i].inode = IND_CACHE_EMPTY;
+        ind_cache[i].last_used = 0;
+    }
+    for(i = 0; i < FRAME_CACHE_SIZE; ++i) {
+        frame_cache[i].inode = FRAME_CACHE_EMPTY;
+        frame_cache[i].last_used = 0;
+    }
+
+    mount_layer(fs_start);
+
+    // let open() reach directories and regular files without knowing about them
+    register_filetype(FOLDER_TYPE, &dir_fops, 0);
+    register_filetype(FILE_TYPE, &file_fops, 0);
+}
+
+/* mount_layer
+* Inputs: - fs_start: starting address of another image
+* Outputs: return 0 for success ; return -1 if MAX_LAYERS are already mounted or the image
+           can't be registered as a block device
+* Side Effects: the image becomes the top layer: its root names hide the same names in the
+                layers below, and files created from now on go in it. The merged root index
+                is rebuilt and the dentry cache emptied. A journaled image replays its log
+                tail instead of being scanned for free inodes and blocks
+*/
+int32_t mount_layer(uint32_t fs_start) {
+    fs_layer_t * new_layer;
+    fstats_t * stats = (fstats_t *)fs_start;
+    uint32_t journal_start, journal_len, num_blocks;
+
+    if(num_layers == MAX_LAYERS) {
+        return FS_FAIL;
+    }
+    new_layer = &layers[num_layers];
 
     // memcpy(&total_dirs, (void*) boot_begin, FOUR_B_OFFSET); //get the number of directories
     // memcpy(&total_inodes, (void*) (boot_begin + FOUR_B_OFFSET), FOUR_B_OFFSET); //get the number of inodes
     // memcpy(&total_data, (void*) (boot_begin + (2 * FOUR_B_OFFSET)), FOUR_B_OFFSET); //get the the number of data blocks
-    memcpy(&file_stats, (void*) boot_begin, STATS_SIZE); // initializing file_stats global variable
+    new_layer->boot_begin = fs_start; // boot block starting address
+
+    // a version 2 image stamps its magic at the start of the reserved bytes and puts the
+    // directory index between the boot block and the inodes. Names are only looked up through
+    // the merged union index, so that block is mkfs's alone: the kernel never reads it and
+    // doesn't keep it current, nor journal it, as files come and go
+    if(*(uint32_t *)stats->reserved == FS_MAGIC_V2) {
+        new_layer->version = FS_VERSION_2;
+        new_layer->features = 0;
+        new_layer->inode_begin = fs_start + 2 * SIZE_OF_BLOCKS; // inode starting address
+    } else {
+        new_layer->version = FS_VERSION_1;
+        new_layer->features = ((uint32_t *)stats->reserved)[FS_FEATURES_WORD];
+        new_layer->inode_begin = fs_start + SIZE_OF_BLOCKS; // inode starting address
+    }
+    new_layer->data_begin = new_layer->inode_begin + (SIZE_OF_BLOCKS * stats->total_inodes); // data_blocks starting address
+
+    // file data is read through the buffer cache like any other disk's, and the journal
+    // area, if the image has one, follows the data blocks
+    new_layer->data_start = (new_layer->data_begin - fs_start) / SIZE_OF_BLOCKS;
+    num_blocks = new_layer->data_start + stats->total_data;
+    journal_start = ((uint32_t *)stats->reserved)[FS_JOURNAL_WORD];
+    journal_len = ((uint32_t *)stats->reserved)[FS_JOURNAL_LEN_WORD];
+    if(journal_len != 0 && journal_start + journal_len > num_blocks) {
+        num_blocks = journal_start + journal_len;
+    }
+    new_layer->dev = register_ramdisk((uint8_t *)fs_start, num_blocks * SIZE_OF_BLOCKS);
+    if(new_layer->dev == NULL) {
+        return FS_FAIL;
+    }
+
+    num_layers++;
+    layer = NULL; // the slot may be reused, so load it even if it was current
+    use_layer(num_layers - 1);
+    load_bitmaps(journal_start, journal_len);
+
+    build_union();
+    memset(dcache, 0, sizeof(dcache));
+    fs_stats.version = new_layer->version;
+    fs_stats.features = new_layer->features;
+    fs_stats.layers = num_layers;
+    return FS_SUCCESS;
+}
+
+/* readahead_blocks
+* Inputs: - inode : index of inode, layer included
+          - file_block : first block of the file wanted soon
+          - count : blocks wanted
+* Outputs: none
+* Side Effects: starts cache reads of the data blocks behind them, a run at a time, under one
+                plug so the whole window reaches the device together ; compressed files are
+                skipped, the frame cache already keeps their blocks
+*/
+static void readahead_blocks(uint32_t inode, uint32_t file_block, uint32_t count) {
+    uint32_t num_blocks, len;
+    run_list_t * list;
+    block_run_t run;
+
+    inode = enter_layer(inode);
+    if(inode >= file_stats.total_inodes || is_compressed(inode)) {
+        return;
+    }
+    num_blocks = file_blocks(inode);
+    if(file_block >= num_blocks) {
+        return;
+    }
+    if(count > num_blocks - file_block) {
+        count = num_blocks - file_block;
+    }
+    list = get_runs(inode);
+    if(list == NULL) {
+        return;
+    }
+
+    blk_plug(data_dev);
+    while(count > 0 && find_run(inode, list, file_block, &run) == FS_SUCCESS) {
+        len = (run.length < count) ? run.length : count;
+        if(run.data_block + len > file_stats.total_data) {
+            break;
+        }
+        breadahead(data_dev, data_start + run.data_block, len);
+        file_block += len;
+        count -= len;
+    }
+    blk_unplug(data_dev);
+}
+
+/* file_readahead
+* Inputs: - desc : descriptor of a regular file
+          - nbytes : bytes the read about to happen at file_pos asks for
+* Outputs: none
+* Side Effects: adapts the descriptor's window to whether the read continues the last one,
+                and tops up the blocks read ahead once the reader has used half of them
+*/
+static void file_readahead(file_desc_t * desc, uint32_t nbytes) {
+    uint32_t first, last, from;
+
+    if(nbytes == 0) {
+        return;
+    }
+    if(desc->file_pos == desc->ra_pos) {
+        desc->ra_window = (desc->ra_window == 0) ? RA_MIN_BLOCKS : desc->ra_window * 2;
+        if(desc->ra_window > RA_MAX_BLOCKS) {
+            desc->ra_window = RA_MAX_BLOCKS;
+        }
+    } else {
+        // a seek: what was read ahead is of no use from here
+        desc->ra_window >>= RA_SHRINK_SHIFT;
+        desc->ra_end = 0;
+    }
+    if(desc->ra_window == 0) {
+        return;
+    }
 
-    data_begin = inode_begin + (SIZE_OF_BLOCKS * ((file_stats.total_inodes + 1))); // data_blocks starting address
-    dentry_arr = (dentry_t *)(boot_begin + STATS_SIZE); // setting starting address of data entries array
-    inode_arr = (inode_t *)(inode_begin); // setting starting address of inode data array
+    first = desc->file_pos / SIZE_OF_BLOCKS;
+    last = (desc->file_pos + nbytes - 1) / SIZE_OF_BLOCKS + 1;
+    if(desc->ra_end >= last + desc->ra_window / 2) {
+        return;
+    }
+    from = (desc->ra_end > first) ? desc->ra_end : first;
+    desc->ra_end = last + desc->ra_window;
+    readahead_blocks(desc->file_inode, from, desc->ra_end - from);
 }
 
 /* file_read
@@ -195,10 +1827,9 @@ int32_t file_read(int32_t fd, void *buf, int32_t nbytes) {
 
     uint32_t curr_offset;
     uint32_t curr_inode;
-    pcb_t * current = curr_pcb();
     int32_t total_bytes_read;
 
-    file_desc_t curr_fd_info;
+    file_desc_t * curr_fd_info = get_fd(curr_pcb(), fd);
 
     // casting name to be unsigned
     // uint8_t * unsigned_name = (uint8_t *)fname;
@@ -207,35 +1838,52 @@ int32_t file_read(int32_t fd, void *buf, int32_t nbytes) {
     int32_t ret_val = FS_FAIL;
 
     // invalid name or buffer
-    if((uint8_t *)buf == NULL) {
+    if((uint8_t *)buf == NULL || curr_fd_info == NULL) {
         return ret_val;
     }
 
-    curr_fd_info = current->fd_arr[fd];
-
-    curr_inode = curr_fd_info.file_inode;
-    curr_offset = curr_fd_info.file_pos;
+    curr_inode = curr_fd_info->file_inode;
+    curr_offset = curr_fd_info->file_pos;
 
     //printf("File position %d", curr_offset);
 
+    if(nbytes > 0) {
+        file_readahead(curr_fd_info, (uint32_t)nbytes);
+    }
     total_bytes_read =  read_data(curr_inode, curr_offset, (uint8_t *)buf, (uint32_t)nbytes);
 
     // ensuring that fname is in dir_entry array
     // read_dentry_result = read_dentry_by_name(unsigned_name, &dentry);
 
     // upon failure, return FS_FAIL, otherwise return number of bytes read
-    current->fd_arr[fd].file_pos += total_bytes_read;
+    if(total_bytes_read > 0) {
+        curr_fd_info->file_pos += total_bytes_read;
+    }
+    curr_fd_info->ra_pos = curr_fd_info->file_pos;
 
     return total_bytes_read;
 }
 
 /* file_write
-* Inputs: none
-* Outputs: return -1;
-* Side Effects: Do nothing
+* Inputs: -fd : descriptor of a regular file
+          -buf : bytes to write
+          -nbytes : number of bytes to write
+* Outputs: number of bytes written, or -1 for failure
+* Side Effects: overwrites or appends at file_pos (through write_data) and advances it
 */
 int32_t file_write(int32_t fd, const void *buf, int32_t nbytes) {
-    return FS_FAIL;
+    file_desc_t * curr_fd_info = get_fd(curr_pcb(), fd);
+    int32_t written;
+
+    if(buf == NULL || nbytes < 0 || curr_fd_info == NULL || curr_fd_info->file_inode < 0) {
+        return FS_FAIL;
+    }
+
+    written = write_data(curr_fd_info->file_inode, curr_fd_info->file_pos, (const uint8_t *)buf, nbytes);
+    if(written > 0) {
+        curr_fd_info->file_pos += written;
+    }
+    return written;
 }
 
 
@@ -258,7 +1906,8 @@ int32_t file_open(const uint8_t* filename) {
 }
 
 /* dir_read
-* Inputs: offset - file loc in dentry arr (*** nbytes is offset here ***)
+* Inputs: fd - open directory (file_inode, ROOT_INODE for the root), its file_pos is the index
+               of the next dentry
           buf - buffer that will hold file string
 * Outputs: return length of filename written to buffer
 * Side Effects: writing file name to buffer's location in memory
@@ -267,13 +1916,20 @@ int32_t file_open(const uint8_t* filename) {
 int32_t dir_read(int32_t fd, void *buf, int32_t nbytes) {
 
     dentry_t dentry;
+    uint32_t dir;
+    file_desc_t * curr_fd_info = get_fd(curr_pcb(), fd);
+
+    if (curr_fd_info == NULL) {
+      return FS_FAIL;
+    }
+    dir = (uint32_t)curr_fd_info->file_inode;
 
-    if (current_dir >= file_stats.total_dirs) {
-      current_dir = 0;
+    if (curr_fd_info->file_pos >= dir_size(dir)) {
+      curr_fd_info->file_pos = 0;
       return 0;
     }
 
-    if(read_dentry_by_index(current_dir, &dentry) == 0) {
+    if(dir_entry(dir, curr_fd_info->file_pos, &dentry) == 0) {
         // current_dir = 0;
         // return current_dir;
 
@@ -290,24 +1946,191 @@ int32_t dir_read(int32_t fd, void *buf, int32_t nbytes) {
     }
     strncpy((int8_t *)buf, (int8_t *)dentry.filename, ret_string);
     memcpy((int8_t *)buf, (int8_t *)dentry.filename, ret_string);
-    current_dir++;
+    curr_fd_info->file_pos++;
     return ret_string;
     }
 
     return 0;
 }
 
+/* dir_getdents
+* Inputs: -dir: directory inode, ROOT_INODE for the root
+          -cursor: index of the next dentry to list, advanced past the ones written
+          -buf: buffer for the records
+          -nbytes: size of buf
+* Outputs: bytes of dirent_t records written ; 0 at the end of the directory ; -1 if even the
+           next record doesn't fit
+* Side Effects: packs one record per dentry, each d_reclen bytes long
+*/
+int32_t dir_getdents(uint32_t dir, uint32_t* cursor, void *buf, int32_t nbytes) {
+    dentry_t dentry;
+    stat_t st;
+    dirent_t * rec;
+    uint32_t name_len, rec_len;
+    int32_t used = 0;
+
+    while(*cursor < dir_size(dir) && dir_entry(dir, *cursor, &dentry) == FS_SUCCESS) {
+        // a full length name has no terminator in the dentry
+        for(name_len = 0; name_len < MAX_ENTRY_LEN && dentry.filename[name_len] != '\0'; ++name_len);
+        rec_len = (DIRENT_HEADER + name_len + 1 + DIRENT_ALIGN - 1) & ~(DIRENT_ALIGN - 1);
+        if(used + rec_len > nbytes) {
+            break;
+        }
+
+        rec = (dirent_t *)((uint8_t *)buf + used);
+        rec->d_inode = dentry.inode_index;
+        rec->d_type = dentry.filetype;
+        rec->d_size = 0;
+        // "." is the directory being listed
+        if(dentry.filetype == FOLDER_TYPE && strncmp(dentry.filename, ".", 2) == 0) {
+            dentry.inode_index = dir;
+        }
+        if((dentry.filetype == FILE_TYPE || dentry.filetype == FOLDER_TYPE) &&
+           stat_file(dentry.filetype, dentry.inode_index, &st) == FS_SUCCESS) {
+            rec->d_size = st.size;
+        }
+        rec->d_reclen = rec_len;
+        memcpy(rec->d_name, dentry.filename, name_len);
+        rec->d_name[name_len] = '\0';
+
+        used += rec_len;
+        (*cursor)++;
+    }
+
+    if(used == 0 && *cursor < dir_size(dir)) {
+        return FS_FAIL;
+    }
+    return used;
+}
+
 /* get_file_size
-* Inputs: -node_index: index into inode
-* Outputs: return 0
+* Inputs: -node_index: inode number
+* Outputs: length of the file ; return -1 for a bad inode
 * Side Effects:
 */
 int32_t get_file_size(uint32_t node_index) {
+    node_index = enter_layer(node_index);
+    if(node_index >= file_stats.total_inodes) {
+        return FS_FAIL;
+    }
     //get the length of the file from the inode
     return inode_arr[node_index].length;
 
 }
 
+/* get_block_addr
+* Inputs: -inode: index of inode
+          -block_index: which of the file's blocks (offset / SIZE_OF_BLOCKS)
+          -addr: set to the block's address
+* Outputs: return 0 for success ; return -1 if the block is past the end of the file, or the
+           file is compressed and has no block holding its bytes as they read
+* Side Effects: writes the block back first if the buffer cache holds a newer copy
+*/
+int32_t get_block_addr(uint32_t inode, uint32_t block_index, uint32_t* addr) {
+    uint32_t num_blocks, node, block;
+
+    node = enter_layer(inode);
+    if(node >= file_stats.total_inodes || addr == NULL || is_compressed(node)) {
+        return FS_FAIL;
+    }
+
+    num_blocks = file_blocks(node);
+    if(block_index >= num_blocks || check_invalid_block(block_index, inode)) {
+        return FS_FAIL;
+    }
+
+    // the caller reads the block in place, so a newer copy in the cache has to land first
+    block = block_of(node, block_index);
+    if(bsync(data_dev, data_start + block) == FS_FAIL) {
+        return FS_FAIL;
+    }
+    *addr = (uint32_t)((block_data_t *)data_begin + block);
+    return FS_SUCCESS;
+}
+
+/* hold_inode
+* Inputs: - inode : index of inode
+* Outputs: return 0 ; return -1 for a bad inode
+* Side Effects: delete_file refuses the file until every hold is released
+*/
+int32_t hold_inode(uint32_t inode) {
+    uint32_t node = enter_layer(inode);
+
+    if(node >= file_stats.total_inodes || node >= MAX_FS_INODES) {
+        return FS_FAIL;
+    }
+    layer->inode_refs[node]++;
+    return FS_SUCCESS;
+}
+
+/* release_inode
+* Inputs: - inode : index of inode passed to hold_inode
+* Outputs: none
+* Side Effects: drops one reference, ignores an inode that holds none
+*/
+void release_inode(uint32_t inode) {
+    uint32_t node = enter_layer(inode);
+
+    if(node >= file_stats.total_inodes || node >= MAX_FS_INODES || layer->inode_refs[node] == 0) {
+        return;
+    }
+    layer->inode_refs[node]--;
+}
+
+/* sync_file
+* Inputs: - inode : index of inode
+* Outputs: return 0 once the file's data is on its layer's device ; return -1 for a bad inode
+           or a failed write
+* Side Effects: writes back every dirty block of the layer, the cache doesn't track which
+                file a block belongs to, then commits the layer's running journal
+                transaction so the file's size and block map are durable too
+*/
+int32_t sync_file(uint32_t inode) {
+    inode = enter_layer(inode);
+    if(inode >= file_stats.total_inodes) {
+        return FS_FAIL;
+    }
+    // data first, so a committed size never covers blocks that didn't make it
+    if(bflush(data_dev) == FS_FAIL) {
+        return FS_FAIL;
+    }
+    return journal_commit(journal);
+}
+
+/* stat_file
+* Inputs: -filetype: type from the dentry
+          -node_index: index into inode
+          -buf: stat struct to fill
+* Outputs: return 0 for success ; return -1 for a bad inode
+* Side Effects: fills size, type, inode, block and extent counts, leaves dev to the caller
+*/
+int32_t stat_file(uint32_t filetype, uint32_t node_index, stat_t* buf) {
+    if(buf == NULL) {
+        return FS_FAIL;
+    }
+
+    buf->type = filetype;
+    buf->inode = node_index;
+    node_index = enter_layer(node_index);
+
+    // the root directory is the dentry arrays of the boot blocks, a subdirectory's dentries
+    // are its data
+    if(filetype == FOLDER_TYPE && node_index >= file_stats.total_inodes) {
+        buf->size = union_count * sizeof(dentry_t);
+        buf->blocks = 1;
+        return FS_SUCCESS;
+    }
+
+    if(node_index >= file_stats.total_inodes) {
+        return FS_FAIL;
+    }
+
+    buf->size = inode_arr[node_index].length;
+    buf->blocks = file_blocks(node_index);
+    buf->extents = (fs_version == FS_VERSION_2) ? extent_inode(node_index)->num_extents : 0;
+    return FS_SUCCESS;
+}
+
 /* dir_write
 * Inputs: none
 * Outputs: return -1
@@ -343,5 +2166,5 @@ int32_t dir_open(const uint8_t* filename) {
 * Side Effects: none
 */
 int32_t check_fs_init() {
-    return (dentry_arr == NULL) ? FS_FAIL : FS_SUCCESS;
+    return (num_layers == 0) ? FS_FAIL : FS_SUCCESS;
 }
@@ -3,6 +3,8 @@
 
 #include "types.h"
 #include "lib.h"
+#include "block.h"
+#include "journal.h"
 
 // various filesystem macros
 #define SIZE_OF_BLOCKS 4096
@@ -13,6 +15,63 @@
 #define DENTRY_RES_LEN 24
 #define FSTATS_RES_LEN 52
 #define FOUR_B_OFFSET 4
+#define RUN_CACHE_SIZE 8 // inodes whose block-run lists are cached
+#define MAX_RUNS 32 // runs one cached list can hold
+#define RUNS_OVERFLOW 0xFFFFFFFF // num_runs of a file too fragmented to cache
+#define RUN_CACHE_EMPTY 0xFFFFFFFF // inode of an unused cache slot
+#define MAX_FS_INODES 4096 // inodes the free-inode bitmap can track
+#define MAX_FS_BLOCKS 32768 // data blocks the free-block bitmap can track (128MB)
+
+// format versions, told apart by the first word of fstats_t.reserved
+#define FS_VERSION_1 1 // block-number inodes, unsorted directory
+#define FS_VERSION_2 2 // extent inodes, sorted and hashed directory
+#define FS_MAGIC_V2 0x32565346 // "FSV2", marks a version 2 image
+#define NUM_EXTENTS ((SIZE_OF_BLOCKS - 8) / 8) // extents in a version 2 inode
+#define NO_BLOCK 0xFFFFFFFF // file block that maps to no data block
+#define INODE_COMPRESSED 0x1 // inode_v2_t.flags: stored as one LZ4 frame per 4kB of the file
+#define FRAME_CACHE_SIZE 16 // decompressed blocks kept
+#define FRAME_CACHE_EMPTY 0xFFFFFFFF // inode of an unused frame cache slot
+
+// version 1 feature flags, in the second word of fstats_t.reserved
+#define FS_FEATURES_WORD 1
+#define FS_FEATURE_INDIRECT 0x1 // the last two node_data slots are single and double indirect
+#define PTRS_PER_BLOCK (SIZE_OF_BLOCKS / 4) // block numbers in an indirect block
+#define NUM_DIRECT_BLOCKS (NUM_DATA_BLOCKS - 2) // node_data slots that point at data with FS_FEATURE_INDIRECT
+#define SINGLE_INDIRECT NUM_DIRECT_BLOCKS // node_data slot of the single indirect block
+#define DOUBLE_INDIRECT (NUM_DIRECT_BLOCKS + 1) // node_data slot of the double indirect block
+#define IND_CACHE_SIZE 16 // indirect blocks remembered across reads
+#define IND_SINGLE 0 // cache key of the single indirect block, 1 + i for entry i of the double
+#define IND_CACHE_EMPTY 0xFFFFFFFF // inode of an unused indirect cache slot
+
+// journal area of an image built with mkfs -j, the same words in either version
+#define FS_JOURNAL_WORD 2 // first block of the area, counted from the boot block
+#define FS_JOURNAL_LEN_WORD 3 // blocks in the area, 0 for an image without a journal
+
+// directory tree: a FOLDER dentry other than "." is a subdirectory whose data is its dentries
+#define ROOT_INODE 0xFFFFFFFF // the boot block directory, which has no inode
+#define MAX_PATH_DEPTH 16 // directories a path (or the tree) may nest
+#define DCACHE_SIZE 256 // (directory, name) lookups remembered (power of two)
+#define DCACHE_MIX 2654435761U // spreads the directory inode across the slots
+#define DCACHE_EMPTY 0 // unused slot
+#define DCACHE_POSITIVE 1 // the name is in the directory
+#define DCACHE_NEGATIVE 2 // the name is known not to be in the directory
+
+// per-descriptor readahead: a read starting where the last one ended doubles the window up
+// to RA_MAX_BLOCKS, any other read shrinks it by RA_SHRINK_SHIFT
+#define RA_MIN_BLOCKS 4 // window a sequential reader starts with
+#define RA_MAX_BLOCKS 32 // largest window, 128kB ahead of the reader
+#define RA_SHRINK_SHIFT 2
+
+// union mount: every multiboot module is a layer, and a root name in a later layer shadows the
+// same name in earlier ones. Inode numbers outside filesystem.c carry their layer in the top bits
+#define MAX_LAYERS 8 // modules that can be mounted
+#define LAYER_SHIFT 16 // a layer's inodes are numbered (layer << LAYER_SHIFT) | inode
+#define LAYER_OF(inode) ((inode) >> LAYER_SHIFT)
+#define LOCAL_INODE(inode) ((inode) & ((1 << LAYER_SHIFT) - 1))
+#define NO_INODE 0xFFFFFFFE // inode number that is in no layer
+#define MAX_UNION_DENTRY (MAX_LAYERS * MAX_NUM_DENTRY) // root names across every layer
+#define UNION_HASH_SIZE 1024 // buckets in the merged root index (power of two)
+#define UNION_HASH_END 0xFFFF // end of a merged index chain / empty bucket
 
 // for read, write, close, open ret_vals
 #define FS_SUCCESS 0
@@ -22,6 +81,12 @@
 #define RTC_TYPE 0
 #define FOLDER_TYPE 1
 #define FILE_TYPE 2
+#define DEVICE_TYPE 3 // never on disk, reported by stat for registry devices
+
+// lseek whence values
+#define SEEK_SET 0
+#define SEEK_CUR 1
+#define SEEK_END 2
 
 
 typedef struct {
@@ -47,15 +112,151 @@ typedef struct {
     uint32_t data[NUM_DATA_BLOCKS + 1];
 } block_data_t;
 
+// a recently used indirect block, so deep reads skip the walk from the inode
+typedef struct {
+    uint32_t inode; // owner tagged with its layer, IND_CACHE_EMPTY if unused
+    uint32_t key; // IND_SINGLE, or 1 + index into the double indirect block
+    uint32_t * table; // the indirect block's block numbers
+    uint32_t last_used; // ind_cache_clock value at the last hit, for LRU replacement
+} ind_cache_t;
+
+// version 2: a run of data blocks, the file's blocks are the extents laid end to end
+typedef struct {
+    uint32_t start; // first data block
+    uint32_t length; // number of data blocks
+} extent_t;
+
+typedef struct {
+    uint32_t length; // same place as inode_t.length so size lookups don't care about the version
+    uint16_t num_extents;
+    uint16_t flags; // INODE_COMPRESSED
+    extent_t extents[NUM_EXTENTS];
+} inode_v2_t;
+
+/* A compressed file's extents hold a stream that starts with (length / 4kB rounded up) + 1
+ * offsets into the stream: frame i is the bytes from offset i to offset i + 1. A frame as long
+ * as the 4kB it decodes to is stored raw, anything shorter is an LZ4 block. */
+typedef struct {
+    uint32_t inode; // owner tagged with its layer, FRAME_CACHE_EMPTY if unused
+    uint32_t frame; // which 4kB of the file
+    uint32_t last_used; // frame_cache_clock value at the last hit, for LRU replacement
+    uint8_t data[SIZE_OF_BLOCKS];
+} frame_cache_t;
+
+// one remembered directory lookup, found or not
+typedef struct {
+    uint32_t state; // DCACHE_EMPTY, DCACHE_POSITIVE or DCACHE_NEGATIVE
+    uint32_t parent; // directory searched, ROOT_INODE for the root
+    uint32_t filetype; // what the name resolved to, if positive
+    uint32_t inode_index;
+    int8_t name[MAX_ENTRY_LEN]; // not terminated at full length, like dentry_t
+} dcache_entry_t;
+
+// one mounted module
+typedef struct {
+    uint32_t boot_begin; // start of the module, its boot block
+    uint32_t inode_begin;
+    uint32_t data_begin;
+    blkdev_t * dev; // ramdisk over the module, data blocks are read through the buffer cache
+    uint32_t data_start; // device block holding data block 0
+    uint32_t version; // FS_VERSION_1 or FS_VERSION_2
+    uint32_t features; // FS_FEATURE_* flags of a version 1 image
+    uint32_t inode_bitmap[BITMAP_WORDS(MAX_FS_INODES)]; // set for inodes in use
+    uint32_t block_bitmap[BITMAP_WORDS(MAX_FS_BLOCKS)]; // set for data blocks in use
+    uint32_t inode_refs[MAX_FS_INODES]; // open descriptors and mapped pages on each inode, delete_file waits for 0
+    journal_t journal; // metadata log, a no-op for an image without a journal area
+} fs_layer_t;
+
+// a root name that is visible through the union, chained by hash
+typedef struct {
+    uint16_t layer; // layer whose boot block holds the dentry
+    uint16_t index; // dentry within that boot block
+    uint16_t next; // next visible name in the same bucket
+} union_entry_t;
+
+// a stretch of a file whose data blocks sit back to back in the image
+typedef struct {
+    uint32_t file_block; // first block of the file in the run
+    uint32_t data_block; // data block holding file_block
+    uint32_t length; // number of blocks in the run
+} block_run_t;
+
+typedef struct {
+    uint32_t inode; // inode the runs describe tagged with its layer, RUN_CACHE_EMPTY if unused
+    uint32_t num_runs; // runs in the list, RUNS_OVERFLOW if the file has more than MAX_RUNS
+    uint32_t last_used; // run_cache_clock value at the last hit, for LRU replacement
+    block_run_t runs[MAX_RUNS]; // sorted by file_block
+} run_list_t;
+
+typedef struct {
+    uint32_t size; // length of the file in bytes
+    uint32_t type; // filetype (RTC_TYPE, FOLDER_TYPE, FILE_TYPE, DEVICE_TYPE)
+    uint32_t inode; // inode index, -1 for devices
+    uint32_t blocks; // data blocks the file occupies
+    uint32_t dev; // device number, 0 for regular files
+    uint32_t extents; // extents mapping those blocks, 0 on a version 1 image
+} stat_t;
+
+typedef struct {
+    uint32_t lookups; // read_dentry_by_name calls
+    uint32_t lookup_misses; // lookups that found no dentry
+    uint32_t dentries_scanned; // dentries compared across all lookups
+    uint32_t reads; // read_data calls
+    uint32_t bytes_read; // bytes copied out by read_data
+    uint32_t blocks_read; // data blocks touched by read_data
+    uint32_t runs_copied; // bulk copies issued by read_data, one per contiguous run
+    uint32_t run_cache_hits; // read_data calls that found the inode's run list cached
+    uint32_t run_cache_misses; // read_data calls that had to build a run list
+    uint32_t free_inodes; // inodes not referenced by any dentry
+    uint32_t free_blocks; // data blocks not referenced by any inode
+    uint32_t bytes_written; // bytes stored by file_write
+    uint32_t version; // format of the loaded image, FS_VERSION_1 or FS_VERSION_2
+    uint32_t features; // FS_FEATURE_* flags of the top layer, where new files go
+    uint32_t ind_cache_hits; // indirect block lookups served from the cache
+    uint32_t ind_cache_misses; // indirect block lookups that walked from the inode
+    uint32_t frame_cache_hits; // compressed blocks served already decompressed
+    uint32_t frames_decompressed; // compressed blocks decoded from the image
+    uint32_t dcache_hits; // path components found in the dentry cache
+    uint32_t dcache_negative_hits; // path components the cache knew were missing
+    uint32_t dcache_misses; // path components that searched a directory
+    uint32_t layers; // modules mounted
+} fs_stats_t;
+
+// one getdents record, d_reclen bytes long: the header, the name and its terminator, rounded
+// up so the next record is aligned
+typedef struct {
+    uint32_t d_inode; // inode index
+    uint32_t d_type; // filetype
+    uint32_t d_size; // length in bytes, 0 for devices
+    uint16_t d_reclen; // offset of the next record
+    int8_t d_name[MAX_ENTRY_LEN + 1]; // only as much of this as the name needs is written
+} dirent_t;
+
+#define DIRENT_HEADER 14 // bytes of dirent_t before d_name
+#define DIRENT_ALIGN 4 // records start on this boundary
+
+// lookup and read counters, read by /proc/fs
+extern fs_stats_t fs_stats;
+
 
-//reads a given dentry by the file name
+//resolves a '/' separated path from the root directory
 extern int32_t read_dentry_by_name(const uint8_t* fname, dentry_t* dentry);
 //reads a given dentry by the index of the dentry
 extern int32_t read_dentry_by_index(uint32_t index, dentry_t* dentry);
 //read the data
 extern int32_t read_data(uint32_t inode, uint32_t offset, uint8_t * buf, uint32_t length);
-//initialize all globals in filesystem
+//forget the cached block runs of an inode of the current layer whose blocks changed
+extern void invalidate_runs(uint32_t inode);
+//add an empty regular file to the directory
+extern int32_t create_file(const uint8_t* fname);
+//remove a regular file from the directory and free its inode and blocks
+extern int32_t delete_file(const uint8_t* fname);
+//write into a file's data blocks, allocating and growing as needed
+extern int32_t write_data(uint32_t inode, uint32_t offset, const uint8_t * buf, uint32_t length);
+//initialize all globals in filesystem, mounting one module
 extern void init_files(uint32_t fs_start);
+//mount another module on top of the ones already mounted
+extern int32_t mount_layer(uint32_t fs_start);
 
 //read the file
 extern int32_t file_read(int32_t fd, void *buf, int32_t nbytes);
@@ -68,6 +269,8 @@ extern int32_t file_open(const uint8_t* filename);
 
 extern int32_t dir_read(int32_t fd, void *buf, int32_t nbytes);
 extern int32_t dir_write(int32_t fd, const void *buf, int32_t nbytes);
+//fill buf with as many dirent_t records of directory dir as fit, starting at dentry *cursor
+extern int32_t dir_getdents(uint32_t dir, uint32_t* cursor, void *buf, int32_t nbytes);
 //close directory
 extern int32_t dir_close(int32_t fd);
 //open directory
@@ -78,5 +281,15 @@ extern uint32_t check_invalid_block(uint32_t block_loc, uint32_t inode);
 extern int32_t check_fs_init();
 //get the length of the file from the inode
 extern int32_t get_file_size(uint32_t node_index);
+//memory address of one of a file's data blocks, for mapping it straight into user space
+extern int32_t get_block_addr(uint32_t inode, uint32_t block_index, uint32_t* addr);
+//keep a file's inode and blocks from being freed while something still points at them
+extern int32_t hold_inode(uint32_t inode);
+//drop a hold_inode reference
+extern void release_inode(uint32_t inode);
+//write a file's dirty blocks back to its layer's device
+extern int32_t sync_file(uint32_t inode);
+//fill size, type and block count for a dentry's file
+extern int32_t stat_file(uint32_t filetype, uint32_t node_index, stat_t* buf);
 
 #endif
@@ -9,6 +9,9 @@
 #define NUM_NONGENERAL_INTERRUPTS 32
 #define USER_DPL 0x3
 
+// times each vector fired, asm stubs bump the device and syscall vectors
+uint32_t vector_count[NUM_VEC];
+
 /* Divide_Error
 * Inputs: none
 * Outputs: none
@@ -16,6 +19,7 @@
 */
 void Divide_Error(){
     cli();
+    vector_count[0]++;
     printf("  Divide Error\n");
     while(1) {}
     sti();
@@ -28,6 +32,7 @@ void Divide_Error(){
 */
 void Reserved(){
     cli();
+    vector_count[1]++;
     printf("  Reserved/Debug\n");
     while(1) {}
     sti();
@@ -40,6 +45,7 @@ void Reserved(){
 */
 void NMI_Interrupt(){
     cli();
+    vector_count[2]++;
     printf("  NMI_Interrupt\n");
     while(1);
     sti();
@@ -52,6 +58,7 @@ void NMI_Interrupt(){
 */
 void Breakpoint(){
     cli();
+    vector_count[3]++;
     printf("  Breakpoint\n");
     while(1);
     sti();
@@ -64,6 +71,7 @@ void Breakpoint(){
 */
 void Overflow(){
     cli();
+    vector_count[4]++;
     printf("  Overflow\n");
     while(1);
     sti();
@@ -76,6 +84,7 @@ void Overflow(){
 */
 void Bound(){
     cli();
+    vector_count[5]++;
     printf("  Bound\n");
     while(1);
     sti();
@@ -88,6 +97,7 @@ void Bound(){
 */
 void Invalid_Opcode(){
     cli();
+    vector_count[6]++;
     printf("  Invalid_Opcode\n");
     while(1);
     sti();
@@ -100,6 +110,7 @@ void Invalid_Opcode(){
 */
 void Device_NA(){
     cli();
+    vector_count[7]++;
     printf("  Device_NA\n");
     while(1);
     sti();
@@ -112,6 +123,7 @@ void Device_NA(){
 */
 void Double_Fault(){
     cli();
+    vector_count[8]++;
     printf("  Double_Fault\n");
     while(1);
     sti();
@@ -124,6 +136,7 @@ void Double_Fault(){
 */
 void Segment_Overrun(){
     cli();
+    vector_count[9]++;
     printf("  Segment_Overrun\n");
     while(1);
     sti();
@@ -136,6 +149,7 @@ void Segment_Overrun(){
 */
 void invalid_tss() {
     cli();
+    vector_count[10]++;
     printf("  Invalid TSS Error\n");
     while(1);
     sti();
@@ -148,6 +162,7 @@ void invalid_tss() {
 */
 void seg_not_present() {
     cli();
+    vector_count[11]++;
     printf("  Segment Not Present\n");
     while(1);
     sti();
@@ -160,6 +175,7 @@ void seg_not_present() {
 */
 void stack_seg_fault() {
     cli();
+    vector_count[12]++;
     printf("  Stack-Segment Fault\n");
     while(1);
     sti();
@@ -172,6 +188,7 @@ void stack_seg_fault() {
 */
 void general_protection() {
     cli();
+    vector_count[13]++;
     printf("  General Protection Error\n");
     halt(255);
     sti();
@@ -184,6 +201,7 @@ void general_protection() {
 */
 void page_fault() {
     cli();
+    vector_count[14]++;
     printf("  Page fault\n");
     halt(255);
     sti();
@@ -196,6 +214,7 @@ void page_fault() {
 */
 void floating_point_error() {
     cli();
+    vector_count[16]++;
     printf("  Floating Point Error\n");
     while(1);
     sti();
@@ -208,6 +227,7 @@ void floating_point_error() {
 */
 void align_check() {
     cli();
+    vector_count[17]++;
     printf("  Alignment Check Error\n");
     while(1);
     sti();
@@ -220,6 +240,7 @@ void align_check() {
 */
 void machine_check() {
     cli();
+    vector_count[18]++;
     printf("  Machine Check Error\n");
     while(1);
     sti();
@@ -232,6 +253,7 @@ void machine_check() {
 */
 void simd_floating_point_exception() {
     cli();
+    vector_count[19]++;
     printf("  SIMD Floating Point Exception\n");
     while(1);
     sti();
@@ -244,6 +266,7 @@ void simd_floating_point_exception() {
 */
 void general() {
     cli();
+    vector_count[OTHER_VECTOR]++; // the stub can't tell which vector it was, lump them together
     printf("  General Interrupt\n");
     sti();
 }
@@ -328,4 +351,8 @@ void idt_init(){
 
     SET_IDT_ENTRY(idt[32], pit_INT);
 
+    // ATA channels complete their DMA transfers here, IRQ 14 and 15 on the slave PIC
+    SET_IDT_ENTRY(idt[46], ata_primary_INT);
+    SET_IDT_ENTRY(idt[47], ata_secondary_INT);
+
 }
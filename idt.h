@@ -1,3 +1,11 @@
+#include "x86_desc.h"
+
+// slot that counts every vector without its own handler
+#define OTHER_VECTOR (NUM_VEC - 1)
+
+// per-vector interrupt counts, read by /proc/interrupts
+extern uint32_t vector_count[NUM_VEC];
+
 // initializing the IDT
 extern void idt_init();
 
@@ -7,3 +7,8 @@ extern void keyboard_INT();
 extern void sys_call_INT();
 // PIT interrupt handler
 extern void pit_INT();
+// ATA channel interrupt handlers, IRQ 14 and 15
+extern void ata_primary_INT();
+extern void ata_secondary_INT();
+// virtio-blk handler, installed at boot on whatever PIC line PCI routed the device to
+extern void virtio_blk_INT();
@@ -0,0 +1,378 @@
+#include "journal.h"
+#include "lib.h"
+#include "paging.h"
+
+journal_stats_t journal_stats;
+
+static volatile uint32_t journal_ticks = 0; // RTC ticks since boot, ages running transactions
+static journal_t * open_journals[JOURNAL_MAX_OPEN]; // what journal_tick ages
+static uint32_t num_open = 0;
+
+/* journal_sector
+* Inputs: - j : journal
+          - block : block of its area
+* Outputs: the block's first sector on the device
+* Side Effects: none
+*/
+static uint32_t journal_sector(journal_t * j, uint32_t block) {
+    return (j->start + block) * JOURNAL_BLOCK_SECTORS;
+}
+
+/* journal_sum
+* Inputs: - desc : descriptor with a valid count
+* Outputs: FNV-1a of the descriptor up to its last tag
+* Side Effects: none
+*/
+static uint32_t journal_sum(const jdesc_t * desc) {
+    const uint8_t * p = (const uint8_t *)desc;
+    uint32_t i, len, hash = 2166136261U;
+
+    len = sizeof(jdesc_t) - (JOURNAL_MAX_BLOCKS - desc->count) * sizeof(jtag_t);
+    for (i = 0; i < len; i++) {
+        hash ^= p[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/* journal_write_super
+* Inputs: - j : journal
+* Outputs: 0 or -1 if the write failed
+* Side Effects: records head as where replay starts, with the current sequence number
+*/
+static int32_t journal_write_super(journal_t * j) {
+    jsuper_t * sb = (jsuper_t *)j->frame;
+
+    memset(j->frame, 0, BLK_SECTOR_SIZE);
+    sb->magic = JOURNAL_MAGIC;
+    sb->seq = j->seq;
+    sb->tail = j->head;
+    sb->maps_valid = j->maps_valid;
+    return blk_write(j->dev, journal_sector(j, JOURNAL_SUPER), 1, j->frame);
+}
+
+/* journal_open
+* Inputs: - j : journal to set up
+          - dev : device holding the area
+          - start, len : the area, in JOURNAL_BLOCK_SIZE units
+          - inode_map, inode_map_sectors : the free-inode bitmap in memory and its size
+          - block_map, block_map_sectors : the same for the free-block bitmap
+* Outputs: 0 ; -1 if the area is too small, off the device, or unreadable, and j stays a no-op
+* Side Effects: a superblock that was never written means an empty log and bitmaps that were
+                never written home. The first JOURNAL_MAX_OPEN journals opened are aged by
+                journal_tick, any others only commit from journal_end
+*/
+int32_t journal_open(journal_t * j, blkdev_t * dev, uint32_t start, uint32_t len,
+                     void * inode_map, uint32_t inode_map_sectors,
+                     void * block_map, uint32_t block_map_sectors) {
+    jsuper_t * sb;
+    uint32_t i;
+
+    j->dev = NULL;
+    if (dev == NULL || len < JOURNAL_MIN_BLOCKS || start + len > dev->num_sectors / JOURNAL_BLOCK_SECTORS) return -1;
+    if (inode_map_sectors > JOURNAL_BLOCK_SECTORS || block_map_sectors > JOURNAL_BLOCK_SECTORS) return -1;
+    // a remounted layer keeps the frame it had
+    if (j->frame == NULL) j->frame = alloc_frame();
+    if (j->frame == NULL) return -1;
+
+    j->start = start;
+    j->len = len;
+    j->maps[0] = inode_map;
+    j->map_sectors[0] = inode_map_sectors;
+    j->maps[1] = block_map;
+    j->map_sectors[1] = block_map_sectors;
+    j->depth = 0;
+    j->overflow = 0;
+    j->count = 0;
+    j->due = 0;
+
+    if (blk_read(dev, journal_sector(j, JOURNAL_SUPER), 1, j->frame) != 0) return -1;
+    sb = (jsuper_t *)j->frame;
+    if (sb->magic == JOURNAL_MAGIC && sb->tail >= JOURNAL_LOG && sb->tail < len) {
+        j->seq = sb->seq;
+        j->head = sb->tail;
+        j->maps_valid = sb->maps_valid;
+    } else {
+        j->seq = 1;
+        j->head = JOURNAL_LOG;
+        j->maps_valid = 0;
+    }
+    j->dev = dev;
+
+    for (i = 0; i < num_open; i++) {
+        if (open_journals[i] == j) return 0;
+    }
+    if (num_open < JOURNAL_MAX_OPEN) open_journals[num_open++] = j;
+    return 0;
+}
+
+/* journal_replay
+* Inputs: - j : opened journal, with nothing running
+* Outputs: transactions written home ; -1 if a read or write failed partway
+* Side Effects: walks the log from the checkpointed tail while descriptors carry the next
+                sequence number and their commit records match. head is left past the last
+                one, for journal_checkpoint to empty the log
+*/
+int32_t journal_replay(journal_t * j) {
+    jdesc_t * desc = (jdesc_t *)j->frame;
+    jcommit_t * rec = (jcommit_t *)j->frame;
+    uint32_t i, count, sum;
+    int32_t replayed = 0;
+
+    if (j->dev == NULL) return -1;
+    while (j->head + 2 <= j->len) {
+        if (blk_read(j->dev, journal_sector(j, j->head), JOURNAL_BLOCK_SECTORS, j->frame) != 0) return -1;
+        if (desc->magic != JOURNAL_DESC_MAGIC || desc->seq != j->seq || desc->count > JOURNAL_MAX_BLOCKS ||
+            j->head + desc->count + 2 > j->len) {
+            break;
+        }
+        count = desc->count;
+        sum = journal_sum(desc);
+        memcpy(j->tags, desc->tags, count * sizeof(jtag_t));
+
+        // the images only count if the commit record behind them made it to the log
+        if (blk_read(j->dev, journal_sector(j, j->head + count + 1), 1, j->frame) != 0) return -1;
+        if (rec->magic != JOURNAL_COMMIT_MAGIC || rec->seq != j->seq || rec->count != count || rec->checksum != sum) {
+            break;
+        }
+
+        for (i = 0; i < count; i++) {
+            if (j->tags[i].sectors == 0 || j->tags[i].sectors > JOURNAL_BLOCK_SECTORS) continue;
+            if (blk_read(j->dev, journal_sector(j, j->head + i + 1), j->tags[i].sectors, j->frame) != 0 ||
+                blk_write(j->dev, j->tags[i].block * JOURNAL_BLOCK_SECTORS, j->tags[i].sectors, j->frame) != 0) {
+                journal_stats.errors++;
+                return -1;
+            }
+        }
+        j->head += count + 2;
+        j->seq++;
+        replayed++;
+    }
+    journal_stats.replayed += replayed;
+    return replayed;
+}
+
+/* journal_load_maps
+* Inputs: - j : opened journal
+* Outputs: 0 ; -1 if the bitmaps were never written home or the read failed
+* Side Effects: overwrites both in-memory bitmaps
+*/
+int32_t journal_load_maps(journal_t * j) {
+    if (j->dev == NULL || !j->maps_valid) return -1;
+    if (blk_read(j->dev, journal_sector(j, JOURNAL_INODE_MAP), j->map_sectors[0], j->maps[0]) != 0 ||
+        blk_read(j->dev, journal_sector(j, JOURNAL_BLOCK_MAP), j->map_sectors[1], j->maps[1]) != 0) {
+        return -1;
+    }
+    return 0;
+}
+
+/* journal_begin
+* Inputs: - j : journal of the layer the operation changes
+* Outputs: none
+* Side Effects: no commit starts until the matching journal_end
+*/
+void journal_begin(journal_t * j) {
+    if (j->dev == NULL) return;
+    j->depth++;
+}
+
+/* journal_end
+* Inputs: - j : journal passed to journal_begin
+* Outputs: 0 ; -1 if a commit was due and failed
+* Side Effects: once no operation is open, commits the running transaction if it has grown
+                to JOURNAL_GROUP_BLOCKS or been open JOURNAL_COMMIT_TICKS ; otherwise later
+                operations keep adding to it and share its commit, or journal_commit_due
+                commits it once it has waited long enough
+*/
+int32_t journal_end(journal_t * j) {
+    if (j->dev == NULL || j->depth == 0) return 0;
+    if (--j->depth > 0) return 0;
+    if (j->count == 0 && !j->overflow) return 0;
+
+    journal_stats.ops++;
+    if (j->overflow || j->count >= JOURNAL_GROUP_BLOCKS || journal_ticks - j->opened_at >= JOURNAL_COMMIT_TICKS) {
+        return journal_commit(j);
+    }
+    return 0;
+}
+
+/* journal_dirty
+* Inputs: - j : journal of the layer being changed
+          - block : home of the changed metadata, JOURNAL_BLOCK_SIZE units from the device start
+          - image : its current contents, read again when the transaction commits
+          - sectors : how much of image belongs in the home
+* Outputs: none
+* Side Effects: a block already in the transaction isn't added twice ; past JOURNAL_MAX_BLOCKS
+                the transaction is marked to checkpoint instead of commit
+*/
+void journal_dirty(journal_t * j, uint32_t block, const void * image, uint32_t sectors) {
+    uint32_t i;
+
+    if (j->dev == NULL) return;
+    for (i = 0; i < j->count; i++) {
+        if (j->tags[i].block == block) return;
+    }
+    if (j->count == JOURNAL_MAX_BLOCKS) {
+        j->overflow = 1;
+        return;
+    }
+    if (j->count == 0) j->opened_at = journal_ticks;
+    j->tags[j->count].block = block;
+    j->tags[j->count].sectors = sectors;
+    j->images[j->count] = image;
+    j->count++;
+}
+
+/* journal_dirty_maps
+* Inputs: - j : journal of the layer whose bitmaps changed
+* Outputs: none
+* Side Effects: both bitmap homes join the running transaction
+*/
+void journal_dirty_maps(journal_t * j) {
+    if (j->dev == NULL) return;
+    journal_dirty(j, j->start + JOURNAL_INODE_MAP, j->maps[0], j->map_sectors[0]);
+    journal_dirty(j, j->start + JOURNAL_BLOCK_MAP, j->maps[1], j->map_sectors[1]);
+}
+
+/* journal_commit
+* Inputs: - j : journal
+* Outputs: 0, also when there is nothing to commit or an operation is still open ; -1 if a
+           write failed, and the transaction stays running for the next try
+* Side Effects: writes the descriptor and every image under one plug, waits for them, then
+                writes the commit record. A log without room for the transaction is
+                checkpointed instead
+*/
+int32_t journal_commit(journal_t * j) {
+    jdesc_t * desc = (jdesc_t *)j->frame;
+    jcommit_t * rec = (jcommit_t *)j->frame;
+    blk_request_t * req;
+    uint32_t i, submitted, sum;
+    int32_t ret = 0;
+
+    if (j->dev == NULL || j->depth > 0) return 0;
+    if (j->overflow) {
+        // too much changed for one transaction, bring the homes up to date instead
+        journal_stats.overflows++;
+        return journal_checkpoint(j);
+    }
+    if (j->count == 0) return 0;
+    if (j->head + j->count + 2 > j->len) {
+        // no room left in the log, the checkpoint brings this transaction home with the rest
+        return journal_checkpoint(j);
+    }
+
+    memset(j->frame, 0, JOURNAL_BLOCK_SIZE);
+    desc->magic = JOURNAL_DESC_MAGIC;
+    desc->seq = j->seq;
+    desc->count = j->count;
+    memcpy(desc->tags, j->tags, j->count * sizeof(jtag_t));
+    sum = journal_sum(desc);
+
+    // the descriptor and images sit back to back in the log, so they reach the device as one run
+    blk_plug(j->dev);
+    for (submitted = 0; submitted <= j->count; submitted++) {
+        req = &j->reqs[submitted];
+        req->sector = journal_sector(j, j->head + submitted);
+        req->count = (submitted == 0) ? JOURNAL_BLOCK_SECTORS : j->tags[submitted - 1].sectors;
+        req->buf = (submitted == 0) ? j->frame : (uint8_t *)j->images[submitted - 1];
+        req->dir = BLK_WRITE;
+        if (blk_submit(j->dev, req) != 0) break;
+    }
+    blk_unplug(j->dev);
+    for (i = 0; i < submitted; i++) {
+        if (blk_wait(j->dev, &j->reqs[i]) != 0) ret = -1;
+    }
+    if (submitted <= j->count) ret = -1;
+
+    // the commit record only goes out once every image is on the device, so a crash
+    // before it leaves a transaction that replay skips
+    if (ret == 0) {
+        memset(j->frame, 0, BLK_SECTOR_SIZE);
+        rec->magic = JOURNAL_COMMIT_MAGIC;
+        rec->seq = j->seq;
+        rec->count = j->count;
+        rec->checksum = sum;
+        ret = blk_write(j->dev, journal_sector(j, j->head + j->count + 1), 1, j->frame);
+    }
+    if (ret != 0) {
+        journal_stats.errors++;
+        return -1;
+    }
+
+    journal_stats.commits++;
+    journal_stats.blocks_logged += j->count;
+    j->head += j->count + 2;
+    j->seq++;
+    j->count = 0;
+    j->due = 0;
+    return 0;
+}
+
+/* journal_checkpoint
+* Inputs: - j : journal, with no operation open
+* Outputs: 0 ; -1 if a write failed, and the log keeps what it has
+* Side Effects: the rest of the metadata the journal logs is edited in place on the device,
+                so its homes are already current and only the bitmaps are written out. The
+                log then starts over empty, the running transaction included
+*/
+int32_t journal_checkpoint(journal_t * j) {
+    uint32_t head;
+
+    if (j->dev == NULL) return -1;
+    if (blk_write(j->dev, journal_sector(j, JOURNAL_INODE_MAP), j->map_sectors[0], j->maps[0]) != 0 ||
+        blk_write(j->dev, journal_sector(j, JOURNAL_BLOCK_MAP), j->map_sectors[1], j->maps[1]) != 0) {
+        journal_stats.errors++;
+        return -1;
+    }
+    head = j->head;
+    j->head = JOURNAL_LOG;
+    j->maps_valid = 1;
+    if (journal_write_super(j) != 0) {
+        j->head = head;
+        journal_stats.errors++;
+        return -1;
+    }
+    j->count = 0;
+    j->overflow = 0;
+    j->due = 0;
+    journal_stats.checkpoints++;
+    return 0;
+}
+
+/* journal_tick
+* Inputs: none, called from the RTC interrupt
+* Outputs: none
+* Side Effects: commits need to sleep on the device, so the tick only marks a transaction
+                that has been open JOURNAL_COMMIT_TICKS as due, for journal_commit_due
+*/
+void journal_tick() {
+    journal_t * j;
+    uint32_t i;
+
+    journal_ticks++;
+    for (i = 0; i < num_open; i++) {
+        j = open_journals[i];
+        if (j->dev != NULL && (j->count > 0 || j->overflow) && journal_ticks - j->opened_at >= JOURNAL_COMMIT_TICKS) {
+            j->due = 1;
+        }
+    }
+}
+
+/* journal_commit_due
+* Inputs: none, called on the way out of every system call
+* Outputs: none
+* Side Effects: commits each transaction journal_tick marked due unless an operation still
+                has it open, then journal_end commits it. A failed commit is counted in
+                journal_stats.errors and the next tick marks the transaction due again
+*/
+void journal_commit_due() {
+    journal_t * j;
+    uint32_t i;
+
+    for (i = 0; i < num_open; i++) {
+        j = open_journals[i];
+        if (!j->due || j->depth > 0) continue;
+        j->due = 0;
+        journal_commit(j);
+    }
+}
@@ -0,0 +1,109 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "types.h"
+#include "block.h"
+
+/* A journal area is JOURNAL_LOG blocks of fixed homes followed by the log: each committed
+ * transaction is a descriptor block naming the home blocks, their images in the same order,
+ * then a commit record. A transaction whose commit record is missing or doesn't match its
+ * descriptor is never replayed. */
+#define JOURNAL_MAGIC 0x4C4E524A // "JRNL", jsuper_t
+#define JOURNAL_DESC_MAGIC 0x43534544 // "DESC", jdesc_t
+#define JOURNAL_COMMIT_MAGIC 0x54494D43 // "CMIT", jcommit_t
+#define JOURNAL_BLOCK_SIZE 4096
+#define JOURNAL_BLOCK_SECTORS (JOURNAL_BLOCK_SIZE / BLK_SECTOR_SIZE)
+#define JOURNAL_SUPER 0 // journal block holding jsuper_t
+#define JOURNAL_INODE_MAP 1 // home of the free-inode bitmap
+#define JOURNAL_BLOCK_MAP 2 // home of the free-block bitmap
+#define JOURNAL_LOG 3 // first block of the log
+#define JOURNAL_MAX_BLOCKS 64 // home blocks one transaction can carry
+#define JOURNAL_MIN_BLOCKS (JOURNAL_LOG + JOURNAL_MAX_BLOCKS + 2) // smallest area a full transaction fits in
+#define JOURNAL_GROUP_BLOCKS 16 // a transaction this big commits when the operation ends
+#define JOURNAL_COMMIT_TICKS 256 // RTC ticks a transaction stays open, 1/4 second at the fixed RTC_BASE_FREQ
+#define JOURNAL_MAX_OPEN 8 // journals journal_tick ages, one per filesystem layer
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq; // sequence number of the first transaction to replay
+    uint32_t tail; // journal block it starts at
+    uint32_t maps_valid; // the bitmap homes hold the allocation state as of this checkpoint
+} jsuper_t;
+
+typedef struct {
+    uint32_t block; // home, in JOURNAL_BLOCK_SIZE units from the start of the device
+    uint32_t sectors; // how much of the image belongs there
+} jtag_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;
+    uint32_t count; // images following the descriptor
+    jtag_t tags[JOURNAL_MAX_BLOCKS];
+} jdesc_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t seq; // same as the descriptor's
+    uint32_t count;
+    uint32_t checksum; // of the descriptor, so a stale record left in the log never matches
+} jcommit_t;
+
+typedef struct {
+    blkdev_t * dev; // NULL if the image has no journal, every call is then a no-op
+    uint32_t start; // device block of the journal superblock
+    uint32_t len; // blocks in the journal area
+    uint32_t seq; // sequence number the running transaction commits as
+    uint32_t head; // journal block the running transaction will be written at
+    uint32_t maps_valid; // the bitmap homes were written at the last checkpoint
+    void * maps[2]; // inode and block bitmaps, in memory
+    uint32_t map_sectors[2];
+    uint8_t * frame; // descriptor, commit record and replay staging
+    // running transaction
+    uint32_t depth; // operations between journal_begin and journal_end, commits wait for 0
+    uint32_t opened_at; // journal tick the transaction took its first block at
+    volatile uint32_t due; // journal_tick found it open JOURNAL_COMMIT_TICKS, journal_commit_due commits it
+    uint32_t overflow; // an operation touched more than JOURNAL_MAX_BLOCKS
+    uint32_t count; // home blocks in it
+    jtag_t tags[JOURNAL_MAX_BLOCKS];
+    const uint8_t * images[JOURNAL_MAX_BLOCKS]; // current contents of each, logged at commit
+    blk_request_t reqs[JOURNAL_MAX_BLOCKS + 1]; // descriptor and images on their way to the log
+} journal_t;
+
+typedef struct {
+    uint32_t commits; // transactions written to a log
+    uint32_t blocks_logged; // home block images they carried
+    uint32_t ops; // operations that shared those commits
+    uint32_t checkpoints; // logs emptied after the homes caught up
+    uint32_t overflows; // operations too big for a transaction, checkpointed instead
+    uint32_t replayed; // committed transactions found and written home at mount
+    uint32_t errors; // failed log or home writes
+} journal_stats_t;
+
+extern journal_stats_t journal_stats;
+
+// attach to the area [start, start + len) of dev, reading its superblock ; 0 or -1
+extern int32_t journal_open(journal_t * j, blkdev_t * dev, uint32_t start, uint32_t len,
+                            void * inode_map, uint32_t inode_map_sectors,
+                            void * block_map, uint32_t block_map_sectors);
+// write every committed transaction of the log tail home ; returns transactions replayed or -1
+extern int32_t journal_replay(journal_t * j);
+// read the bitmaps back from their homes into memory, fails unless maps_valid ; 0 or -1
+extern int32_t journal_load_maps(journal_t * j);
+// an operation starts / ends, the group commit happens at the end of the last one open
+extern void journal_begin(journal_t * j);
+extern int32_t journal_end(journal_t * j);
+// add a home block, whose current contents are at image, to the running transaction
+extern void journal_dirty(journal_t * j, uint32_t block, const void * image, uint32_t sectors);
+// add both bitmaps to the running transaction
+extern void journal_dirty_maps(journal_t * j);
+// write the running transaction to the log now ; 0 or -1
+extern int32_t journal_commit(journal_t * j);
+// write the bitmaps home and empty the log ; 0 or -1
+extern int32_t journal_checkpoint(journal_t * j);
+// timer hook, marks the running transactions that have waited long enough as due
+extern void journal_tick();
+// commit every due transaction no operation holds open, called where sleeping is allowed
+extern void journal_commit_due();
+
+#endif
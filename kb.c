@@ -3,6 +3,10 @@
 #include "lib.h"
 #include "types.h"
 #include "terminal.h"
+#include "device.h"
+
+// the console as a device, read and write both work unlike stdin/stdout
+const fops tty_fops = {kb_open_syscall, kb_close_syscall, kb_read_syscall, kb_write_syscall};
 
 // array of characters that maps scancode to proper 0-9, a-z ASCII characters
 char keys[NUM_MODES][NUM_CODES] = {
@@ -53,6 +57,8 @@ void init_kb() {
   // enable keyboard interrupts for keyboard, KB_ON == 1
   enable_irq(KB_ON);
 
+  register_device((int8_t *)"/dev/tty", MAJOR_TTY, MINOR_CONSOLE, &tty_fops);
+
 }
 
 /* read_kb
@@ -14,6 +14,14 @@
 #include "filesystem.h"
 #include "scheduling.h"
 #include "terminal.h"
+#include "device.h"
+#include "serial.h"
+#include "procfs.h"
+#include "ata.h"
+#include "virtio_blk.h"
+#include "bcache.h"
+#include "slab.h"
+#include "sys_call.h"
 
 #define RUN_TESTS
 
@@ -26,6 +34,7 @@
 void entry(unsigned long magic, unsigned long addr) {
 
     multiboot_info_t *mbi;
+    uint32_t mem_pages, modules_end, n;
 
     /* Clear the screen. */
     clear();
@@ -56,13 +65,14 @@ void entry(unsigned long magic, unsigned long addr) {
     if (CHECK_FLAG(mbi->flags, 2))
         printf("cmdline = %s\n", (char *)mbi->cmdline);
 
+    /* Drivers register with the device registry as they initialize */
+    init_devices();
+    init_procfs();
+
     if (CHECK_FLAG(mbi->flags, 3)) {
         int mod_count = 0;
         int i;
         module_t* mod = (module_t*)mbi->mods_addr;
-
-        init_files((uint32_t) mod->mod_start);
-
         while (mod_count < mbi->mods_count) {
             printf("Module %d loaded at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_start);
             printf("Module %d ends at address: 0x%#x\n", mod_count, (unsigned int)mod->mod_end);
@@ -158,9 +168,51 @@ void entry(unsigned long magic, unsigned long addr) {
     // init the rtc
     rtc_init();
 
+    // init COM1 as /dev/ttyS0
+    init_serial();
+
     //initialize paging
     init_paging();
 
+    // kernel frame pool for growable tables
+    init_frames();
+
+    // kmalloc and the per-object slab caches, carved from the frame pool
+    init_slab();
+
+    // programs get the 4MB pages of RAM the kernel, the frame pool and the modules leave, and the
+    // process table is sized to match ; without a memory size assume RAM ends at the frame pool
+    mem_pages = CHECK_FLAG(mbi->flags, 0) ? (mbi->mem_upper + MEM_UPPER_START_KB) / PROGRAM_PAGE_KB : FRAME_POOL_PDE;
+    modules_end = 0;
+    if (CHECK_FLAG(mbi->flags, 3)) {
+        module_t* mod = (module_t*)mbi->mods_addr;
+        for (n = 0; n < mbi->mods_count; n++) {
+            if (mod[n].mod_end > modules_end) modules_end = mod[n].mod_end;
+        }
+    }
+    init_tasks(init_program_pages(mem_pages, modules_end));
+
+    // IDE disks become block devices, their DMA tables come from the frame pool
+    init_ata();
+    init_virtio_blk();
+
+    // the buffer cache gets a share of whatever frames the drivers left
+    init_bcache();
+
+    // modules are mounted once the cache their file data is read through exists
+    if (CHECK_FLAG(mbi->flags, 3)) {
+        module_t* mod = (module_t*)mbi->mods_addr;
+        uint32_t m;
+
+        // the first module is the base layer, every later one is mounted over it
+        init_files((uint32_t) mod->mod_start);
+        for (m = 1; m < mbi->mods_count; m++) {
+            if (mount_layer((uint32_t) mod[m].mod_start) != 0) {
+                printf("Module %d not mounted, too many layers\n", m);
+            }
+        }
+    }
+
     init_terminals();
 
     // pit_init();
@@ -656,6 +656,36 @@ int8_t* strncpy(int8_t* dest, const int8_t* src, uint32_t n) {
     return dest;
 }
 
+/* uint32_t strhash(const int8_t* s, uint32_t n);
+ * Inputs: const int8_t* s = string to hash
+ *              uint32_t n = most bytes to look at
+ * Return Value: 32-bit FNV-1a hash of the string
+ * Function: hashes up to n bytes, stopping early at the terminator */
+uint32_t strhash(const int8_t* s, uint32_t n) {
+    uint32_t i, hash = 2166136261U;
+    for (i = 0; i < n && s[i] != '\0'; i++) {
+        hash ^= (uint8_t)s[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+/* int32_t find_first_zero(const uint32_t* map, uint32_t nbits);
+ * Inputs: const uint32_t* map = bitmap to search
+ *               uint32_t nbits = number of valid bits in the map
+ * Return Value: index of the first clear bit, or -1 if every bit is set
+ * Function: skips full words, then uses bsf on the inverted word */
+int32_t find_first_zero(const uint32_t* map, uint32_t nbits) {
+    uint32_t i, idx;
+    for (i = 0; i < BITMAP_WORDS(nbits); i++) {
+        if (map[i] == 0xFFFFFFFF)
+            continue;
+        idx = i * BITS_PER_WORD + first_set_bit(~map[i]);
+        return (idx < nbits) ? (int32_t)idx : -1;
+    }
+    return -1;
+}
+
 /* void test_interrupts(void)
  * Inputs: void
  * Return Value: void
@@ -40,6 +40,15 @@ void* memmove(void* dest, const void* src, uint32_t n);
 int32_t strncmp(const int8_t* s1, const int8_t* s2, uint32_t n);
 int8_t* strcpy(int8_t* dest, const int8_t*src);
 int8_t* strncpy(int8_t* dest, const int8_t*src, uint32_t n);
+uint32_t strhash(const int8_t* s, uint32_t n);
+
+/* Bitmap helpers, one bit per slot packed into 32-bit words */
+#define BITS_PER_WORD 32
+#define BITMAP_WORDS(nbits) (((nbits) + BITS_PER_WORD - 1) / BITS_PER_WORD)
+#define bitmap_set(map, i)   ((map)[(i) / BITS_PER_WORD] |= (1U << ((i) % BITS_PER_WORD)))
+#define bitmap_clear(map, i) ((map)[(i) / BITS_PER_WORD] &= ~(1U << ((i) % BITS_PER_WORD)))
+#define bitmap_test(map, i)  (((map)[(i) / BITS_PER_WORD] >> ((i) % BITS_PER_WORD)) & 1U)
+int32_t find_first_zero(const uint32_t* map, uint32_t nbits);
 
 /* Userspace address-check functions */
 int32_t bad_userspace_addr(const void* addr, int32_t len);
@@ -47,6 +56,17 @@ int32_t safe_strncpy(int8_t* dest, const int8_t* src, int32_t n);
 
 extern void test_interrupts();
 
+/* Index of the lowest set bit in a nonzero word */
+static inline uint32_t first_set_bit(uint32_t word) {
+    uint32_t idx;
+    asm volatile ("bsfl %1, %0"
+            : "=r"(idx)
+            : "rm"(word)
+            : "cc"
+    );
+    return idx;
+}
+
 /* Port read functions */
 /* Inb reads a byte and returns its value as a zero-extended 32-bit
  * unsigned int */
@@ -114,7 +134,7 @@ do {                                    \
 /* Writes four bytes to four consecutive ports */
 #define outl(data, port)                \
 do {                                    \
-    asm volatile ("outl %l1, (%w0)"     \
+    asm volatile ("outl %1, (%w0)"      \
             :                           \
             : "d"(port), "a"(data)      \
             : "memory", "cc"            \
@@ -0,0 +1,74 @@
+#include "lz4.h"
+#include "lib.h"
+
+/*
+lz4_length
+functionality: reads the extra length bytes that follow a nibble of LZ4_RUN_MASK
+input: ip - read cursor, advanced past the bytes
+       iend - end of the block
+       len - the nibble value
+output: the full length, or -1 if the block ends first
+Effects: none
+*/
+static int32_t lz4_length(const uint8_t** ip, const uint8_t* iend, uint32_t len) {
+    uint8_t b;
+
+    if (len != LZ4_RUN_MASK) return len;
+    do {
+        if (*ip >= iend) return -1;
+        b = *(*ip)++;
+        len += b;
+    } while (b == LZ4_LEN_BYTE_MAX);
+    return len;
+}
+
+/*
+lz4_decompress
+functionality: decodes an LZ4 block (token, literals, 16-bit offset, match) into dst
+input: src, src_len - the compressed block
+       dst, dst_len - output buffer and its size
+output: number of bytes written to dst, or -1 if the block is malformed or doesn't fit
+Effects: every read and write is bounds checked, so a corrupt image can't overrun dst
+*/
+int32_t lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len) {
+    const uint8_t * ip = src;
+    const uint8_t * iend = src + src_len;
+    const uint8_t * match;
+    uint8_t * op = dst;
+    uint8_t * oend = dst + dst_len;
+    uint32_t token, offset;
+    int32_t len;
+
+    while (ip < iend) {
+        token = *ip++;
+
+        // literals
+        len = lz4_length(&ip, iend, token >> 4);
+        if (len < 0 || len > iend - ip || len > oend - op) return -1;
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+
+        // the last sequence is literals only
+        if (ip == iend) break;
+
+        // match
+        if (iend - ip < 2) return -1;
+        offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (uint32_t)(op - dst)) return -1;
+
+        len = lz4_length(&ip, iend, token & LZ4_RUN_MASK);
+        if (len < 0) return -1;
+        len += LZ4_MIN_MATCH;
+        if (len > oend - op) return -1;
+
+        // byte by byte, the match may overlap what it is producing
+        match = op - offset;
+        while (len-- > 0) {
+            *op++ = *match++;
+        }
+    }
+
+    return op - dst;
+}
@@ -0,0 +1,17 @@
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "types.h"
+
+// LZ4 block format constants
+#define LZ4_MIN_MATCH 4 // a match length nibble of 0 means 4 bytes
+#define LZ4_RUN_MASK 15 // nibble value meaning "more length bytes follow"
+#define LZ4_LEN_BYTE_MAX 255 // a length byte of 255 means another one follows
+
+// worst case size of n bytes after compression
+#define LZ4_BOUND(n) ((n) + (n) / 255 + 16)
+
+// decode one LZ4 block, returns the bytes produced or -1 if the block is malformed
+extern int32_t lz4_decompress(const uint8_t* src, uint32_t src_len, uint8_t* dst, uint32_t dst_len);
+
+#endif
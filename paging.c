@@ -1,5 +1,13 @@
 #include "paging.h"
 
+// one bit per frame in the kernel pool, set when the frame is handed out
+static uint32_t frame_bitmap[BITMAP_WORDS(NUM_FRAMES)];
+static uint32_t num_frames_used = 0;
+
+// one bit per physical 4MB page, set for pages that aren't RAM, hold the kernel, the frame
+// pool or modules, or are running a program
+static uint32_t program_page_bitmap[BITMAP_WORDS(MAX_PROGRAM_PAGES)];
+
 
 /*
 init_paging:
@@ -92,3 +100,161 @@ void add_page(uint32_t physical_address, uint32_t virtual_address){
   // Flush TLB since we changed paging structure
   flush_TLB();
 }
+
+/*
+set_mmap_table:
+functionality: installs a process's mmap page table in the shared page directory
+input: table - 4KB page table from alloc_frame, or NULL if the process has no mappings
+outputs: None
+Effects: the window at MMAP_START shows the given process's mappings, TLB flushed
+*/
+void set_mmap_table(uint32_t * table) {
+  page_dir[MMAP_PDE] = (table == NULL) ? 0 : ((uint32_t)table | USR_WRITE_PRES);
+  flush_TLB();
+}
+
+/*
+init_frames:
+functionality: identity maps the 4MB kernel frame pool and clears its bitmap
+input: None
+outputs: None
+Effects: frames in [FRAME_POOL_START, FRAME_POOL_START + 4MB) become allocatable
+*/
+void init_frames() {
+  memset(frame_bitmap, 0, sizeof(frame_bitmap));
+  num_frames_used = 0;
+
+  // supervisor only, so user programs can never touch kernel frames
+  page_dir[FRAME_POOL_PDE] = FRAME_POOL_START | KERNEL_4MB_SET;
+  flush_TLB();
+}
+
+/*
+alloc_frame:
+functionality: finds the first free frame in the pool and hands it out zeroed
+input: None
+outputs: kernel virtual (== physical) address of the frame, NULL if none are free
+Effects: marks the frame used in the bitmap
+*/
+void * alloc_frame() {
+  void * frame;
+  int32_t idx = find_first_zero(frame_bitmap, NUM_FRAMES);
+
+  if (idx < 0) return NULL;
+
+  bitmap_set(frame_bitmap, idx);
+  num_frames_used++;
+
+  frame = (void *)(FRAME_POOL_START + idx * FOUR_KB);
+  memset(frame, 0, FOUR_KB);
+  return frame;
+}
+
+/*
+alloc_frames:
+functionality: finds the first run of count free frames, for devices that need
+physically contiguous memory
+input: count - frames wanted
+outputs: address of the first frame, NULL if no run is long enough
+Effects: marks the whole run used and zeroes it
+*/
+void * alloc_frames(uint32_t count) {
+  uint32_t start, len;
+
+  if (count == 0) return NULL;
+
+  for (start = 0, len = 0; start + len < NUM_FRAMES; ) {
+    if (bitmap_test(frame_bitmap, start + len)) {
+      start += len + 1;
+      len = 0;
+    } else if (++len == count) {
+      for (len = 0; len < count; len++) bitmap_set(frame_bitmap, start + len);
+      num_frames_used += count;
+      memset((void *)(FRAME_POOL_START + start * FOUR_KB), 0, count * FOUR_KB);
+      return (void *)(FRAME_POOL_START + start * FOUR_KB);
+    }
+  }
+  return NULL;
+}
+
+/*
+free_frame:
+functionality: gives a frame back to the pool
+input: frame - address returned by alloc_frame
+outputs: None
+Effects: clears the frame's bit, ignores addresses outside the pool
+*/
+void free_frame(void * frame) {
+  uint32_t idx = ((uint32_t)frame - FRAME_POOL_START) / FOUR_KB;
+
+  if ((uint32_t)frame < FRAME_POOL_START || idx >= NUM_FRAMES) return;
+  if (!bitmap_test(frame_bitmap, idx)) return;
+
+  bitmap_clear(frame_bitmap, idx);
+  num_frames_used--;
+}
+
+/*
+frames_in_use:
+functionality: reports how many pool frames are handed out
+input: None
+outputs: count of allocated frames
+Effects: None
+*/
+uint32_t frames_in_use() {
+  return num_frames_used;
+}
+
+/*
+init_program_pages:
+functionality: works out which physical 4MB pages programs can be loaded into
+input: mem_pages - whole 4MB pages of RAM counting from address 0, cut off at 4GB
+       reserved_end - first byte past the boot modules, which stay where the loader put them
+outputs: number of pages programs can use, the most processes that can run at once
+Effects: every other page is marked used, so the kernel page, the frame pool and the modules
+are never handed out
+*/
+uint32_t init_program_pages(uint32_t mem_pages, uint32_t reserved_end) {
+  uint32_t i, first, total = 0;
+
+  if (mem_pages > MAX_PROGRAM_PAGES) mem_pages = MAX_PROGRAM_PAGES;
+  first = (reserved_end + FOUR_MB - 1) >> DIR_SHIFT;
+  if (first < (PROGRAM_PAGE_START >> DIR_SHIFT)) first = PROGRAM_PAGE_START >> DIR_SHIFT;
+
+  for (i = 0; i < MAX_PROGRAM_PAGES; i++) {
+    if (i < first || i >= mem_pages || i == FRAME_POOL_PDE) {
+      bitmap_set(program_page_bitmap, i);
+    } else {
+      bitmap_clear(program_page_bitmap, i);
+      total++;
+    }
+  }
+  return total;
+}
+
+/*
+alloc_program_page:
+functionality: finds the lowest free 4MB page for a program image
+input: None
+outputs: physical address of the page, 0 if none are free
+Effects: marks the page used ; it isn't mapped or cleared, execute loads the program over it
+*/
+uint32_t alloc_program_page() {
+  int32_t idx = find_first_zero(program_page_bitmap, MAX_PROGRAM_PAGES);
+
+  if (idx < 0) return 0;
+  bitmap_set(program_page_bitmap, idx);
+  return (uint32_t)idx << DIR_SHIFT;
+}
+
+/*
+free_program_page:
+functionality: gives a program's 4MB page back
+input: addr - address from alloc_program_page, or the directory entry made from it
+outputs: None
+Effects: clears the page's bit, ignores 0
+*/
+void free_program_page(uint32_t addr) {
+  if (addr == 0) return;
+  bitmap_clear(program_page_bitmap, addr >> DIR_SHIFT);
+}
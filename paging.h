@@ -19,6 +19,21 @@
 #define DIR_SHIFT 22 // bit shift to store directory offset
 #define DIR_BITS 0x03FF // bits set for a directory entry
 #define USR_WRITE_PRES 7 // bits to set to user, writeable, and present
+#define KERNEL_4MB_SET 0x83 // bits for a supervisor, writeable, present 4MB page
+#define FRAME_POOL_START 0x2000000 // 32MB, the program pages are allocated around it
+#define FRAME_POOL_PDE (FRAME_POOL_START >> DIR_SHIFT) // directory entry mapping the pool
+#define NUM_FRAMES PAGE_SIZE // 4KB frames in the 4MB pool
+#define USR_READ_PRES 5 // bits to set to user, read only, and present
+#define PTE_COPY 0x200 // available bit: the page is a kernel frame holding a copy, not an image block
+#define PTE_ADDR_MASK 0xFFFFF000 // frame address bits of a page table entry
+#define MMAP_START 0x8C00000 // 140MB, user window for mmap'd files
+#define MMAP_PDE (MMAP_START >> DIR_SHIFT) // directory entry for the mmap window
+#define MMAP_PAGES PAGE_SIZE // 4KB pages in the mmap window
+#define PROGRAM_PAGE_START 0x800000 // 8MB, first byte past the kernel page
+#define MAX_PROGRAM_PAGES PAGE_SIZE // 4MB pages in a 4GB physical space
+#define PROGRAM_PAGE_BITS 0x87 // user, writeable, present 4MB page
+#define PROGRAM_PAGE_KB 4096 // KB in a program page, multiboot reports memory in KB
+#define MEM_UPPER_START_KB 1024 // multiboot's mem_upper counts from 1MB
 
 
 // array of page directory entries
@@ -40,6 +55,25 @@ extern void change_registers();
 extern void flush_TLB();
 // add another page mapping for the program
 extern void add_page(uint32_t physical_address, uint32_t virtual_address);
+// point the mmap window at a process's page table (NULL unmaps the window)
+extern void set_mmap_table(uint32_t * table);
+// map the kernel frame pool and mark every frame free
+extern void init_frames();
+// hand out one zeroed 4KB kernel frame, NULL if the pool is empty
+extern void * alloc_frame();
+// hand out count physically contiguous zeroed frames, NULL if no run is free
+extern void * alloc_frames(uint32_t count);
+// return a frame from alloc_frame to the pool
+extern void free_frame(void * frame);
+// number of frames currently handed out
+extern uint32_t frames_in_use();
+// make the first mem_pages 4MB pages of RAM, past the kernel and reserved_end, allocatable ;
+// returns how many that is
+extern uint32_t init_program_pages(uint32_t mem_pages, uint32_t reserved_end);
+// hand out one physical 4MB page for a program image, 0 if none are free
+extern uint32_t alloc_program_page();
+// return a page from alloc_program_page, flag bits in the address are ignored
+extern void free_program_page(uint32_t addr);
 #endif
 
 
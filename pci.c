@@ -0,0 +1,102 @@
+#include "pci.h"
+#include "lib.h"
+
+#define PCI_FUNC_STEP PCI_DEV(0, 0, 1) // distance between neighbouring functions
+#define PCI_SLOT_STEP PCI_DEV(0, 1, 0)
+#define PCI_FUNC_MASK PCI_DEV(0, 0, PCI_MAX_FUNC - 1)
+#define PCI_END PCI_DEV(PCI_MAX_BUS, 0, 0) // one past the last function
+#define PCI_CLASS_MASK 0xFFFF0000 // class and subclass, ignoring prog-if and revision
+#define PCI_ID_SHIFT 16 // device id sits above the vendor id
+
+/* pci_read
+* Inputs: - dev : function from PCI_DEV
+          - offset : dword aligned config space offset
+* Outputs: the config dword
+* Side Effects: one config cycle through PCI_CONFIG_ADDR/DATA
+*/
+uint32_t pci_read(pci_dev_t dev, uint32_t offset) {
+    outl(PCI_ENABLE | dev | (offset & 0xFC), PCI_CONFIG_ADDR);
+    return inl(PCI_CONFIG_DATA);
+}
+
+/* pci_write
+* Inputs: - dev : function from PCI_DEV
+          - offset : dword aligned config space offset
+          - value : dword to store
+* Outputs: none
+* Side Effects: one config cycle through PCI_CONFIG_ADDR/DATA
+*/
+void pci_write(pci_dev_t dev, uint32_t offset, uint32_t value) {
+    outl(PCI_ENABLE | dev | (offset & 0xFC), PCI_CONFIG_ADDR);
+    outl(value, PCI_CONFIG_DATA);
+}
+
+/* pci_scan
+* Inputs: - offset : config dword to compare
+          - mask : bits of it that matter
+          - want : value those bits must have
+          - start : first function to look at
+* Outputs: first present function that matches ; PCI_NONE if none does
+* Side Effects: skips empty slots and the upper functions of single-function devices
+*/
+static pci_dev_t pci_scan(uint32_t offset, uint32_t mask, uint32_t want, pci_dev_t start) {
+    pci_dev_t dev = start;
+
+    while (dev < PCI_END) {
+        if ((pci_read(dev, PCI_VENDOR_ID) & PCI_NO_VENDOR) == PCI_NO_VENDOR) {
+            // nothing at function 0 means nothing in the whole slot
+            dev = ((dev & PCI_FUNC_MASK) == 0) ? dev + PCI_SLOT_STEP : dev + PCI_FUNC_STEP;
+            continue;
+        }
+        if ((pci_read(dev, offset) & mask) == want) return dev;
+
+        if ((dev & PCI_FUNC_MASK) == 0 && !(pci_read(dev, PCI_HEADER_TYPE) & PCI_MULTI_FUNC)) {
+            dev += PCI_SLOT_STEP;
+        } else {
+            dev += PCI_FUNC_STEP;
+        }
+    }
+    return PCI_NONE;
+}
+
+/* pci_find_class
+* Inputs: - class, subclass : PCI class code, e.g. 0x01, 0x01 for an IDE controller
+          - start : PCI_DEV(0, 0, 0), or one function past the previous match
+* Outputs: matching function ; PCI_NONE if none is left
+* Side Effects: none
+*/
+pci_dev_t pci_find_class(uint32_t class, uint32_t subclass, pci_dev_t start) {
+    return pci_scan(PCI_CLASS, PCI_CLASS_MASK, (class << 24) | (subclass << 16), start);
+}
+
+/* pci_find_device
+* Inputs: - vendor, device : PCI ids
+          - start : PCI_DEV(0, 0, 0), or one function past the previous match
+* Outputs: matching function ; PCI_NONE if none is left
+* Side Effects: none
+*/
+pci_dev_t pci_find_device(uint32_t vendor, uint32_t device, pci_dev_t start) {
+    return pci_scan(PCI_VENDOR_ID, 0xFFFFFFFF, (device << PCI_ID_SHIFT) | vendor, start);
+}
+
+/* pci_io_bar
+* Inputs: - dev : function
+          - n : BAR number, 0-5
+* Outputs: I/O port base of the BAR ; 0 for a memory BAR
+* Side Effects: none
+*/
+uint32_t pci_io_bar(pci_dev_t dev, uint32_t n) {
+    uint32_t bar = pci_read(dev, PCI_BAR0 + n * 4);
+
+    if (!(bar & PCI_BAR_IO)) return 0;
+    return bar & PCI_BAR_IO_MASK;
+}
+
+/* pci_enable_master
+* Inputs: - dev : function
+* Outputs: none
+* Side Effects: sets the I/O space and bus master bits of the command register
+*/
+void pci_enable_master(pci_dev_t dev) {
+    pci_write(dev, PCI_COMMAND, pci_read(dev, PCI_COMMAND) | PCI_CMD_IO | PCI_CMD_MASTER);
+}
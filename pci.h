@@ -0,0 +1,49 @@
+#ifndef PCI_H
+#define PCI_H
+
+#include "types.h"
+
+// configuration mechanism #1 ports
+#define PCI_CONFIG_ADDR 0xCF8
+#define PCI_CONFIG_DATA 0xCFC
+#define PCI_ENABLE 0x80000000 // set in the address to start a config cycle
+
+// bus/slot/function ranges scanned by pci_find_class
+#define PCI_MAX_BUS 256
+#define PCI_MAX_SLOT 32
+#define PCI_MAX_FUNC 8
+
+// config space offsets
+#define PCI_VENDOR_ID 0x00 // vendor in the low half, device in the high half
+#define PCI_COMMAND 0x04
+#define PCI_CLASS 0x08 // class, subclass, prog-if, revision from the top byte down
+#define PCI_HEADER_TYPE 0x0C // header type is the third byte of this dword
+#define PCI_BAR0 0x10 // six 4-byte BARs follow
+#define PCI_SUBSYSTEM 0x2C // subsystem vendor low, subsystem id high
+#define PCI_INTERRUPT_LINE 0x3C // low byte is the PIC line the firmware routed
+
+#define PCI_NO_VENDOR 0xFFFF // read back from an empty slot
+#define PCI_MULTI_FUNC 0x800000 // header type bit 7, in PCI_HEADER_TYPE's dword
+#define PCI_BAR_IO 0x1 // BAR describes an I/O port range
+#define PCI_BAR_IO_MASK 0xFFFFFFFC
+#define PCI_CMD_IO 0x1 // decode I/O BARs
+#define PCI_CMD_MASTER 0x4 // allow the device to DMA
+
+// a PCI function, packed the way PCI_CONFIG_ADDR wants it
+typedef uint32_t pci_dev_t;
+#define PCI_NONE 0xFFFFFFFF
+#define PCI_DEV(bus, slot, func) (((bus) << 16) | ((slot) << 11) | ((func) << 8))
+
+// 32-bit config read/write, offset is dword aligned
+extern uint32_t pci_read(pci_dev_t dev, uint32_t offset);
+extern void pci_write(pci_dev_t dev, uint32_t offset, uint32_t value);
+// first function with this class/subclass at or after start, PCI_NONE if there is none
+extern pci_dev_t pci_find_class(uint32_t class, uint32_t subclass, pci_dev_t start);
+// first function with this vendor/device at or after start, PCI_NONE if there is none
+extern pci_dev_t pci_find_device(uint32_t vendor, uint32_t device, pci_dev_t start);
+// I/O port base behind BAR n, 0 if it is a memory BAR
+extern uint32_t pci_io_bar(pci_dev_t dev, uint32_t n);
+// turn on I/O decode and bus mastering
+extern void pci_enable_master(pci_dev_t dev);
+
+#endif
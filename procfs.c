@@ -0,0 +1,344 @@
+#include "types.h"
+#include "lib.h"
+#include "procfs.h"
+#include "device.h"
+#include "sys_call.h"
+#include "paging.h"
+#include "idt.h"
+#include "scheduling.h"
+#include "block.h"
+#include "bcache.h"
+#include "journal.h"
+#include "slab.h"
+
+typedef void (*proc_gen_t)(proc_buf_t * pb);
+
+static void gen_ps(proc_buf_t * pb);
+static void gen_interrupts(proc_buf_t * pb);
+static void gen_sched(proc_buf_t * pb);
+static void gen_fs(proc_buf_t * pb);
+static void gen_meminfo(proc_buf_t * pb);
+static void gen_diskstats(proc_buf_t * pb);
+static void gen_bcache(proc_buf_t * pb);
+static void gen_slabinfo(proc_buf_t * pb);
+
+// indexed by minor number
+static const struct {
+    const int8_t * name;
+    proc_gen_t gen;
+} proc_files[] = {
+    {"/proc/ps", gen_ps},
+    {"/proc/interrupts", gen_interrupts},
+    {"/proc/sched", gen_sched},
+    {"/proc/fs", gen_fs},
+    {"/proc/meminfo", gen_meminfo},
+    {"/proc/diskstats", gen_diskstats},
+    {"/proc/bcache", gen_bcache},
+    {"/proc/slabinfo", gen_slabinfo},
+};
+#define NUM_PROC_FILES (sizeof(proc_files) / sizeof(proc_files[0]))
+
+const fops proc_fops = {proc_open, proc_close, proc_read, proc_write};
+
+// scratch space the current report is generated into
+static int8_t proc_scratch[PROC_BUF_SIZE];
+
+/* init_procfs
+* Inputs: none
+* Outputs: none
+* Side Effects: every /proc file becomes openable through the device registry
+*/
+void init_procfs() {
+    uint32_t i;
+    for (i = 0; i < NUM_PROC_FILES; i++) {
+        register_device(proc_files[i].name, MAJOR_PROC, i, &proc_fops);
+    }
+}
+
+/* proc_open
+* Inputs: unused
+* Outputs: return 0, reports are generated on read
+*/
+int32_t proc_open(const uint8_t * filename) {
+    return 0;
+}
+
+/* proc_close
+* Inputs: unused
+* Outputs: return 0
+*/
+int32_t proc_close(int32_t fd) {
+    return 0;
+}
+
+/* proc_read
+* Inputs: - fd : descriptor of an open /proc file
+          - buf : user buffer
+          - nbytes : most bytes to copy
+* Outputs: bytes copied, 0 at the end of the report, -1 for a bad fd
+* Side Effects: regenerates the whole report, then advances file_pos past what was copied
+*/
+int32_t proc_read(int32_t fd, void * buf, int32_t nbytes) {
+    file_desc_t * desc = get_fd(curr_pcb(), fd);
+    proc_buf_t pb;
+    uint32_t minor;
+
+    if (desc == NULL || buf == NULL || nbytes < 0) return -1;
+
+    minor = DEV_MINOR(desc->file_dev);
+    if (minor >= NUM_PROC_FILES) return -1;
+
+    pb.buf = proc_scratch;
+    pb.len = 0;
+    pb.cap = PROC_BUF_SIZE;
+    proc_files[minor].gen(&pb);
+
+    if (desc->file_pos >= pb.len) return 0;
+    if ((uint32_t)nbytes > pb.len - desc->file_pos) nbytes = pb.len - desc->file_pos;
+
+    memcpy(buf, pb.buf + desc->file_pos, nbytes);
+    desc->file_pos += nbytes;
+    return nbytes;
+}
+
+/* proc_write
+* Inputs: unused
+* Outputs: return -1, /proc files are read only
+*/
+int32_t proc_write(int32_t fd, const void * buf, int32_t nbytes) {
+    return -1;
+}
+
+/* proc_puts
+* Inputs: - pb : report being built
+          - s : string to append
+* Outputs: none
+* Side Effects: appends as much of s as fits
+*/
+void proc_puts(proc_buf_t * pb, const int8_t * s) {
+    while (*s != '\0' && pb->len < pb->cap) {
+        pb->buf[pb->len++] = *s++;
+    }
+}
+
+/* proc_putu
+* Inputs: - pb : report being built
+          - value : number to append in decimal
+* Outputs: none
+*/
+void proc_putu(proc_buf_t * pb, uint32_t value) {
+    int8_t num[PROC_NUM_LEN];
+    proc_puts(pb, itoa(value, num, 10));
+}
+
+/* proc_stat
+* Inputs: - pb : report being built
+          - name : counter name
+          - value : counter value
+* Outputs: none
+* Side Effects: appends one "name value" line
+*/
+void proc_stat(proc_buf_t * pb, const int8_t * name, uint32_t value) {
+    proc_puts(pb, name);
+    proc_puts(pb, " ");
+    proc_putu(pb, value);
+    proc_puts(pb, "\n");
+}
+
+/* gen_ps
+* Inputs: - pb : report being built
+* Outputs: none
+* Side Effects: one line per running process: pid, parent, open fds and arguments
+*/
+static void gen_ps(proc_buf_t * pb) {
+    uint32_t pid, i, open_fds;
+    pcb_t * pcb;
+
+    proc_puts(pb, "pid ppid fds args\n");
+    for (pid = 0; pid < num_processes; pid++) {
+        if (!pid_in_use(pid)) continue;
+
+        pcb = get_parent_pcb(pid);
+        open_fds = 0;
+        for (i = 0; i < FD_WORDS; i++) {
+            // popcount by clearing the lowest set bit until the word is empty
+            uint32_t word = pcb->fd_table.fd_bitmap[i];
+            while (word) {
+                word &= word - 1;
+                open_fds++;
+            }
+        }
+
+        proc_putu(pb, pcb->curr_pid);
+        proc_puts(pb, " ");
+        proc_putu(pb, pcb->parent_pid);
+        proc_puts(pb, " ");
+        proc_putu(pb, open_fds);
+        proc_puts(pb, " ");
+        proc_puts(pb, (int8_t *)pcb->args_buf);
+        proc_puts(pb, "\n");
+    }
+}
+
+/* gen_interrupts
+* Inputs: - pb : report being built
+* Outputs: none
+* Side Effects: one "vector count" line for every vector that has fired
+*/
+static void gen_interrupts(proc_buf_t * pb) {
+    uint32_t vec;
+
+    proc_puts(pb, "vector count\n");
+    for (vec = 0; vec < OTHER_VECTOR; vec++) {
+        if (vector_count[vec] == 0) continue;
+        proc_putu(pb, vec);
+        proc_puts(pb, " ");
+        proc_putu(pb, vector_count[vec]);
+        proc_puts(pb, "\n");
+    }
+    proc_stat(pb, "other", vector_count[OTHER_VECTOR]);
+}
+
+/* gen_sched
+* Inputs: - pb : report being built
+* Outputs: none
+*/
+static void gen_sched(proc_buf_t * pb) {
+    proc_stat(pb, "ticks", sched_stats.ticks);
+    proc_stat(pb, "context_switches", sched_stats.context_switches);
+    proc_stat(pb, "execs", sched_stats.execs);
+    proc_stat(pb, "halts", sched_stats.halts);
+}
+
+/* gen_fs
+* Inputs: - pb : report being built
+* Outputs: none
+*/
+static void gen_fs(proc_buf_t * pb) {
+    proc_stat(pb, "version", fs_stats.version);
+    proc_stat(pb, "features", fs_stats.features);
+    proc_stat(pb, "layers", fs_stats.layers);
+    proc_stat(pb, "lookups", fs_stats.lookups);
+    proc_stat(pb, "lookup_misses", fs_stats.lookup_misses);
+    proc_stat(pb, "dentries_scanned", fs_stats.dentries_scanned);
+    proc_stat(pb, "reads", fs_stats.reads);
+    proc_stat(pb, "bytes_read", fs_stats.bytes_read);
+    proc_stat(pb, "blocks_read", fs_stats.blocks_read);
+    proc_stat(pb, "runs_copied", fs_stats.runs_copied);
+    proc_stat(pb, "run_cache_hits", fs_stats.run_cache_hits);
+    proc_stat(pb, "run_cache_misses", fs_stats.run_cache_misses);
+    proc_stat(pb, "ind_cache_hits", fs_stats.ind_cache_hits);
+    proc_stat(pb, "ind_cache_misses", fs_stats.ind_cache_misses);
+    proc_stat(pb, "frame_cache_hits", fs_stats.frame_cache_hits);
+    proc_stat(pb, "frames_decompressed", fs_stats.frames_decompressed);
+    proc_stat(pb, "dcache_hits", fs_stats.dcache_hits);
+    proc_stat(pb, "dcache_negative_hits", fs_stats.dcache_negative_hits);
+    proc_stat(pb, "dcache_misses", fs_stats.dcache_misses);
+    proc_stat(pb, "bytes_written", fs_stats.bytes_written);
+    proc_stat(pb, "free_inodes", fs_stats.free_inodes);
+    proc_stat(pb, "free_blocks", fs_stats.free_blocks);
+    proc_stat(pb, "journal_commits", journal_stats.commits);
+    proc_stat(pb, "journal_blocks", journal_stats.blocks_logged);
+    proc_stat(pb, "journal_ops", journal_stats.ops);
+    proc_stat(pb, "journal_checkpoints", journal_stats.checkpoints);
+    proc_stat(pb, "journal_overflows", journal_stats.overflows);
+    proc_stat(pb, "journal_replayed", journal_stats.replayed);
+    proc_stat(pb, "journal_errors", journal_stats.errors);
+}
+
+/* gen_meminfo
+* Inputs: - pb : report being built
+* Outputs: none
+*/
+static void gen_meminfo(proc_buf_t * pb) {
+    proc_stat(pb, "frames_total", NUM_FRAMES);
+    proc_stat(pb, "frames_used", frames_in_use());
+    proc_stat(pb, "frames_free", NUM_FRAMES - frames_in_use());
+}
+
+/* gen_diskstats
+* Inputs: - pb : report being built
+* Outputs: none
+* Side Effects: one line per block device; latencies are TSC cycles from submit to completion
+*/
+static void gen_diskstats(proc_buf_t * pb) {
+    blkdev_t * dev;
+    uint32_t i;
+
+    proc_puts(pb, "dev reads writes sectors_read sectors_written merges dispatches depth max_depth lat_avg lat_max errors\n");
+    for (i = 0; (dev = get_blkdev(i)) != NULL; i++) {
+        proc_puts(pb, dev->name);
+        proc_puts(pb, " ");
+        proc_putu(pb, dev->reads);
+        proc_puts(pb, " ");
+        proc_putu(pb, dev->writes);
+        proc_puts(pb, " ");
+        proc_putu(pb, dev->sectors_read);
+        proc_puts(pb, " ");
+        proc_putu(pb, dev->sectors_written);
+        proc_puts(pb, " ");
+        proc_putu(pb, dev->merges);
+        proc_puts(pb, " ");
+        proc_putu(pb, dev->dispatches);
+        proc_puts(pb, " ");
+        proc_putu(pb, dev->depth);
+        proc_puts(pb, " ");
+        proc_putu(pb, dev->max_depth);
+        proc_puts(pb, " ");
+        proc_putu(pb, dev->lat_avg);
+        proc_puts(pb, " ");
+        proc_putu(pb, dev->lat_max);
+        proc_puts(pb, " ");
+        proc_putu(pb, dev->errors);
+        proc_puts(pb, "\n");
+    }
+}
+
+/* gen_bcache
+* Inputs: - pb : report being built
+* Outputs: none
+* Side Effects: buffer cache size, hit/miss/eviction, readahead and writeback counters
+*/
+static void gen_bcache(proc_buf_t * pb) {
+    proc_stat(pb, "bufs", bcache_stats.bufs);
+    proc_stat(pb, "hits", bcache_stats.hits);
+    proc_stat(pb, "misses", bcache_stats.misses);
+    proc_stat(pb, "evictions", bcache_stats.evictions);
+    proc_stat(pb, "writes", bcache_stats.writes);
+    proc_stat(pb, "dirty", bcache_stats.dirty);
+    proc_stat(pb, "flushes", bcache_stats.flushes);
+    proc_stat(pb, "read_errors", bcache_stats.read_errors);
+    proc_stat(pb, "write_errors", bcache_stats.write_errors);
+    proc_stat(pb, "readahead", bcache_stats.readahead);
+    proc_stat(pb, "readahead_hits", bcache_stats.readahead_hits);
+}
+
+/* gen_slabinfo
+* Inputs: - pb : report being built
+* Outputs: none
+* Side Effects: one line per slab cache, kmalloc's size classes first
+*/
+static void gen_slabinfo(proc_buf_t * pb) {
+    kmem_cache_t * cache;
+    uint32_t i;
+
+    proc_puts(pb, "name active total size slabs allocs frees failures\n");
+    for (i = 0; (cache = get_kmem_cache(i)) != NULL; i++) {
+        proc_puts(pb, cache->name);
+        proc_puts(pb, " ");
+        proc_putu(pb, cache->active);
+        proc_puts(pb, " ");
+        proc_putu(pb, cache->slabs * cache->per_slab);
+        proc_puts(pb, " ");
+        proc_putu(pb, cache->size);
+        proc_puts(pb, " ");
+        proc_putu(pb, cache->slabs);
+        proc_puts(pb, " ");
+        proc_putu(pb, cache->allocs);
+        proc_puts(pb, " ");
+        proc_putu(pb, cache->frees);
+        proc_puts(pb, " ");
+        proc_putu(pb, cache->failures);
+        proc_puts(pb, "\n");
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef PROCFS_H
+#define PROCFS_H
+
+#include "types.h"
+
+#define MAJOR_PROC 2 // device major shared by every /proc file
+#define PROC_BUF_SIZE 8192 // largest report a /proc file can produce
+#define PROC_NUM_LEN 11 // digits in a 32-bit value plus terminator
+
+// minor numbers, one per generated file
+#define PROC_PS 0
+#define PROC_INTERRUPTS 1
+#define PROC_SCHED 2
+#define PROC_FS 3
+#define PROC_MEMINFO 4
+#define PROC_DISKSTATS 5
+#define PROC_BCACHE 6
+#define PROC_SLABINFO 7
+
+// text being generated for one read of a /proc file
+typedef struct {
+    int8_t * buf;
+    uint32_t len;
+    uint32_t cap;
+} proc_buf_t;
+
+// register every /proc file with the device registry
+extern void init_procfs();
+extern int32_t proc_open(const uint8_t * filename);
+extern int32_t proc_close(int32_t fd);
+// regenerate the file and copy out the bytes at the descriptor's position
+extern int32_t proc_read(int32_t fd, void * buf, int32_t nbytes);
+extern int32_t proc_write(int32_t fd, const void * buf, int32_t nbytes);
+
+// append helpers for generators
+extern void proc_puts(proc_buf_t * pb, const int8_t * s);
+extern void proc_putu(proc_buf_t * pb, uint32_t value);
+// append "name value\n"
+extern void proc_stat(proc_buf_t * pb, const int8_t * name, uint32_t value);
+
+#endif
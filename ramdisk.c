@@ -0,0 +1,95 @@
+#include "ramdisk.h"
+#include "lib.h"
+#include "sys_call.h"
+
+typedef struct {
+    uint8_t * base;
+    blkdev_t * dev;
+    blk_request_t * pending[RAMDISK_PENDING]; // copied runs waiting for the unplug to complete them
+    uint32_t num_pending;
+} ramdisk_t;
+
+static ramdisk_t ramdisks[MAX_RAMDISKS];
+static uint32_t num_ramdisks = 0;
+
+/* ram_dispatch
+* Inputs: - dev : a ramdisk
+          - req : first request of a run
+* Outputs: BLK_STARTED ; BLK_BUSY while RAMDISK_PENDING runs wait to complete
+* Side Effects: the copy happens right away, but completing here would re-enter the queue
+                the block layer is still walking, so the run waits for ram_unplug
+*/
+static int32_t ram_dispatch(blkdev_t * dev, blk_request_t * req) {
+    ramdisk_t * rd = (ramdisk_t *)dev->priv;
+    blk_request_t * seg;
+    uint8_t * disk;
+    uint32_t len;
+
+    if (rd->num_pending == RAMDISK_PENDING) return BLK_BUSY;
+
+    disk = rd->base + (req->sector << BLK_SECTOR_SHIFT);
+    for (seg = req; seg != NULL; seg = seg->merged) {
+        len = seg->count << BLK_SECTOR_SHIFT;
+        if (req->dir == BLK_WRITE) {
+            memcpy(disk, seg->buf, len);
+        } else {
+            memcpy(seg->buf, disk, len);
+        }
+        disk += len;
+    }
+    rd->pending[rd->num_pending++] = req;
+    return BLK_STARTED;
+}
+
+/* ram_unplug
+* Inputs: - dev : a ramdisk
+* Outputs: none
+* Side Effects: completes every copied run ; each completion may dispatch (and complete)
+                more of the queue before this returns
+*/
+static void ram_unplug(blkdev_t * dev) {
+    ramdisk_t * rd = (ramdisk_t *)dev->priv;
+    blk_request_t * req;
+    uint32_t flags;
+
+    cli_and_save(flags);
+    while (rd->num_pending > 0) {
+        req = rd->pending[--rd->num_pending];
+        blk_complete(dev, req, BLK_DONE);
+    }
+    restore_flags(flags);
+}
+
+/* register_ramdisk
+* Inputs: - base : start of the memory
+          - bytes : its size, rounded down to whole sectors
+* Outputs: the device, the existing one if base is already registered ; NULL if
+           MAX_RAMDISKS are registered or the block layer is full
+* Side Effects: the memory is named ram0, ram1, ... in registration order
+*/
+blkdev_t * register_ramdisk(uint8_t * base, uint32_t bytes) {
+    ramdisk_t * rd;
+    blkdev_t * dev;
+    int8_t name[BLK_NAME_LEN];
+    uint32_t i;
+
+    if (base == NULL) return NULL;
+    // remounting an image finds the device it already has
+    for (i = 0; i < num_ramdisks; i++) {
+        if (ramdisks[i].base == base) return ramdisks[i].dev;
+    }
+    if (num_ramdisks == MAX_RAMDISKS) return NULL;
+
+    rd = &ramdisks[num_ramdisks];
+    rd->base = base;
+    rd->num_pending = 0;
+
+    strcpy(name, (int8_t *)"ram");
+    itoa(num_ramdisks, name + strlen(name), 10);
+    dev = register_blkdev(name, bytes >> BLK_SECTOR_SHIFT, RAMDISK_MAX_SECTORS, RAMDISK_MAX_SEGMENTS,
+                          ram_dispatch, ram_unplug, ram_unplug, rd);
+    if (dev == NULL) return NULL;
+    rd->dev = dev;
+    num_ramdisks++;
+    return dev;
+}
@@ -0,0 +1,15 @@
+#ifndef RAMDISK_H
+#define RAMDISK_H
+
+#include "types.h"
+#include "block.h"
+
+#define MAX_RAMDISKS 8 // one per filesystem layer
+#define RAMDISK_MAX_SECTORS 128 // largest run one copy moves
+#define RAMDISK_MAX_SEGMENTS 32
+#define RAMDISK_PENDING BLK_BATCH // runs copied but not yet completed
+
+// register the memory [base, base + bytes) as the block device ramN, NULL if the table is full
+extern blkdev_t * register_ramdisk(uint8_t * base, uint32_t bytes);
+
+#endif
@@ -3,7 +3,15 @@
 #include "lib.h"
 #include "i8259.h"
 #include "tests.h"
+#include "device.h"
+#include "bcache.h"
+#include "journal.h"
+
+const fops rtc_fops = {rtc_open, rtc_close, rtc_read, rtc_write};
 volatile int rtc_interrupt_flag = 0;                         // globaly declare the interrupt flag as no interupt
+volatile uint32_t rtc_ticks = 0;                             // hardware interrupts since boot
+static volatile uint32_t rtc_freq = freq_2;                  // rate programs asked for with rtc_write, 0 for none
+static volatile uint32_t rtc_countdown = RTC_BASE_FREQ / freq_2; // hardware ticks until a program sees the next one
 
 /*
 rtc_init:
@@ -12,18 +20,26 @@ enable & generate on IRQ 8
 input:  None
 outpu: None
 Effects: RTC Interrupts are disabled by default, this will
-enable & generate on IRQ 8
+enable & generate on IRQ 8. The chip is set to RTC_BASE_FREQ for good,
+the buffer cache and journal timers count its ticks
 */
 void rtc_init(){
     outb(stat_reg_a, reg_num);      // select reg a
     unsigned char old_a = inb(write_CMOS);      // cur a value
+    outb(stat_reg_a, reg_num);      // select reg a again, the read left the index on reg d
+    outb((old_a & first_half_mask) | rate_freq_1024, write_CMOS);   // fixed base rate
     outb(stat_reg_b, reg_num);      // select reg b
-    //unsigned char old_b = inb(0x71);
-    outb(old_a | bit_six, write_CMOS);  // only 6 bit of reg b on
+    unsigned char old_b = inb(write_CMOS);
+    outb(stat_reg_b, reg_num);      // select reg b again
+    outb(old_b | bit_six, write_CMOS);  // only 6 bit of reg b on
     enable_irq(irq_line);           // enable line 8
 
     // enable rtc interrupts, RTC_ON == 8
     enable_irq(irq_line);
+
+    // reachable both as /dev/rtc and through the "rtc" dentry in the filesystem
+    register_device((int8_t *)"/dev/rtc", MAJOR_RTC, 0, &rtc_fops);
+    register_filetype(RTC_TYPE, &rtc_fops, MKDEV(MAJOR_RTC, 0));
 }
 
 /*
@@ -44,7 +60,14 @@ void rtc_interrupt(){
       //printf("1");		// we need to print a 1 for every interupts
       send_eoi(irq_line);
       //printf("1");                              // added for rtc write test
-      rtc_interrupt_flag = 1;                   // indicates we got an interuptope
+      rtc_ticks++;
+      // programs see their own rate, divided down from the fixed one
+      if (rtc_freq != freq_0 && --rtc_countdown == 0) {
+          rtc_countdown = RTC_BASE_FREQ / rtc_freq;
+          rtc_interrupt_flag = 1;               // indicates we got an interuptope
+      }
+      bcache_tick();                            // timed writeback of the buffer cache
+      journal_tick();                           // marks old journal transactions due
       // sending end of interrupt signal
     // Allow Interupt flags
     sti();
@@ -91,61 +114,40 @@ input:
     nytes - number of bytes; always four for rtc
 output: -1 for invalid / FAIL
         0 for successful write
-Effects: Sets the new desired RTC Frequency
+Effects: Sets the new desired RTC Frequency that rtc_read waits on. The chip
+stays at RTC_BASE_FREQ, so 0 only stops rtc_read returning and the kernel's
+timers keep running
 */
 int32_t rtc_write(int32_t fd, const void* buf, int32_t nbytes){
-    uint8_t rate;
-
     if(nbytes != max_rtc_bytes || buf == NULL){         // assure we have 4 bytes and the buffer is not null
         return -1;
     }
 
     uint32_t frequency = *((uint32_t*) buf);         // determine frequency
-    outb(stat_reg_a, reg_num);       // hold  the old rtc data
-    char previous = inb(write_CMOS);
+    uint32_t flags;
 
-    switch(frequency){                              // set the rate based on freq
+    switch(frequency){                              // the rates the chip could run at
         case freq_1024:
-            rate = rate_freq_1024;
-            break;
         case freq_512:
-            rate = rate_freq_512;
-            break;
         case freq_256:
-            rate = rate_freq_256;
-            break;
         case freq_128:
-            rate = rate_freq_128;
-            break;
         case freq_64:
-            rate = rate_freq_64;
-            break;
         case freq_32:
-            rate = rate_freq_32;
-            break;
         case freq_16:
-            rate = rate_freq_16;
-            break;
         case freq_8:
-            rate = rate_freq_8;
-            break;
         case freq_4:
-            rate = rate_freq_4;
-            break;
         case freq_2:
-            rate = rate_freq_2;
-            break;
         case freq_0:
-            rate = rate_freq_0;
             break;
         default:
             return -1;
     }
 
-    outb(stat_reg_a, reg_num);
-    char temp = (previous & first_half_mask);       // We want first half
-    temp = (temp | rate);                           // combine values
-    outb(temp, write_CMOS);                           // write new freq
+    cli_and_save(flags);
+    rtc_freq = frequency;
+    rtc_countdown = (frequency == freq_0) ? 0 : RTC_BASE_FREQ / frequency;
+    rtc_interrupt_flag = 0;                         // the first read waits a whole period
+    restore_flags(flags);
     //printf("GOT TO END OF WRITE");
     return 0;
 }
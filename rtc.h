@@ -10,6 +10,7 @@ int32_t rtc_read (int32_t fd, void *buf, int32_t nbytes);
 int32_t rtc_write (int32_t fd, const void* buf, int32_t nbytes);
 int32_t rtc_close (int32_t fd);
 //volatile int rtc_interrupt_flag; // inidicates if an int is occuring, must be volitile due to
+extern volatile uint32_t rtc_ticks; // hardware interrupts since boot, always RTC_BASE_FREQ a second
 
 
 // used for testing only
@@ -48,3 +49,4 @@ int32_t rtc_close (int32_t fd);
 #define rate_freq_2 0x0F
 #define rate_freq_0 0x00
 #define max_rtc_bytes 4
+#define RTC_BASE_FREQ freq_1024 // rate the chip always runs at, rtc_write only divides it for programs
@@ -9,6 +9,8 @@
 #include "i8259.h"
 #include "terminal.h"
 
+sched_stats_t sched_stats;
+
 // Use Equal Time Slices Round Robin
 // Test with counter, Ping Pong, fish
 // be mindful of Synchronization Issues
@@ -72,6 +74,7 @@ void pit_interrupt(void){
 
     printf("int ");
     send_eoi(PIT_IRQ);            // end the cur int before we update
+    sched_stats.ticks++;
 
     // cli();                  // Start: Mask Interrupts
     // send_eoi defined in i8259 for refrence
@@ -94,9 +97,13 @@ void pit_interrupt(void){
       return;
     }
 
-    next_process_number = (next_process_number+1) % 6;
-    while (current_processses_running[0] == FREE) {
-      next_process_number = (next_process_number+1) % 6;
+    // no process table to pick from, init_tasks couldn't allocate one
+    if (num_processes == 0) {
+      return;
+    }
+    next_process_number = (next_process_number+1) % num_processes;
+    while (!pid_in_use(next_process_number)) {
+      next_process_number = (next_process_number+1) % num_processes;
     }
 
 
@@ -140,6 +147,11 @@ void switch_process(int pid, int next_pid) {
   // save current ebp/esp
   pcb_t * curr_pcb = get_parent_pcb(pid);
   pcb_t * next_pcb = get_parent_pcb(next_pid);
+  // a pid that has never run has no task struct to save into or switch to
+  if (curr_pcb == NULL || next_pcb == NULL) {
+    return;
+  }
+  sched_stats.context_switches++;
   asm volatile(
                "movl %%esp, %%eax;"
                "movl %%ebp, %%ebx;"
@@ -152,8 +164,12 @@ void switch_process(int pid, int next_pid) {
   printf("next terminal: %d", running_terminal);
 
 
+  // show the next process's mmap'd files
+  set_mmap_table(next_pcb->mmap_table);
+  current = next_pcb;
+
   // set tss to next process
-  tss.esp0 = STACK_START - (STACK_SIZE * next_pid) - TSS_OFFSET;// -4 is for the tss struct and how it's stored
+  tss.esp0 = next_pcb->esp0;
 
 
   // update vidmem
@@ -13,5 +13,15 @@ extern void pit_interrupt();
 
 extern void switch_process(int pid, int next_pid);
 
-int8_t cur_process_number;
-int8_t next_process_number;
+typedef struct {
+  uint32_t ticks; // PIT interrupts handled
+  uint32_t context_switches; // times the running process changed
+  uint32_t execs; // programs started by execute
+  uint32_t halts; // programs that returned through halt
+} sched_stats_t;
+
+// scheduler counters, read by /proc/sched
+extern sched_stats_t sched_stats;
+
+int32_t cur_process_number;
+int32_t next_process_number;
@@ -0,0 +1,79 @@
+#include "serial.h"
+#include "lib.h"
+#include "device.h"
+
+const fops serial_fops = {serial_open, serial_close, serial_read, serial_write};
+
+/*
+init_serial:
+functionality: sets COM1 to 38400 8N1 with FIFOs on and interrupts off
+input: None
+output: None
+Effects: /dev/ttyS0 becomes openable
+*/
+void init_serial() {
+    outb(0x00, COM1_PORT + SERIAL_IER);            // polled, no interrupts
+    outb(SERIAL_DLAB, COM1_PORT + SERIAL_LCR);     // expose the divisor latch
+    outb(SERIAL_DIVISOR, COM1_PORT + SERIAL_DATA); // divisor low byte
+    outb(0x00, COM1_PORT + SERIAL_IER);            // divisor high byte
+    outb(SERIAL_8N1, COM1_PORT + SERIAL_LCR);      // clears DLAB too
+    outb(SERIAL_FIFO_ON, COM1_PORT + SERIAL_FCR);
+    outb(SERIAL_MCR_ON, COM1_PORT + SERIAL_MCR);
+
+    register_device((int8_t *)"/dev/ttyS0", MAJOR_TTY, MINOR_SERIAL, &serial_fops);
+}
+
+/*
+serial_open
+Functionality: nothing to set up per open
+input: filename - unused
+output: returns 0
+*/
+int32_t serial_open(const uint8_t* filename) {
+    return 0;
+}
+
+/*
+serial_close
+Functionality: nothing to tear down per close
+input: fd - unused
+output: returns 0
+*/
+int32_t serial_close(int32_t fd) {
+    return 0;
+}
+
+/*
+serial_read
+Functionality: drains the receive FIFO into buf
+input: buf - destination, nbytes - most bytes to copy
+output: number of bytes copied, 0 if nothing has arrived, -1 for bad input
+*/
+int32_t serial_read(int32_t fd, void* buf, int32_t nbytes) {
+    int32_t count = 0;
+
+    if (buf == NULL || nbytes < 0) return -1;
+
+    while (count < nbytes && (inb(COM1_PORT + SERIAL_LSR) & LSR_DATA_READY)) {
+        ((uint8_t *)buf)[count++] = inb(COM1_PORT + SERIAL_DATA);
+    }
+    return count;
+}
+
+/*
+serial_write
+Functionality: sends each byte once the transmitter has room
+input: buf - bytes to send, nbytes - number of bytes
+output: number of bytes sent, -1 for bad input
+*/
+int32_t serial_write(int32_t fd, const void* buf, int32_t nbytes) {
+    int32_t i;
+
+    if (buf == NULL || nbytes < 0) return -1;
+
+    for (i = 0; i < nbytes; i++) {
+        while (!(inb(COM1_PORT + SERIAL_LSR) & LSR_THR_EMPTY));
+        outb(((const uint8_t *)buf)[i], COM1_PORT + SERIAL_DATA);
+    }
+    return nbytes;
+}
@@ -0,0 +1,32 @@
+#ifndef SERIAL_H
+#define SERIAL_H
+
+#include "types.h"
+
+// COM1 registers, offsets from the base port
+#define COM1_PORT 0x3F8
+#define SERIAL_DATA 0 // transmit/receive buffer (divisor low when DLAB set)
+#define SERIAL_IER 1 // interrupt enable (divisor high when DLAB set)
+#define SERIAL_FCR 2 // FIFO control
+#define SERIAL_LCR 3 // line control
+#define SERIAL_MCR 4 // modem control
+#define SERIAL_LSR 5 // line status
+
+#define SERIAL_DLAB 0x80 // divisor latch access bit in LCR
+#define SERIAL_8N1 0x03 // 8 data bits, no parity, one stop bit
+#define SERIAL_FIFO_ON 0xC7 // enable and clear FIFOs, 14 byte threshold
+#define SERIAL_MCR_ON 0x03 // DTR + RTS
+#define SERIAL_DIVISOR 3 // 115200 / 3 = 38400 baud
+#define LSR_DATA_READY 0x01 // a received byte is waiting
+#define LSR_THR_EMPTY 0x20 // transmitter can take another byte
+
+// program COM1 and register it as /dev/ttyS0
+extern void init_serial();
+extern int32_t serial_open(const uint8_t* filename);
+extern int32_t serial_close(int32_t fd);
+// copy out whatever bytes have already arrived, never blocks
+extern int32_t serial_read(int32_t fd, void* buf, int32_t nbytes);
+// transmit nbytes, polling the line status between bytes
+extern int32_t serial_write(int32_t fd, const void* buf, int32_t nbytes);
+
+#endif
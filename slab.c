@@ -0,0 +1,231 @@
+#include "slab.h"
+#include "lib.h"
+#include "paging.h"
+
+static kmem_cache_t caches[MAX_KMEM_CACHES];
+static uint32_t num_caches = 0;
+static kmem_cache_t * kmalloc_caches[KMALLOC_CLASSES]; // 16, 32, ... 2048 bytes
+
+/* slab_unlink
+* Inputs: - cache : owner
+          - s : slab on its partial list
+* Outputs: none
+* Side Effects: takes s off the list in O(1)
+*/
+static void slab_unlink(kmem_cache_t * cache, slab_t * s) {
+    if (s->prev != NULL) s->prev->next = s->next;
+    else cache->partial = s->next;
+    if (s->next != NULL) s->next->prev = s->prev;
+    s->next = NULL;
+    s->prev = NULL;
+}
+
+/* slab_push
+* Inputs: - cache : owner
+          - s : slab not on any list
+* Outputs: none
+* Side Effects: s becomes the first partial slab, the next allocations come from it
+*/
+static void slab_push(kmem_cache_t * cache, slab_t * s) {
+    s->prev = NULL;
+    s->next = cache->partial;
+    if (cache->partial != NULL) cache->partial->prev = s;
+    cache->partial = s;
+}
+
+/* slab_grow
+* Inputs: - cache : cache out of free objects
+* Outputs: a slab with every object free, NULL if the frame pool is empty
+* Side Effects: reuses the cache's kept empty slab before taking a new frame, whose objects
+                are threaded onto its free list once here
+*/
+static slab_t * slab_grow(kmem_cache_t * cache) {
+    slab_t * s;
+    uint8_t * obj;
+    uint32_t i;
+
+    if (cache->empty != NULL) {
+        s = cache->empty;
+        cache->empty = NULL;
+        return s;
+    }
+
+    s = (slab_t *)alloc_frame();
+    if (s == NULL) return NULL;
+    s->cache = cache;
+    s->inuse = 0;
+    s->free = NULL;
+    // threaded backwards so the list hands objects out in address order
+    obj = (uint8_t *)s + cache->offset + (cache->per_slab - 1) * cache->size;
+    for (i = 0; i < cache->per_slab; i++, obj -= cache->size) {
+        *(void **)obj = s->free;
+        s->free = obj;
+    }
+    cache->slabs++;
+    return s;
+}
+
+/*
+init_slab:
+functionality: creates the kmalloc size classes, one cache per power of two
+input: None
+output: None
+Effects: no frames are taken until the first allocation from each cache
+*/
+void init_slab() {
+    int8_t name[KMEM_NAME_LEN];
+    uint32_t i;
+
+    memset(caches, 0, sizeof(caches));
+    num_caches = 0;
+    for (i = 0; i < KMALLOC_CLASSES; i++) {
+        strcpy(name, (int8_t *)"size-");
+        itoa(1U << (i + KMALLOC_MIN_SHIFT), name + strlen(name), 10);
+        kmalloc_caches[i] = kmem_cache_create(name, 1U << (i + KMALLOC_MIN_SHIFT), 0);
+    }
+}
+
+/* kmem_cache_create
+* Inputs: - name : shown by /proc/slabinfo, cut to KMEM_NAME_LEN - 1 characters
+          - size : bytes per object
+          - align : power of two every object starts on, 0 for SLAB_ALIGN
+* Outputs: the cache ; NULL if the table is full, align isn't a power of two, or not even
+           one object fits a slab
+* Side Effects: objects are padded to the alignment and start after the slab header, so a
+                cache aligned to a cache line never shares a line between two objects
+*/
+kmem_cache_t * kmem_cache_create(const int8_t * name, uint32_t size, uint32_t align) {
+    kmem_cache_t * cache;
+    uint32_t offset;
+
+    if (align < SLAB_ALIGN) align = SLAB_ALIGN;
+    if (name == NULL || size == 0 || num_caches == MAX_KMEM_CACHES || (align & (align - 1)) != 0) return NULL;
+    // a free object holds the next free one's address
+    if (size < sizeof(void *)) size = sizeof(void *);
+    size = (size + align - 1) & ~(align - 1);
+    offset = (sizeof(slab_t) + align - 1) & ~(align - 1);
+    if (size > SLAB_SIZE - offset) return NULL;
+
+    cache = &caches[num_caches++];
+    memset(cache, 0, sizeof(kmem_cache_t));
+    strncpy(cache->name, name, KMEM_NAME_LEN - 1);
+    cache->size = size;
+    cache->offset = offset;
+    cache->per_slab = (SLAB_SIZE - offset) / size;
+    return cache;
+}
+
+/* kmem_cache_alloc
+* Inputs: - cache : cache to allocate from
+* Outputs: a zeroed object ; NULL if the frame pool is empty
+* Side Effects: O(1): pops the first partial slab's free list, a slab that fills up leaves
+                the partial list
+*/
+void * kmem_cache_alloc(kmem_cache_t * cache) {
+    slab_t * s;
+    void * obj;
+    uint32_t flags;
+
+    if (cache == NULL) return NULL;
+    cli_and_save(flags);
+    s = cache->partial;
+    if (s == NULL) {
+        s = slab_grow(cache);
+        if (s == NULL) {
+            cache->failures++;
+            restore_flags(flags);
+            return NULL;
+        }
+        slab_push(cache, s);
+    }
+
+    obj = s->free;
+    s->free = *(void **)obj;
+    s->inuse++;
+    if (s->inuse == cache->per_slab) slab_unlink(cache, s);
+    cache->active++;
+    cache->allocs++;
+    restore_flags(flags);
+
+    memset(obj, 0, cache->size);
+    return obj;
+}
+
+/* kmem_cache_free
+* Inputs: - cache : cache obj came from
+          - obj : object from kmem_cache_alloc, NULL is ignored
+* Outputs: none
+* Side Effects: O(1): a full slab goes back on the partial list, an emptied one is kept as
+                the cache's spare or its frame returned to the pool
+*/
+void kmem_cache_free(kmem_cache_t * cache, void * obj) {
+    slab_t * s;
+    uint32_t flags;
+
+    if (cache == NULL || obj == NULL) return;
+    s = (slab_t *)((uint32_t)obj & ~(SLAB_SIZE - 1));
+    if (s->cache != cache) return;
+
+    cli_and_save(flags);
+    if (s->inuse == cache->per_slab) slab_push(cache, s);
+    *(void **)obj = s->free;
+    s->free = obj;
+    s->inuse--;
+    cache->active--;
+    cache->frees++;
+
+    if (s->inuse == 0) {
+        slab_unlink(cache, s);
+        if (cache->empty == NULL) {
+            cache->empty = s;
+        } else {
+            cache->slabs--;
+            free_frame(s);
+        }
+    }
+    restore_flags(flags);
+}
+
+/* kmalloc
+* Inputs: - size : bytes wanted
+* Outputs: zeroed memory, SLAB_ALIGN aligned ; NULL for 0 or more than SLAB_SIZE bytes, or
+           when the frame pool is empty
+* Side Effects: sizes up to 1 << KMALLOC_MAX_SHIFT come from the smallest class that fits,
+                anything bigger takes a frame of its own
+*/
+void * kmalloc(uint32_t size) {
+    uint32_t i;
+
+    if (size == 0 || size > SLAB_SIZE) return NULL;
+    if (size > (1U << KMALLOC_MAX_SHIFT)) return alloc_frame();
+
+    for (i = 0; (1U << (i + KMALLOC_MIN_SHIFT)) < size; i++);
+    return kmem_cache_alloc(kmalloc_caches[i]);
+}
+
+/* kfree
+* Inputs: - ptr : memory from kmalloc, or NULL
+* Outputs: none
+* Side Effects: a slab object never starts a frame (the header does), so a frame aligned
+                pointer is a whole-frame allocation
+*/
+void kfree(void * ptr) {
+    slab_t * s;
+
+    if (ptr == NULL) return;
+    if (((uint32_t)ptr & (SLAB_SIZE - 1)) == 0) {
+        free_frame(ptr);
+        return;
+    }
+    s = (slab_t *)((uint32_t)ptr & ~(SLAB_SIZE - 1));
+    kmem_cache_free(s->cache, ptr);
+}
+
+/* get_kmem_cache
+* Inputs: - n : index in creation order
+* Outputs: the cache, NULL past the last one
+* Side Effects: none
+*/
+kmem_cache_t * get_kmem_cache(uint32_t n) {
+    return (n < num_caches) ? &caches[n] : NULL;
+}
@@ -0,0 +1,58 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+#include "types.h"
+
+#define SLAB_SIZE 4096 // every slab is one pool frame
+#define SLAB_ALIGN 8 // objects are padded to a multiple of this unless the cache asks for more
+#define MAX_KMEM_CACHES 24 // caches that can be created, kmalloc's size classes included
+#define KMEM_NAME_LEN 16 // longest cache name, including the terminator
+#define KMALLOC_MIN_SHIFT 4 // smallest kmalloc size class, 16 bytes
+#define KMALLOC_MAX_SHIFT 11 // largest, 2KB ; bigger requests up to SLAB_SIZE get a whole frame
+#define KMALLOC_CLASSES (KMALLOC_MAX_SHIFT - KMALLOC_MIN_SHIFT + 1)
+
+struct kmem_cache;
+
+// header at the start of every slab frame, the objects follow it
+typedef struct slab {
+    struct kmem_cache * cache; // owner, so kfree finds it from the frame alone
+    struct slab * next; // partial list links, unused while the slab is full
+    struct slab * prev;
+    void * free; // first free object, each free object holds the address of the next
+    uint32_t inuse; // objects handed out
+} slab_t;
+
+typedef struct kmem_cache {
+    int8_t name[KMEM_NAME_LEN];
+    uint32_t size; // object size, padded to the cache's alignment
+    uint32_t per_slab; // objects one slab holds
+    uint32_t offset; // where the first object starts in a slab
+    slab_t * partial; // slabs with objects both free and in use, allocation takes from the first
+    slab_t * empty; // one slab kept with nothing in use, so a cache hovering around a slab
+                    // boundary doesn't take and return a frame on every call
+    // counters, read by /proc/slabinfo
+    uint32_t active; // objects in use
+    uint32_t slabs; // frames the cache holds
+    uint32_t allocs;
+    uint32_t frees;
+    uint32_t failures; // allocations that found the frame pool empty
+} kmem_cache_t;
+
+// set up the kmalloc size classes, call after init_frames
+extern void init_slab();
+// a cache of size-byte objects aligned to align (a power of two, 0 for SLAB_ALIGN) ; NULL if
+// MAX_KMEM_CACHES exist or size doesn't fit a slab
+extern kmem_cache_t * kmem_cache_create(const int8_t * name, uint32_t size, uint32_t align);
+// a zeroed object, NULL if the frame pool is empty
+extern void * kmem_cache_alloc(kmem_cache_t * cache);
+// return an object to the cache it came from
+extern void kmem_cache_free(kmem_cache_t * cache, void * obj);
+// size zeroed bytes from the smallest size class that fits, a whole frame past KMALLOC_MAX_SHIFT ;
+// NULL for 0, more than SLAB_SIZE, or an empty pool
+extern void * kmalloc(uint32_t size);
+// free memory from kmalloc, NULL is ignored
+extern void kfree(void * ptr);
+// the n-th cache created, NULL past the end
+extern kmem_cache_t * get_kmem_cache(uint32_t n);
+
+#endif
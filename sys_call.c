@@ -6,23 +6,82 @@
 #include "types.h"
 #include "x86_desc.h"
 #include "terminal.h"
+#include "device.h"
+#include "scheduling.h"
+#include "slab.h"
 
 // counting in use processes
 uint8_t num_active_blocks = 0;
 
 // will hold current process number
-uint8_t process_number;
+int32_t process_number;
+
+// jump tables every process starts with, shared by every descriptor
+// (drivers register their own with the device registry)
+const fops stdin_fops = {kb_open_syscall, kb_close_syscall, kb_read_syscall, no_fops_func};
+const fops stdout_fops = {kb_open_syscall, kb_close_syscall, no_fops_func, kb_write_syscall};
+const fops no_fops_holder = {no_fops_func, no_fops_func, no_fops_func, no_fops_func};
+
+// descriptor chunks, FDS_PER_CHUNK file_desc_t each
+static kmem_cache_t * fd_chunk_cache = NULL;
+
+// task structs, one per pid taken the first time the pid runs and kept after it halts along
+// with its kernel stack ; pids are handed out lowest first, so few are ever made
+static kmem_cache_t * task_cache = NULL;
+static pcb_t ** tasks = NULL; // num_processes entries
+static uint32_t pid_bitmap[BITMAP_WORDS(MAX_PROCESSES)]; // bit set while a process runs as the pid
+uint32_t num_processes = 0;
+
+// what the kernel runs as before the first program, so boot code and tests have descriptors
+static pcb_t boot_task __attribute__((aligned(TASK_ALIGN)));
+static char boot_args[MAX_BYTES];
+
+pcb_t * current = &boot_task;
+
+/* alloc_task
+* Functionality: finds or creates the task struct of a pid
+* Inputs: pid - slot execute claimed
+* Outputs: the task, NULL if the slab caches or the frame pool are out of frames
+* Side Effects: a new task gets its args_buf from kmalloc and its kernel stack from the frame
+*               pool, nothing is left half made
+*/
+static pcb_t * alloc_task(uint32_t pid) {
+  pcb_t * task;
+  uint32_t i;
+
+  if (tasks[pid] != NULL) return tasks[pid];
+
+  task = (pcb_t *)kmem_cache_alloc(task_cache);
+  if (task == NULL) return NULL;
+  task->args_buf = (char *)kmalloc(MAX_BYTES);
+  task->kstack = alloc_frames(STACK_FRAMES);
+  if (task->args_buf == NULL || task->kstack == NULL) {
+    kfree(task->args_buf);
+    if (task->kstack != NULL) {
+      for (i = 0; i < STACK_FRAMES; i++) free_frame((uint8_t *)task->kstack + i * FOUR_KB);
+    }
+    kmem_cache_free(task_cache, task);
+    return NULL;
+  }
+  task->esp0 = (uint32_t)task->kstack + STACK_SIZE - TSS_OFFSET;
+  tasks[pid] = task;
+  return task;
+}
 
-// global starting address location for program pages (Set with bitmask)
- uint32_t start_address = START_ADDRESS; // 8MB + 10000111 set bits
+/* unmap_page
+* Functionality: clears one entry of a process's mmap window
+* Inputs: pcb - process owning the window, i - entry
+* Outputs: None
+* Side Effects: a copied page's frame goes back to the pool and the file's hold is dropped
+*/
+static void unmap_page(pcb_t * pcb, uint32_t i) {
+  uint32_t entry = pcb->mmap_table[i];
 
-// list of possible jump tables based on file type
-fops rtc_fops = {rtc_open, rtc_close, rtc_read, rtc_write};
-fops dir_fops = {dir_open, dir_close, dir_read, dir_write};
-fops file_fops = {file_open, file_close, file_read, file_write};
-fops stdin_fops = {kb_open_syscall, kb_close_syscall, kb_read_syscall, no_fops_func};
-fops stdout_fops = {kb_open_syscall, kb_close_syscall, no_fops_func, kb_write_syscall};
-fops no_fops_holder = {no_fops_func, no_fops_func, no_fops_func, no_fops_func};
+  if (entry == 0) return;
+  if (entry & PTE_COPY) free_frame((void *)(entry & PTE_ADDR_MASK));
+  release_inode(pcb->mmap_inodes[i]);
+  pcb->mmap_table[i] = 0;
+}
 
 /* halt
 * Inputs: 8 bit value of halt status
@@ -36,32 +95,45 @@ int32_t halt(uint8_t status) {
   cli();
 
   // grab current and parent pcb blocks
-  pcb_t* curr = (pcb_t *)(STACK_START - (STACK_SIZE * (terminal[curr_terminal].curr_pid+1)));
-  pcb_t* parent =  (pcb_t *)(STACK_START - (STACK_SIZE * (curr->parent_pid+1)));
+  pcb_t* curr = get_parent_pcb(terminal[curr_terminal].curr_pid);
+  pcb_t* parent = get_parent_pcb(curr->parent_pid);
 
-  //set the currrent process to be freed
-  current_processses_running[curr->curr_pid] = FREE;
+  //set the currrent process to be freed, its task and stack wait for the next use of the pid
+  bitmap_clear(pid_bitmap, curr->curr_pid);
+  free_program_page(curr->start_address);
 
-  // for each file descriptor in the fd array of a process..
-  for (i = 0; i < MAX_FILE_OPS; i++) {
-    if(curr->fd_arr[i].file_flags != FREE) { // if the fd is in use, close it
+  // for each open file descriptor past stdin/stdout, close it
+  for (i = SIX_FOPS_BEGIN; i < MAX_FDS; i++) {
+    if (bitmap_test(curr->fd_table.fd_bitmap, i)) {
         close(i);
     }
-    // manually clear file descriptor fields
-    curr->fd_arr[i].file_inode = NULL;
-    curr->fd_arr[i].file_jumptable = no_fops_holder; // set to empty jump table
+  }
+
+  // hand back any chunks the table grew into and forget stdin/stdout
+  destroy_fd_table(curr);
 
+  // drop the mmap window, the file blocks themselves belong to the filesystem
+  if (curr->mmap_table != NULL) {
+    for (i = 0; i < MMAP_PAGES; i++) unmap_page(curr, i);
+    free_frame(curr->mmap_table);
+    free_frame(curr->mmap_inodes);
+    curr->mmap_table = NULL;
+    curr->mmap_inodes = NULL;
   }
+  set_mmap_table(parent->mmap_table);
 
-    page_dir[_128MB] = START_ADDRESS + ((curr->parent_pid) * _4MB);
+    page_dir[_128MB] = parent->start_address;
 
   // flush TLB since we have updated paging
   flush_TLB();
 
   // set tss to parent stack pointer
   tss.esp0 = curr->parent_stack_pointer; // -4 is for the tss struct and how it's stored
+  sched_stats.halts++;
+  sched_stats.context_switches++;
   terminal[curr_terminal].curr_pid = parent->curr_pid;
   terminal[curr_terminal].total_processes--;
+  current = parent;
 
   // if we are the last process, we do not want to close it, so re-run Shell
   if (curr->curr_pid == parent->curr_pid ) {//&& terminal[curr_terminal].total_processes == 0) {
@@ -98,9 +170,6 @@ int32_t execute(const uint8_t * command) {
 
   cli();
 
-  // used to determine if open fd or not
-  uint8_t proc_flag = 0;
-
   // holds potential magic characters
   uint8_t exe_buf[SYS_BUF_SIZE];
 
@@ -113,11 +182,8 @@ int32_t execute(const uint8_t * command) {
   // to be modified later
   int entry_point = 0;
 
-  file_desc_t temp_fd[MAX_FILE_OPS];
-
-  char temp_args[MAX_BYTES];
-
-  uint32_t temp_child_proc, temp_base_pointer, temp_stack_pointer, temp_address;
+  // physical 4MB page the program is loaded into
+  uint32_t image;
 
   // ensuring a good command input
   if(command == NULL){
@@ -201,91 +267,51 @@ int32_t execute(const uint8_t * command) {
   // - single 4MB page mapping 0x08000000 to either 8MB or 12MB
   // - copy program to 0x00048000 within page
 
-  // finding process number
-  proc_flag = 0;
-  for(i = 0; i < (MAX_FILE_OPS-SIX_FOPS_BEGIN); ++i) {
-      if(current_processses_running[i] == IN_USE) {
-          continue;
-      }
-      current_processses_running[i] = IN_USE;
-      process_number = i;
-      proc_flag = 1;
-      break;
-  }
+  // finding process number, the lowest pid nothing is running as
+  process_number = find_first_zero(pid_bitmap, num_processes);
 
   // no process available? return with error
-  if(proc_flag == 0){
+  if(process_number < 0){
+    return FAIL;
+  }
+
+  // the pid's task struct and kernel stack, made on its first use, and a page to load into
+  if (alloc_task(process_number) == NULL) {
+    return FAIL;
+  }
+  image = alloc_program_page();
+  if (image == 0) {
     return FAIL;
   }
+  bitmap_set(pid_bitmap, process_number);
 
   // getting current block using found process number
   pcb_t * curr_block;
   pcb_t * parent;
-  // pcb_t * temp_block;
 
-  if(terminal[curr_terminal].curr_pid > process_number && terminal[curr_terminal].total_processes > 0 ) {
+  // maintaining current and parent process numbers
+  curr_block = get_parent_pcb(process_number);
 
-      curr_block = (pcb_t *)(STACK_START - (STACK_SIZE * (terminal[curr_terminal].curr_pid+1)));
-      parent = (pcb_t *)(STACK_START - (STACK_SIZE * (process_number+1)));
-
-      current_processses_running[parent->curr_pid] = IN_USE;
-
-      temp_child_proc = process_number;
-      temp_base_pointer = parent->parent_base_pointer;
-      temp_stack_pointer = parent->parent_stack_pointer;
-      temp_address = parent->start_address;
-
-      for(i = 0; i < MAX_FILE_OPS; ++i) {
-          temp_fd[i] = parent->fd_arr[i];
-          parent->fd_arr[i] = curr_block->fd_arr[i];
-          curr_block->fd_arr[i] = temp_fd[i];
-      }
-
-      for(i = 0; i < MAX_BYTES; ++i) {
-          temp_args[i] = parent->args_buf[i];
-          parent->args_buf[i] = curr_block->args_buf[i];
-          curr_block->args_buf[i] = temp_args[i];
-      }
-
-      curr_block->parent_pid = temp_child_proc;
-
-      parent->curr_pid = temp_child_proc;
-      parent->parent_pid = parent->curr_pid;
-
-      parent->parent_base_pointer = curr_block->parent_base_pointer;
-      curr_block->parent_base_pointer = temp_base_pointer;
-
-      parent->parent_stack_pointer = curr_block->parent_stack_pointer;
-      curr_block->parent_stack_pointer = temp_stack_pointer;
-
-      parent->start_address = curr_block->start_address;
+  curr_block->curr_pid = process_number;
 
-  }
-
-  else {
-    // maintaining current and parent process numbers
-    curr_block = (pcb_t *)(STACK_START - (STACK_SIZE * (process_number+1)));
-
-    curr_block->curr_pid = process_number;
-
-    if(terminal[curr_terminal].total_processes == 0 || terminal[curr_terminal].curr_pid < 0)
-    {
-      curr_block->parent_pid = process_number;
-      parent = (pcb_t *)(STACK_START - (STACK_SIZE * (process_number+1)));
-    } else {
-      parent = get_parent_pcb(terminal[curr_terminal].curr_pid);
-      curr_block->parent_pid = parent->curr_pid;
-    }
+  if(terminal[curr_terminal].total_processes == 0 || terminal[curr_terminal].curr_pid < 0)
+  {
+    curr_block->parent_pid = process_number;
+    parent = curr_block;
+  } else {
+    parent = get_parent_pcb(terminal[curr_terminal].curr_pid);
+    curr_block->parent_pid = parent->curr_pid;
   }
 
   terminal[curr_terminal].curr_pid = curr_block->curr_pid;
+  current = curr_block;
 
   terminal[curr_terminal].total_processes++;
 
   // properly setting address of current block
-  curr_block->start_address = (terminal[curr_terminal].curr_pid * _4MB) + START_ADDRESS;
+  curr_block->start_address = image | PROGRAM_PAGE_BITS;
 
-  // Should be at 4MB offset depending on the PID
+  // the program's own 4MB page, wherever alloc_program_page found it
   page_dir[PAGE] = curr_block->start_address;
 
   // store arguments into pcb buffer
@@ -316,20 +342,19 @@ int32_t execute(const uint8_t * command) {
 
 
   // setting default fd vals and accounting for stdin and stdout, which are always indices 0,1
-  for(i = 0; i < MAX_FILE_OPS; i++){
-    curr_block->fd_arr[i].file_inode = -1;
-    curr_block->fd_arr[i].file_flags = FREE; // set rest
-    curr_block->fd_arr[i].file_pos = 0;
-    curr_block->fd_arr[i].file_jumptable = no_fops_holder;
-  }
-  curr_block->fd_arr[0].file_jumptable = stdin_fops;
-  curr_block->fd_arr[1].file_jumptable = stdout_fops;
-  curr_block->fd_arr[0].file_flags = IN_USE;
-  curr_block->fd_arr[1].file_flags = IN_USE;
+  init_fd_table(curr_block);
+
+  // a new program starts with an empty mmap window
+  curr_block->mmap_table = NULL;
+  curr_block->mmap_inodes = NULL;
+  set_mmap_table(NULL);
+
+  sched_stats.execs++;
+  sched_stats.context_switches++;
 
   // modifying tss values
   tss.ss0 = KERNEL_DS;
-  tss.esp0 = STACK_START - (STACK_SIZE * terminal[curr_terminal].curr_pid) - TSS_OFFSET;// -4 is for the tss struct and how it's stored
+  tss.esp0 = curr_block->esp0;
 
   // end of critical section
   sti();
@@ -372,12 +397,11 @@ int32_t execute(const uint8_t * command) {
 * Side Effects:
 */
 int32_t read(int32_t fd, void * buf, int32_t nbytes) {
-  pcb_t* pcb = curr_pcb();
+  file_desc_t* desc = get_fd(curr_pcb(), fd);
 
-  if (fd < 0 || fd > MAX_FILE_OPS || buf == NULL || nbytes < 1) return FAIL;    // valid buf, nbytes, fd
-  if (pcb->fd_arr[fd].file_flags == 0) return FAIL;
+  if (desc == NULL || buf == NULL || nbytes < 1) return FAIL;    // valid buf, nbytes, fd
 
-  int32_t retval = (pcb->fd_arr[fd].file_jumptable.read)(fd, buf, nbytes); // I think this is the syntax?
+  int32_t retval = (desc->file_jumptable->read)(fd, buf, nbytes);
 
   retval+=0;
 
@@ -391,11 +415,10 @@ int32_t read(int32_t fd, void * buf, int32_t nbytes) {
 * Side Effects: none
 */
 int32_t write(int32_t fd, const void * buf, int32_t nbytes) {
-  pcb_t* pcb = (pcb_t *)(STACK_START - (STACK_SIZE * (terminal[curr_terminal].curr_pid+1)));
-  if (fd < 0 || fd > MAX_FILE_OPS || buf == NULL || nbytes < 1) return FAIL;
-  if (pcb->fd_arr[fd].file_flags == 0) return FAIL;
+  file_desc_t* desc = get_fd(curr_pcb(), fd);
+  if (desc == NULL || buf == NULL || nbytes < 1) return FAIL;
   // return the write system call
-  return (pcb->fd_arr[fd].file_jumptable.write)(fd, buf, nbytes); // I think this is the syntax?
+  return (desc->file_jumptable->write)(fd, buf, nbytes);
   // return kb_write_syscall(fd, buf, nbytes);
 }
 /* open
@@ -406,66 +429,577 @@ int32_t write(int32_t fd, const void * buf, int32_t nbytes) {
 */
 int32_t open(const uint8_t * filename) {
   pcb_t* pcb = curr_pcb();
-  //file_desc_t* fd;
+  file_desc_t* desc;
   dentry_t dentry;
-
-  // find dentry
-  // if does not exist ret -1
-  int i = 0, flag = 0;
-  if(strlen((const int8_t *)filename) == 0) return FAIL;
-  if(read_dentry_by_name(filename, &dentry) == -1) return FAIL;
+  device_t* dev;
+  const filetype_ops_t* type;
+  const fops* ops;
+  int32_t i, inode;
+  uint32_t devno;
+
+  if(filename == NULL || strlen((const int8_t *)filename) == 0) return FAIL;
+
+  // absolute names may be device paths, resolved through the registry's name hash, and
+  // otherwise walk the directory tree like any other path
+  dev = (filename[0] == DEV_PATH_START) ? lookup_device(filename) : NULL;
+  if (dev != NULL) {
+    ops = dev->ops;
+    devno = dev->devno;
+    inode = -1;
+  } else {
+    // find dentry, the filetype picks whichever driver registered for it
+    if(read_dentry_by_name(filename, &dentry) == -1) return FAIL;
+    type = lookup_filetype(dentry.filetype);
+    if (type == NULL) return FAIL;
+    ops = type->ops;
+    devno = type->devno;
+    inode = (devno == 0) ? (int32_t)dentry.inode_index : -1;
+  }
 
   // allocate a file descriptor
     // if none free ret -1
-  for (i = SIX_FOPS_BEGIN; i < MAX_FILE_OPS; i++) {
-    if (pcb->fd_arr[i].file_flags == FREE) {
-      pcb->fd_arr[i].file_flags = IN_USE;
-      pcb->fd_arr[i].file_pos = 0;
-      flag = 1;
-      break;
+  i = alloc_fd(pcb);
+  if (i == FAIL) return FAIL;
+  desc = get_fd(pcb, i);
+  desc->file_jumptable = ops;
+  desc->file_inode = inode;
+  desc->file_dev = devno;
+  desc->file_type = (dev != NULL) ? DEVICE_TYPE : dentry.filetype;
+
+  if ((ops->open)(filename) != 0) {
+    // open failed after the descriptor was claimed, give it back
+    free_fd(pcb, i);
+    return FAIL;
+  }
+
+  // unlink waits until the last descriptor on a regular file is closed
+  if (desc->file_type == FILE_TYPE && inode >= 0) hold_inode(inode);
+
+  return i;
+}
+/* close
+* Functionality: closes a file
+* Inputs: a file descriptor
+* Outputs: -1 for bad fd, 0 for valid close
+* Side Effects: the last close of a regular file lets unlink remove it
+*/
+int32_t close(int32_t fd) {
+  pcb_t* pcb = curr_pcb();
+  file_desc_t* desc = get_fd(pcb, fd);
+
+  if (fd < SIX_FOPS_BEGIN || desc == NULL) return FAIL;   // valid file descriptor check
+  (desc->file_jumptable->close)(fd);
+  if (desc->file_type == FILE_TYPE && desc->file_inode >= 0) release_inode(desc->file_inode);
+  free_fd(pcb, fd); // set flag to free
+  return GOOD;
+}
+
+/* get_fd
+* Functionality: finds the descriptor struct for an open fd
+* Inputs: pcb - process owning the table, fd - descriptor number
+* Outputs: pointer to the descriptor, NULL if fd is out of range or not open
+* Side Effects: None
+*/
+file_desc_t * get_fd(pcb_t * pcb, int32_t fd) {
+  fd_table_t * table = &pcb->fd_table;
+
+  if (fd < 0 || fd >= MAX_FDS || !bitmap_test(table->fd_bitmap, fd)) return NULL;
+  if (fd < MAX_FILE_OPS) return &table->fd_arr[fd];
+
+  fd -= MAX_FILE_OPS;
+  return &table->fd_chunks[fd / FDS_PER_CHUNK][fd % FDS_PER_CHUNK];
+}
+
+/* alloc_fd
+* Functionality: claims the lowest free descriptor in O(1): the fd_full summary word
+*                picks the first bitmap word with room, bsf picks the bit inside it
+* Inputs: pcb - process owning the table
+* Outputs: new descriptor number, -1 if the table is full or no chunk can be allocated
+* Side Effects: grows the table by one FDS_PER_CHUNK chunk when the first fd in it is claimed
+*/
+int32_t alloc_fd(pcb_t * pcb) {
+  fd_table_t * table = &pcb->fd_table;
+  file_desc_t * desc;
+  uint32_t word, chunk;
+  int32_t fd;
+
+  if (table->fd_full == 0xFFFFFFFF) return FAIL;
+
+  word = first_set_bit(~table->fd_full);
+  fd = word * BITS_PER_WORD + first_set_bit(~table->fd_bitmap[word]);
+  if (fd >= MAX_FDS) return FAIL;
+
+  if (fd >= MAX_FILE_OPS) {
+    chunk = (fd - MAX_FILE_OPS) / FDS_PER_CHUNK;
+    if (table->fd_chunks[chunk] == NULL) {
+      table->fd_chunks[chunk] = (file_desc_t *)kmem_cache_alloc(fd_chunk_cache);
+      if (table->fd_chunks[chunk] == NULL) return FAIL;
     }
   }
 
-  if (!flag) return FAIL; // if none were free, return fail
-  // set up data based on file type
-  switch (dentry.filetype) {
-    case RTC_TYPE:
-      if (rtc_open(filename) != 0) return FAIL;
-      pcb->fd_arr[i].file_jumptable = rtc_fops;
-      pcb->fd_arr[i].file_inode = RTC_INODE;
-      // fd->file_pos = ;
+  bitmap_set(table->fd_bitmap, fd);
+  if (table->fd_bitmap[word] == 0xFFFFFFFF) table->fd_full |= (1U << word);
+
+  desc = get_fd(pcb, fd);
+  desc->file_jumptable = &no_fops_holder;
+  desc->file_inode = -1;
+  desc->file_pos = 0;
+  desc->file_flags = IN_USE;
+  desc->file_dev = 0;
+  desc->ra_pos = 0;
+  desc->ra_window = 0;
+  desc->ra_end = 0;
+  return fd;
+}
+
+/* free_fd
+* Functionality: releases a descriptor number back to the table
+* Inputs: pcb - process owning the table, fd - descriptor number
+* Outputs: None
+* Side Effects: clears the fd bit and its word's full bit
+*/
+void free_fd(pcb_t * pcb, int32_t fd) {
+  file_desc_t * desc = get_fd(pcb, fd);
+
+  if (desc == NULL) return;
+
+  desc->file_flags = FREE;
+  desc->file_jumptable = &no_fops_holder;
+  bitmap_clear(pcb->fd_table.fd_bitmap, fd);
+  pcb->fd_table.fd_full &= ~(1U << (fd / BITS_PER_WORD));
+}
+
+/* init_fd_table
+* Functionality: resets a process's descriptor table to just stdin and stdout
+* Inputs: pcb - process owning the table
+* Outputs: None
+* Side Effects: fds 0 and 1 are open, everything else is free, no chunks allocated
+*/
+void init_fd_table(pcb_t * pcb) {
+  uint32_t word;
+
+  memset(&pcb->fd_table, 0, sizeof(fd_table_t));
+
+  // summary bits past the last bitmap word count as full so they are never picked
+  for (word = FD_WORDS; word < BITS_PER_WORD; word++) {
+    pcb->fd_table.fd_full |= (1U << word);
+  }
+
+  alloc_fd(pcb);
+  alloc_fd(pcb);
+  pcb->fd_table.fd_arr[0].file_jumptable = &stdin_fops;
+  pcb->fd_table.fd_arr[1].file_jumptable = &stdout_fops;
+}
+
+/* destroy_fd_table
+* Functionality: frees every chunk the table grew into and marks all fds free
+* Inputs: pcb - process owning the table
+* Outputs: None
+* Side Effects: chunks go back to their slab cache
+*/
+void destroy_fd_table(pcb_t * pcb) {
+  int32_t i;
+
+  for (i = 0; i < MAX_FD_CHUNKS; i++) {
+    if (pcb->fd_table.fd_chunks[i] != NULL) kmem_cache_free(fd_chunk_cache, pcb->fd_table.fd_chunks[i]);
+  }
+  memset(&pcb->fd_table, 0, sizeof(fd_table_t));
+}
+
+/* init_tasks
+* Functionality: creates the slab caches task structs and descriptor chunks come from, and the
+*                process table
+* Inputs: max_processes - programs that can be in memory at once, capped at MAX_PROCESSES
+* Outputs: None
+* Side Effects: the boot task gets stdin/stdout ; until this runs, or if the cache table is
+*               full, execute fails and no table grows past MAX_FILE_OPS
+*/
+void init_tasks(uint32_t max_processes) {
+  fd_chunk_cache = kmem_cache_create((int8_t *)"files", FDS_PER_CHUNK * sizeof(file_desc_t), 0);
+  task_cache = kmem_cache_create((int8_t *)"task", sizeof(pcb_t), TASK_ALIGN);
+
+  num_processes = (max_processes > MAX_PROCESSES) ? MAX_PROCESSES : max_processes;
+  tasks = (pcb_t **)kmalloc(num_processes * sizeof(pcb_t *));
+  if (tasks == NULL) num_processes = 0;
+  memset(pid_bitmap, 0, sizeof(pid_bitmap));
+  memset(&boot_task, 0, sizeof(pcb_t));
+  boot_task.args_buf = boot_args;
+  init_fd_table(&boot_task);
+  current = &boot_task;
+}
+
+/* stat
+* Functionality: looks up a file by name and reports its size and type
+* Inputs: filename - path or device path, buf - stat struct to fill
+* Outputs: 0 for success, -1 if the name does not resolve
+* Side Effects: None
+*/
+int32_t stat(const uint8_t* filename, stat_t* buf) {
+  dentry_t dentry;
+  device_t* dev;
+  const filetype_ops_t* type;
+
+  if (filename == NULL || buf == NULL) return FAIL;
+
+  memset(buf, 0, sizeof(stat_t));
+
+  dev = (filename[0] == DEV_PATH_START) ? lookup_device(filename) : NULL;
+  if (dev != NULL) {
+    buf->type = DEVICE_TYPE;
+    buf->inode = -1;
+    buf->dev = dev->devno;
+    return GOOD;
+  }
+
+  if (read_dentry_by_name(filename, &dentry) == -1) return FAIL;
+  buf->type = dentry.filetype;
+
+  // dentries that stand for a device (rtc) have no inode worth reporting
+  type = lookup_filetype(dentry.filetype);
+  if (type != NULL && type->devno != 0) {
+    buf->inode = -1;
+    buf->dev = type->devno;
+    return GOOD;
+  }
+
+  return stat_file(dentry.filetype, dentry.inode_index, buf);
+}
+
+/* fstat
+* Functionality: reports size and type of an open file
+* Inputs: fd - descriptor, buf - stat struct to fill
+* Outputs: 0 for success, -1 for a bad descriptor
+* Side Effects: None
+*/
+int32_t fstat(int32_t fd, stat_t* buf) {
+  file_desc_t* desc = get_fd(curr_pcb(), fd);
+
+  if (desc == NULL || buf == NULL) return FAIL;
+
+  memset(buf, 0, sizeof(stat_t));
+  buf->type = desc->file_type;
+  buf->inode = -1;
+  buf->dev = desc->file_dev;
+
+  // the root directory has no inode (ROOT_INODE) but is still worth describing
+  if (desc->file_inode < 0 && desc->file_type != FOLDER_TYPE) return GOOD;
+  return stat_file(desc->file_type, desc->file_inode, buf);
+}
+
+/* lseek
+* Functionality: sets an open file's position
+* Inputs: fd - descriptor, offset - signed byte offset,
+*         whence - SEEK_SET (from 0), SEEK_CUR (from file_pos) or SEEK_END (from the size)
+* Outputs: the new position, -1 for a bad descriptor, whence or a negative result
+* Side Effects: file_pos of the descriptor is updated
+*/
+int32_t lseek(int32_t fd, int32_t offset, int32_t whence) {
+  file_desc_t* desc = get_fd(curr_pcb(), fd);
+  stat_t st;
+  int32_t base;
+
+  if (desc == NULL || fd < SIX_FOPS_BEGIN) return FAIL;
+
+  switch (whence) {
+    case SEEK_SET:
+      base = 0;
       break;
-    case FOLDER_TYPE:
-      // if (dir_open() != 0) return -1;
-      pcb->fd_arr[i].file_jumptable = dir_fops;
-      pcb->fd_arr[i].file_inode = -1;
+    case SEEK_CUR:
+      base = desc->file_pos;
       break;
-    case FILE_TYPE:
-      // if (file_open() != 0) return -1;
-      pcb->fd_arr[i].file_jumptable = file_fops;
-      pcb->fd_arr[i].file_inode = dentry.inode_index;
+    case SEEK_END:
+      if (fstat(fd, &st) == FAIL) return FAIL;
+      base = st.size;
       break;
     default:
       return FAIL;
   }
 
-    return i;
+  if (base + offset < 0) return FAIL;
+  desc->file_pos = base + offset;
+  return desc->file_pos;
 }
-/* close
-* Functionality: closes a file
-* Inputs: a file descriptor
-* Outputs: -1 for bad fd, 0 for valid close
+
+/* pread
+* Functionality: reads a regular file at a given offset, leaving file_pos alone
+* Inputs: fd - descriptor of a regular file, buf - destination, nbytes - most bytes to read,
+*         offset - byte offset in the file
+* Outputs: bytes read (0 at or past the end), -1 for a bad descriptor or a non-file
 * Side Effects: None
 */
-int32_t close(int32_t fd) {
+int32_t pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset) {
+  file_desc_t* desc = get_fd(curr_pcb(), fd);
+
+  if (desc == NULL || buf == NULL || nbytes < 0) return FAIL;
+  if (desc->file_type != FILE_TYPE) return FAIL;
+
+  return read_data(desc->file_inode, offset, (uint8_t *)buf, nbytes);
+}
+
+/* readv
+* Functionality: fills each segment in turn through the descriptor's read op
+* Inputs: fd - descriptor, iov - array of segments, iovcnt - number of segments
+* Outputs: total bytes read, -1 for bad arguments or if the first segment fails
+* Side Effects: stops early on a short read, so a file's position stays exact
+*/
+int32_t readv(int32_t fd, const iovec_t* iov, int32_t iovcnt) {
+  file_desc_t* desc = get_fd(curr_pcb(), fd);
+  int32_t i, ret, total = 0;
+
+  if (desc == NULL || iov == NULL || iovcnt < 0 || iovcnt > MAX_IOV) return FAIL;
+
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len == 0) continue;
+    if (iov[i].iov_base == NULL || iov[i].iov_len < 0) return (total > 0) ? total : FAIL;
+
+    ret = (desc->file_jumptable->read)(fd, iov[i].iov_base, iov[i].iov_len);
+    if (ret < 0) return (total > 0) ? total : FAIL;
+
+    total += ret;
+    if (ret < iov[i].iov_len) break;
+  }
+  return total;
+}
+
+/* writev
+* Functionality: writes each segment in turn through the descriptor's write op
+* Inputs: fd - descriptor, iov - array of segments, iovcnt - number of segments
+* Outputs: total bytes written, -1 for bad arguments or if the first segment fails
+* Side Effects: stops early on a short write
+*/
+int32_t writev(int32_t fd, const iovec_t* iov, int32_t iovcnt) {
+  file_desc_t* desc = get_fd(curr_pcb(), fd);
+  int32_t i, ret, total = 0;
+
+  if (desc == NULL || iov == NULL || iovcnt < 0 || iovcnt > MAX_IOV) return FAIL;
+
+  for (i = 0; i < iovcnt; i++) {
+    if (iov[i].iov_len == 0) continue;
+    if (iov[i].iov_base == NULL || iov[i].iov_len < 0) return (total > 0) ? total : FAIL;
+
+    ret = (desc->file_jumptable->write)(fd, iov[i].iov_base, iov[i].iov_len);
+    if (ret < 0) return (total > 0) ? total : FAIL;
+
+    total += ret;
+    if (ret < iov[i].iov_len) break;
+  }
+  return total;
+}
+
+/* mmap
+* Functionality: maps a regular file's data blocks read only into the mmap window,
+*                one 4KB page per block, so scattered blocks still appear contiguous
+* Inputs: fd - descriptor of a regular file, offset - byte offset (multiple of 4KB),
+*         length - bytes to map, clipped to the end of the file
+* Outputs: user address of the mapping, -1 for bad arguments or no room in the window
+* Side Effects: allocates the process's mmap page table on first use. A partial last page
+*               is copied into a zeroed frame so nothing past the end of the file shows.
+*               Every mapped page holds the file, so it cannot be deleted until munmap
+*/
+int32_t mmap(int32_t fd, uint32_t offset, uint32_t length) {
+  pcb_t* pcb = curr_pcb();
+  file_desc_t* desc = get_fd(pcb, fd);
+  uint32_t first_block, num_pages, start, run, i, addr, tail;
+  stat_t st;
+
+  if (desc == NULL || length == 0 || (offset % FOUR_KB) != 0) return FAIL;
+  if (desc->file_type != FILE_TYPE || fstat(fd, &st) == FAIL) return FAIL;
+  if (offset >= st.size) return FAIL;
+
+  if (length > st.size - offset) length = st.size - offset;
+  first_block = offset / FOUR_KB;
+  num_pages = (length + FOUR_KB - 1) / FOUR_KB;
+
+  if (pcb->mmap_table == NULL) {
+    pcb->mmap_table = (uint32_t *)alloc_frame();
+    if (pcb->mmap_table == NULL) return FAIL;
+    pcb->mmap_inodes = (uint32_t *)alloc_frame();
+    if (pcb->mmap_inodes == NULL) {
+      free_frame(pcb->mmap_table);
+      pcb->mmap_table = NULL;
+      return FAIL;
+    }
+    set_mmap_table(pcb->mmap_table);
+  }
+
+  // first fit: find num_pages free entries in a row
+  run = 0;
+  start = 0;
+  for (i = 0; i < MMAP_PAGES && run < num_pages; i++) {
+    if (pcb->mmap_table[i] != 0) {
+      run = 0;
+      start = i + 1;
+    } else {
+      run++;
+    }
+  }
+  if (run < num_pages) return FAIL;
+
+  // bytes of the file in its last block, 0 if the file ends on a block boundary
+  tail = st.size % FOUR_KB;
+
+  for (i = 0; i < num_pages; i++) {
+    if (tail != 0 && (first_block + i + 1) * FOUR_KB > st.size) {
+      // the rest of the image block belongs to nobody this process may see
+      addr = (uint32_t)alloc_frame();
+      if (addr != 0 &&
+          read_data(desc->file_inode, (first_block + i) * FOUR_KB, (uint8_t *)addr, tail) != (int32_t)tail) {
+        free_frame((void *)addr);
+        addr = 0;
+      }
+      if (addr != 0) addr |= PTE_COPY;
+    } else if (get_block_addr(desc->file_inode, first_block + i, &addr) == -1) {
+      addr = 0;
+    }
+
+    if (addr == 0 || hold_inode(desc->file_inode) == -1) {
+      if (addr & PTE_COPY) free_frame((void *)(addr & PTE_ADDR_MASK));
+      // undo the pages mapped so far
+      while (i-- > 0) unmap_page(pcb, start + i);
+      flush_TLB();
+      return FAIL;
+    }
+    pcb->mmap_inodes[start + i] = desc->file_inode;
+    pcb->mmap_table[start + i] = addr | USR_READ_PRES;
+  }
+
+  flush_TLB();
+  return MMAP_START + start * FOUR_KB;
+}
+
+/* munmap
+* Functionality: removes mmap'd pages from the caller's window
+* Inputs: addr - page aligned address returned by mmap, length - bytes to unmap
+* Outputs: 0 for success, -1 if the range is not inside the window
+* Side Effects: the pages fault if touched again, copied pages are freed and the files
+*               they came from can be deleted once nothing else maps them
+*/
+int32_t munmap(uint32_t addr, uint32_t length) {
   pcb_t* pcb = curr_pcb();
+  uint32_t first, num_pages, i;
 
-  if (fd < SIX_FOPS_BEGIN || fd > MAX_FILE_OPS) return FAIL;   // valid file descriptor check
-  if (pcb->fd_arr[fd].file_flags == FREE) return FAIL;
-  pcb->fd_arr[fd].file_flags = FREE; // set flag to free
+  if (pcb->mmap_table == NULL || (addr % FOUR_KB) != 0 || length == 0) return FAIL;
+  if (addr < MMAP_START) return FAIL;
+
+  first = (addr - MMAP_START) / FOUR_KB;
+  num_pages = (length + FOUR_KB - 1) / FOUR_KB;
+  if (first >= MMAP_PAGES || num_pages > MMAP_PAGES - first) return FAIL;
+
+  for (i = 0; i < num_pages; i++) {
+    unmap_page(pcb, first + i);
+  }
+
+  flush_TLB();
   return GOOD;
 }
 
+/* sendfile
+* Functionality: streams a regular file into another descriptor's write op one block at a
+*                time. Blocks resident in the module are handed to the write op in place,
+*                anything else goes through read_data into a single bounce frame
+* Inputs: out_fd - destination descriptor (console, serial, ...), in_fd - regular file,
+*         offset - byte offset to start from, or SENDFILE_USE_POS to use in_fd's file_pos,
+*         count - most bytes to send
+* Outputs: bytes sent, -1 for bad arguments or if nothing could be sent
+* Side Effects: with SENDFILE_USE_POS, in_fd's file_pos advances by the bytes sent
+*/
+int32_t sendfile(int32_t out_fd, int32_t in_fd, int32_t offset, int32_t count) {
+  pcb_t* pcb = curr_pcb();
+  file_desc_t* in = get_fd(pcb, in_fd);
+  file_desc_t* out = get_fd(pcb, out_fd);
+  uint8_t* bounce = NULL;
+  uint8_t* src;
+  uint32_t pos, addr, chunk;
+  int32_t ret, total = 0;
+  stat_t st;
+
+  if (in == NULL || out == NULL || count < 0) return FAIL;
+  if (in->file_type != FILE_TYPE || fstat(in_fd, &st) == FAIL) return FAIL;
+  if (offset < 0 && offset != SENDFILE_USE_POS) return FAIL;
+
+  pos = (offset == SENDFILE_USE_POS) ? in->file_pos : (uint32_t)offset;
+  if (pos >= st.size) return 0;
+  if (count > st.size - pos) count = st.size - pos;
+
+  while (total < count) {
+    // never cross a block boundary so each chunk is one contiguous piece of the image
+    chunk = FOUR_KB - (pos % FOUR_KB);
+    if (chunk > count - total) chunk = count - total;
+
+    if (get_block_addr(in->file_inode, pos / FOUR_KB, &addr) == 0) {
+      src = (uint8_t *)addr + (pos % FOUR_KB);
+    } else {
+      if (bounce == NULL && (bounce = (uint8_t *)alloc_frame()) == NULL) break;
+      ret = read_data(in->file_inode, pos, bounce, chunk);
+      if (ret <= 0) break;
+      chunk = ret;
+      src = bounce;
+    }
+
+    ret = (out->file_jumptable->write)(out_fd, src, chunk);
+    if (ret <= 0) break;
+
+    total += ret;
+    pos += ret;
+    if (ret < chunk) break;
+  }
+
+  if (bounce != NULL) free_frame(bounce);
+  if (offset == SENDFILE_USE_POS) in->file_pos = pos;
+  return (total > 0 || count == 0) ? total : FAIL;
+}
+
+/* create
+* Functionality: adds an empty regular file to the filesystem
+* Inputs: filename - name of the new file
+* Outputs: 0 for success, -1 if the name is taken or the filesystem is full
+* Side Effects: the file can be opened and written right away
+*/
+int32_t create(const uint8_t* filename) {
+  if (filename == NULL || filename[0] == DEV_PATH_START) return FAIL;
+  return create_file(filename);
+}
+
+/* unlink
+* Functionality: removes a regular file from the filesystem
+* Inputs: filename - name of the file
+* Outputs: 0 for success, -1 if there is no such regular file or it is still open or mapped
+* Side Effects: its blocks and inode become free for new files
+*/
+int32_t unlink(const uint8_t* filename) {
+  if (filename == NULL || filename[0] == DEV_PATH_START) return FAIL;
+  return delete_file(filename);
+}
+
+/* getdents
+* Functionality: lists a directory in bulk
+* Inputs: fd - open directory, buf - buffer for dirent_t records, nbytes - size of buf
+* Outputs: bytes of records written, 0 at the end of the directory, -1 for a bad descriptor,
+*          a non-directory, or a buffer too small for the next record
+* Side Effects: the descriptor's file_pos counts dentries and moves past the ones returned
+*/
+int32_t getdents(int32_t fd, void* buf, int32_t nbytes) {
+  file_desc_t* desc = get_fd(curr_pcb(), fd);
+
+  if (desc == NULL || buf == NULL || nbytes < 0) return FAIL;
+  if (desc->file_type != FOLDER_TYPE) return FAIL;
+
+  return dir_getdents((uint32_t)desc->file_inode, &desc->file_pos, buf, nbytes);
+}
+
+/* fsync
+* Functionality: durability point for a file written through the buffer cache
+* Inputs: fd - open regular file
+* Outputs: 0 once its data is on the device, -1 for a bad descriptor, a non-file, or a failed write
+* Side Effects: sleeps while the dirty blocks of the file's layer are written back
+*/
+int32_t fsync(int32_t fd) {
+  file_desc_t* desc = get_fd(curr_pcb(), fd);
+
+  if (desc == NULL || desc->file_type != FILE_TYPE) return FAIL;
+  return sync_file((uint32_t)desc->file_inode);
+}
+
 /* no_fops_func
 * Functionality: Returns -1 always. Not done yet.
 * Inputs: None
@@ -502,29 +1036,30 @@ int32_t sigreturn(void) {
 * Functionality: Helper function to get the current pcb
 * Inputs: None
 * Outputs: returns a pcb_t pointer to the current pcb
-* Side Effects: As stated returns a pointer to the current pcb
+* Side Effects: None, execute, halt and switch_process keep current up to date
 */
 pcb_t *curr_pcb(void) {
-  pcb_t *curr;
-  asm volatile(
-                "andl %%esp, %%eax;"
-                :"=a"(curr)
-                :"a"(PCB_MASK)
-                :"cc"
-              );
-
-  return curr;
+  return current;
 }
 
 /* get_parent_pcb
 * Functionality: Helper function to get the parent pcb
 * Inputs: uint32_t parent_pid, holds the parent processor identifier - part of the pcb struct
-* Outputs: the desired parent pcb
+* Outputs: the desired parent pcb, NULL for a pid that never ran
 * Side Effects: As stated, parent pcb is found and returned as a pcb_t pointer
 */
 pcb_t * get_parent_pcb(uint32_t parent_pid) {
-  pcb_t * ret = (pcb_t *)(STACK_START - (parent_pid + 1) * STACK_SIZE);      //calculate
-  return ret;
+  return (parent_pid < num_processes) ? tasks[parent_pid] : NULL;
+}
+
+/* pid_in_use
+* Functionality: checks the pid bitmap
+* Inputs: pid - process identifier
+* Outputs: 1 if a running process has the pid, 0 if not or out of range
+* Side Effects: None
+*/
+int32_t pid_in_use(uint32_t pid) {
+  return (pid < num_processes) ? bitmap_test(pid_bitmap, pid) : 0;
 }
 /*
 vidmap:
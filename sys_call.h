@@ -1,19 +1,22 @@
+#ifndef SYS_CALL_H
+#define SYS_CALL_H
+
 #include "filesystem.h"
 #include "paging.h"
 
 // constants used
-#define MAX_FILE_OPS 8
+#define MAX_FILE_OPS 8 // file descriptors held inline in the pcb
+#define MAX_FDS 1024 // hard cap on open files per process
+#define FD_WORDS BITMAP_WORDS(MAX_FDS) // words in the fd bitmap (<= 32 for the summary word)
 #define JUMP_TABLE 4
-#define NUM_PROCESSES 6
+#define MAX_PROCESSES 256 // process table cap, the kernel stacks of a full table take half the frame pool
 #define SYS_CALL_VEC 0x80
 #define FREE 0
 #define IN_USE 1
 #define WRITE_INDEX 3
 #define READ_INDEX 2
 #define SIX_FOPS_BEGIN 2
-#define PCB_MASK 0xFFFFE000
 #define BIG_NUMBER 100000
-#define START_ADDRESS 0x800087
 #define _128MB 32
 #define _4MB 0x400000
 #define _136MB 0x8800000
@@ -21,8 +24,8 @@
 #define __128MB 0x8000000
 #define EIGHT_MB 0x800000
 #define STACK_SIZE 0x2000
+#define STACK_FRAMES (STACK_SIZE / FOUR_KB) // frame pool frames per kernel stack
 #define VIRTUAL_ADDR 0x8048000
-#define STACK_START 0x7FE000
 #define BYTE_ZERO 0x7f
 #define BYTE_ONE 0x45
 #define BYTE_TWO 0x4c
@@ -36,13 +39,14 @@
 #define GOOD 0
 #define IF_FLAG 0x200
 #define ESP_USER 0x83FFFFC
-#define RTC_INODE -2
+#define DEV_PATH_START '/' // names starting here are tried in the device registry before the directory tree
 #define PHYS_ADDR 0xB8000
 #define MAX_BYTES 1025
+#define TASK_ALIGN 64 // task structs start on a cache line, the hot fields fill the first one
+#define MAX_IOV 16 // most segments one readv/writev call accepts
+#define SENDFILE_USE_POS -1 // sendfile offset meaning "use and advance in_fd's file_pos"
 
 
-uint8_t current_processses_running[6];
-
 typedef struct {
      int32_t (*open)(const uint8_t* filename); // open function pointer
      int32_t (*close)(int32_t fd); // close function pointer
@@ -51,25 +55,61 @@ typedef struct {
 } fops;
 
 typedef struct {
-    fops file_jumptable; // array jumptable for open, read, write, and close
+    const fops * file_jumptable; // shared jumptable for open, read, write, and close
     int32_t file_inode; //index of the inode
     uint32_t file_pos; //position of file
     uint32_t file_flags; //flags of file
+    uint16_t file_dev; // device number for driver-backed files, 0 for regular files
+    uint16_t file_type; // filetype the descriptor was opened as, reported by fstat
+    uint32_t ra_pos; // file_pos a sequential read would start at
+    uint32_t ra_window; // blocks kept read ahead of the reader, 0 while reads look random
+    uint32_t ra_end; // file block readahead has been started up to
 } file_desc_t;
 
+// one segment of a scatter/gather transfer
+typedef struct {
+    void * iov_base; // start of the segment
+    int32_t iov_len; // bytes in the segment
+} iovec_t;
+
+// descriptors past the inline ones live in chunks from the "files" slab cache
+#define FDS_PER_CHUNK 16 // descriptors one chunk holds, 576 bytes
+#define MAX_FD_CHUNKS ((MAX_FDS - MAX_FILE_OPS + FDS_PER_CHUNK - 1) / FDS_PER_CHUNK)
+
 typedef struct {
-    file_desc_t fd_arr[MAX_FILE_OPS]; // array holding the 8 file descriptors
+    file_desc_t fd_arr[MAX_FILE_OPS]; // first 8 descriptors, always present (stdin/stdout live here)
+    file_desc_t * fd_chunks[MAX_FD_CHUNKS]; // chunks holding descriptors 8 and up, allocated on demand
+    uint32_t fd_bitmap[FD_WORDS]; // bit set when the descriptor is open
+    uint32_t fd_full; // bit set when the matching fd_bitmap word is full
+} fd_table_t;
+
+// process state, allocated from the "task" slab cache rather than kept at the bottom of the
+// kernel stack ; what every switch, halt and system call touches comes first
+typedef struct {
+    // hot, one cache line
     uint32_t curr_pid; // holds current process identifier
     uint32_t parent_pid; // holds parent process identifier
-    uint32_t parent_base_pointer; // stores base pointer
-    uint32_t parent_stack_pointer; // stores stack pointer
-    uint32_t stack_pointer;
+    uint32_t esp0; // top of the kernel stack, what the TSS points at while the process runs
+    uint32_t stack_pointer; // kernel esp/ebp saved by switch_process
     uint32_t base_pointer;
-    uint32_t start_address;
-    char args_buf[1025];
+    uint32_t parent_stack_pointer; // execute's esp/ebp, halt returns through them
+    uint32_t parent_base_pointer;
+    uint32_t start_address; // page directory entry of the program's 4MB page
+    uint32_t * mmap_table; // page table behind the mmap window, NULL until the first mmap
     int is_base;
+    // descriptor table, several hundred bytes starting right after the hot line
+    fd_table_t fd_table; // growable table of open file descriptors
+    // cold
+    char * args_buf; // MAX_BYTES from kmalloc, only read by getargs and /proc/ps
+    uint32_t * mmap_inodes; // file behind each mmap_table entry, held until the page is unmapped
+    void * kstack; // STACK_FRAMES contiguous frames from the frame pool
 } pcb_t;
 
+// the running process, what curr_pcb returns ; the boot task until the first execute
+extern pcb_t * current;
+// size of the process table, set by init_tasks from the memory programs can be loaded into
+extern uint32_t num_processes;
+
 // halt the current process
 extern int32_t halt(uint8_t status);
 // execute a given command
@@ -86,13 +126,56 @@ extern int32_t close(int32_t fd);
 extern int32_t no_fops_func();
 // get the current pcb struct pointer
 extern pcb_t * curr_pcb(void);
-// get the parent pcb struct
+// look up an open file descriptor, NULL if fd is out of range or closed
+extern file_desc_t * get_fd(pcb_t * pcb, int32_t fd);
+// claim the lowest free descriptor number, -1 if the table is full
+extern int32_t alloc_fd(pcb_t * pcb);
+// release a descriptor number claimed by alloc_fd
+extern void free_fd(pcb_t * pcb, int32_t fd);
+// empty a descriptor table and install stdin/stdout
+extern void init_fd_table(pcb_t * pcb);
+// give back every chunk a descriptor table grew into
+extern void destroy_fd_table(pcb_t * pcb);
+// create the task and descriptor chunk slab caches, the boot task and a process table of
+// max_processes, call after init_slab
+extern void init_tasks(uint32_t max_processes);
+// the task struct of a pid, NULL if it was never used
 extern pcb_t * get_parent_pcb(uint32_t parent_pid);
+// 1 if a running process has the pid, 0 if not
+extern int32_t pid_in_use(uint32_t pid);
 // maps the texs mode video memory into user space
 extern int32_t vidmap (uint8_t** screen_start);
 // gets args from shell
 extern int32_t getargs(uint8_t* buf, int32_t nbytes);
+// size, type, inode and block count of a named file
+extern int32_t stat(const uint8_t* filename, stat_t* buf);
+// size, type, inode and block count of an open file
+extern int32_t fstat(int32_t fd, stat_t* buf);
+// move an open file's position, returns the new position
+extern int32_t lseek(int32_t fd, int32_t offset, int32_t whence);
+// read from a file at an explicit offset without moving file_pos
+extern int32_t pread(int32_t fd, void* buf, int32_t nbytes, uint32_t offset);
+// read into several buffers in one call
+extern int32_t readv(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+// write several buffers in one call
+extern int32_t writev(int32_t fd, const iovec_t* iov, int32_t iovcnt);
+// map a file's blocks read only into the caller, returns the user address
+extern int32_t mmap(int32_t fd, uint32_t offset, uint32_t length);
+// drop mappings made by mmap
+extern int32_t munmap(uint32_t addr, uint32_t length);
+// copy a file to another descriptor inside the kernel
+extern int32_t sendfile(int32_t out_fd, int32_t in_fd, int32_t offset, int32_t count);
+// make a new, empty regular file
+extern int32_t create(const uint8_t* filename);
+// remove a regular file
+extern int32_t unlink(const uint8_t* filename);
+// list a directory, as many records per call as the buffer holds
+extern int32_t getdents(int32_t fd, void* buf, int32_t nbytes);
+// wait until a file's written data is on its device
+extern int32_t fsync(int32_t fd);
 // extra credit - not implemented, just a placeholder
 extern int32_t set_handler(int32_t signum, void * handler_address);
 // extra credit - not implemented, just a placeholder
 extern int32_t sigreturn(void);
+
+#endif
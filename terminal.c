@@ -23,11 +23,6 @@ void init_terminals() {
   char t_kb_prev_buf[3][KB_BUF_SIZE] = { {NULL}, {NULL}, {NULL} };
   int t_kb_prev_buf_index[3] = { KB_EMPTY, KB_EMPTY, KB_EMPTY };
 
-  int o; // I used o because I hate myself
-  for (o = 0; o < NUM_PROCESSES; o++) {
-    current_processses_running[o] = FREE; // set all current processes to free
-  }
-
   // set all the data per terminal
   for (i = 0; i < NUM_TERMS; i++) {
     memcpy(terminal[i].kb_buf, t_kb_buf, KB_BUF_SIZE);
@@ -4,7 +4,6 @@
 #define KB_BUF_SIZE 128 // size of kb_buf
 #define VIDEO       0xB8000
 #define KB_EMPTY 7
-#define NUM_PROCESSES 6
 #define NUM_TERMS 3
 #define _4KB 4096
 #define VISTED 1
@@ -6,6 +6,12 @@
 #include "kb.h"
 #include "filesystem.h"
 #include "sys_call.h"
+#include "block.h"
+#include "bcache.h"
+#include "journal.h"
+#include "slab.h"
+#include "lz4.h"
+#include "ramdisk.h"
 
 #define PASS 0
 #define FAIL -1
@@ -264,6 +270,38 @@ int rtc_write_test()	{
 	return PASS;
 }
 
+/* RTC rate test
+ *
+ * The chip keeps ticking after a program turns its interrupts off, and a program's rate is
+ * counted down from the fixed one
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: leaves the program rate at 2Hz, as rtc_open sets it
+ * Coverage: rtc_write, rtc_read, rtc_ticks
+ * Files: rtc.c/h
+ */
+int rtc_rate_test() {
+	TEST_HEADER;
+	uint32_t freq = freq_0;
+	uint32_t start, spins;
+	int result = PASS;
+
+	if (rtc_write(0, &freq, max_rtc_bytes) != 0) return FAIL;
+	start = rtc_ticks;
+	for (spins = 0; rtc_ticks - start < RTC_TEST_TICKS && spins < RTC_TEST_SPINS; spins++);
+	if (rtc_ticks - start < RTC_TEST_TICKS) result = FAIL;
+
+	freq = freq_2;
+	if (rtc_write(0, &freq, max_rtc_bytes) != 0) return FAIL;
+	start = rtc_ticks;
+	rtc_read(0, NULL, 0);
+	if (rtc_ticks - start < RTC_BASE_FREQ / freq_2) result = FAIL;
+
+	freq = freq_2 + 1;
+	if (rtc_write(0, &freq, max_rtc_bytes) != -1) result = FAIL;
+	return result;
+}
+
 /* Fileystem init test
  *
  * Simple test to ensure filesystem was initialized by making sure dentry array is not NULL
@@ -720,8 +758,8 @@ int file_desc_flags_test() {
 	const uint8_t * command_1 = (uint8_t*)"hello";
 
 	// get number of fd in use
-	for (i = 0; i < MAX_FILE_OPS; i++) {
-		if (curr->fd_arr[i].file_flags > 0) orig++;
+	for (i = 0; i < MAX_FDS; i++) {
+		if (get_fd(curr, i) != NULL) orig++;
 	}
 	printf("Original: %d\n", orig);
 
@@ -730,8 +768,8 @@ int file_desc_flags_test() {
 	// if (curr->fd_arr[num_fd].file_flags != IN_USE) return FAIL; // check that new fd allocated
 
 	// get number of fd in use after open
-	for (i = 0; i < MAX_FILE_OPS; i++) {
-		if (curr->fd_arr[i].file_flags > 0) num_fd++;
+	for (i = 0; i < MAX_FDS; i++) {
+		if (get_fd(curr, i) != NULL) num_fd++;
 	}
 
 	printf("After open: %d\n", num_fd);
@@ -743,8 +781,8 @@ int file_desc_flags_test() {
 	num_fd = 0;
 
 	// get number of fd in use after open
-	for (i = 0; i < MAX_FILE_OPS; i++) {
-		if (curr->fd_arr[i].file_flags > 0) num_fd++;
+	for (i = 0; i < MAX_FDS; i++) {
+		if (get_fd(curr, i) != NULL) num_fd++;
 	}
 
 	printf("After close: %d\n", num_fd);
@@ -793,6 +831,1351 @@ int test_ls() {
 /* Checkpoint 4 tests */
 /* Checkpoint 5 tests */
 
+/* Many Open Files Test
+ *
+ * Opens more files than the 8 inline descriptors so the table has to grow
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: allocates and frees one fd chunk from the "files" slab cache
+ * Coverage: alloc_fd, get_fd, free_fd
+ * Files: sys_call.c, slab.c
+ */
+int many_open_files_test() {
+	TEST_HEADER;
+	int32_t fds[MANY_FDS];
+	int i, result = PASS;
+
+	for (i = 0; i < MANY_FDS; i++) {
+		fds[i] = open((uint8_t *)"frame0.txt");
+		if (fds[i] < 0) return FAIL;
+	}
+
+	// descriptors are handed out lowest first, so the last one is past the inline array
+	if (fds[MANY_FDS - 1] < MAX_FILE_OPS) result = FAIL;
+
+	for (i = 0; i < MANY_FDS; i++) {
+		if (close(fds[i]) != 0) result = FAIL;
+	}
+
+	// a closed descriptor is reused before the table grows any further
+	fds[0] = open((uint8_t *)"frame0.txt");
+	if (fds[0] != SIX_FOPS_BEGIN) result = FAIL;
+	close(fds[0]);
+
+	return result;
+}
+
+/* Device Registry Test
+ *
+ * Opens /dev/null and /dev/zero by name and checks their read/write semantics
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: lookup_device, open of device paths
+ * Files: device.c, sys_call.c
+ */
+int device_registry_test() {
+	TEST_HEADER;
+	uint8_t buf[DEV_TEST_SIZE];
+	int32_t fd, i, result = PASS;
+
+	if (open((uint8_t *)"/dev/nothing") != -1) return FAIL;
+
+	fd = open((uint8_t *)"/dev/null");
+	if (fd < 0) return FAIL;
+	if (write(fd, buf, DEV_TEST_SIZE) != DEV_TEST_SIZE) result = FAIL;
+	if (read(fd, buf, DEV_TEST_SIZE) != 0) result = FAIL;
+	close(fd);
+
+	fd = open((uint8_t *)"/dev/zero");
+	if (fd < 0) return FAIL;
+	memset(buf, 1, DEV_TEST_SIZE);
+	if (read(fd, buf, DEV_TEST_SIZE) != DEV_TEST_SIZE) result = FAIL;
+	for (i = 0; i < DEV_TEST_SIZE; i++) {
+		if (buf[i] != 0) result = FAIL;
+	}
+	close(fd);
+
+	return result;
+}
+
+/* proc_counter
+ *
+ * Finds a "name value" line in a /proc report
+ * Inputs: buf - report text, len - bytes in it, name - counter to look for
+ * Outputs: the value, -1 if the line isn't there
+ */
+static int32_t proc_counter(const uint8_t * buf, int32_t len, const int8_t * name) {
+	int32_t pos, value, n = strlen(name);
+
+	for (pos = 0; pos + n < len; pos++) {
+		if ((pos == 0 || buf[pos - 1] == '\n') && strncmp((int8_t *)buf + pos, name, n) == 0 && buf[pos + n] == ' ') {
+			for (pos += n + 1, value = 0; pos < len && buf[pos] >= '0' && buf[pos] <= '9'; pos++) {
+				value = value * 10 + (buf[pos] - '0');
+			}
+			return value;
+		}
+	}
+	return -1;
+}
+
+/* procfs_test
+ *
+ * Reads /proc/meminfo through open/read, in one read and in small pieces, and checks its
+ * frame counter follows an allocation
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None, the frame taken is given back
+ * Coverage: /proc files through the device registry, proc_read positions, counters
+ * Files: procfs.c/h, sys_call.c, paging.c
+ */
+int procfs_test() {
+	TEST_HEADER;
+	uint8_t buf[PROC_TEST_SIZE];
+	uint8_t pieces[PROC_TEST_SIZE];
+	int32_t fd, len, got, ret, used, result = PASS;
+	void * frame;
+
+	fd = open((uint8_t *)"/proc/meminfo");
+	if (fd < 0) return FAIL;
+	len = read(fd, buf, PROC_TEST_SIZE);
+	if (len <= 0 || len == PROC_TEST_SIZE) return FAIL;
+	if (read(fd, buf, PROC_TEST_SIZE) != 0) result = FAIL;
+	if (write(fd, buf, len) != -1) result = FAIL;
+	close(fd);
+
+	used = proc_counter(buf, len, "frames_used");
+	if (used != (int32_t)frames_in_use()) result = FAIL;
+	if (proc_counter(buf, len, "frames_total") != NUM_FRAMES) result = FAIL;
+
+	// the report comes out the same in small reads, each picking up where the last stopped
+	frame = alloc_frame();
+	if (frame == NULL) return FAIL;
+	fd = open((uint8_t *)"/proc/meminfo");
+	if (fd < 0) return FAIL;
+	for (got = 0; (ret = read(fd, pieces + got, PROC_TEST_CHUNK)) > 0; got += ret);
+	close(fd);
+	free_frame(frame);
+
+	if (got <= 0) result = FAIL;
+	if (proc_counter(pieces, got, "frames_used") != used + 1) result = FAIL;
+	if (proc_counter(pieces, got, "frames_free") != NUM_FRAMES - used - 1) result = FAIL;
+
+	return result;
+}
+
+/* Stat Test
+ *
+ * Checks stat/fstat report frame0.txt's size and that lseek moves the read position
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: stat, fstat, lseek
+ * Files: sys_call.c, filesystem.c
+ */
+int stat_test() {
+	TEST_HEADER;
+	stat_t st;
+	uint8_t buf[FRAME0_SIZE];
+	int32_t fd, result = PASS;
+
+	if (stat((uint8_t *)"frame0.txt", &st) != 0) return FAIL;
+	if (st.size != FRAME0_SIZE || st.type != FILE_TYPE || st.blocks != 1) return FAIL;
+
+	fd = open((uint8_t *)"frame0.txt");
+	if (fd < 0) return FAIL;
+	if (fstat(fd, &st) != 0 || st.size != FRAME0_SIZE) result = FAIL;
+
+	// one read sized from fstat gets the whole file
+	if (read(fd, buf, st.size) != FRAME0_SIZE) result = FAIL;
+	if (read(fd, buf, st.size) != 0) result = FAIL;
+
+	// rewind from the end and read the last ten bytes again
+	if (lseek(fd, -FRAME0_INDEX, SEEK_END) != FRAME0_SIZE - FRAME0_INDEX) result = FAIL;
+	if (read(fd, buf, FRAME0_SIZE) != FRAME0_INDEX) result = FAIL;
+	if (lseek(fd, -1, SEEK_SET) != -1) result = FAIL;
+	close(fd);
+
+	return result;
+}
+
+/* vector_io_test
+ *
+ * Reads frame0.txt with pread at several offsets and with readv across uneven segments,
+ * checks pread leaves file_pos alone, that bad vectors are refused, and that writev lands
+ * its segments back to back in a new file
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None, the file written is unlinked
+ * Coverage: pread, readv, writev
+ * Files: sys_call.c/h, filesystem.c
+ */
+int vector_io_test() {
+	TEST_HEADER;
+	uint8_t ref[FRAME0_SIZE];
+	uint8_t buf[FRAME0_SIZE];
+	uint8_t head[FRAME0_INDEX];
+	iovec_t iov[MAX_IOV + 1];
+	int32_t fd, dev, result = PASS;
+
+	fd = open((uint8_t *)"frame0.txt");
+	if (fd < 0) return FAIL;
+	if (pread(fd, ref, FRAME0_SIZE, 0) != FRAME0_SIZE) return FAIL;
+
+	// pread at an offset, at the end and past it, none of which moves file_pos
+	if (pread(fd, buf, FRAME0_SIZE, FRAME0_INDEX) != FRAME0_SIZE - FRAME0_INDEX) result = FAIL;
+	if (strncmp((int8_t *)buf, (int8_t *)ref + FRAME0_INDEX, FRAME0_SIZE - FRAME0_INDEX) != 0) result = FAIL;
+	if (pread(fd, buf, FRAME0_SIZE, FRAME0_SIZE) != 0) result = FAIL;
+	if (pread(fd, buf, FRAME0_SIZE, FRAME0_SIZE + FRAME0_INDEX) != 0) result = FAIL;
+	if (pread(fd, NULL, FRAME0_SIZE, 0) != -1 || pread(fd, buf, -1, 0) != -1) result = FAIL;
+	if (read(fd, head, FRAME0_INDEX) != FRAME0_INDEX) result = FAIL;
+	if (strncmp((int8_t *)head, (int8_t *)ref, FRAME0_INDEX) != 0) result = FAIL;
+
+	// pread only works on regular files
+	dev = open((uint8_t *)"/dev/zero");
+	if (dev < 0 || pread(dev, buf, FRAME0_SIZE, 0) != -1) result = FAIL;
+	close(dev);
+
+	// readv: an empty segment is skipped and the short last one ends the call
+	lseek(fd, 0, SEEK_SET);
+	iov[0].iov_base = head;
+	iov[0].iov_len = FRAME0_INDEX;
+	iov[1].iov_base = NULL;
+	iov[1].iov_len = 0;
+	iov[2].iov_base = buf;
+	iov[2].iov_len = FRAME0_SIZE;
+	if (readv(fd, iov, 3) != FRAME0_SIZE) result = FAIL;
+	if (strncmp((int8_t *)head, (int8_t *)ref, FRAME0_INDEX) != 0) result = FAIL;
+	if (strncmp((int8_t *)buf, (int8_t *)ref + FRAME0_INDEX, FRAME0_SIZE - FRAME0_INDEX) != 0) result = FAIL;
+	if (readv(fd, iov, 3) != 0) result = FAIL;
+
+	// bad vectors fail outright, a bad segment after a good one ends the call early
+	if (readv(fd, NULL, 1) != -1 || readv(fd, iov, -1) != -1 || readv(fd, iov, MAX_IOV + 1) != -1) result = FAIL;
+	lseek(fd, 0, SEEK_SET);
+	iov[1].iov_len = FRAME0_INDEX;
+	if (readv(fd, iov + 1, 1) != -1) result = FAIL;
+	if (readv(fd, iov, 2) != FRAME0_INDEX) result = FAIL;
+	iov[1].iov_base = buf;
+	iov[1].iov_len = -1;
+	if (readv(fd, iov + 1, 1) != -1) result = FAIL;
+	close(fd);
+
+	// writev puts the segments back to back
+	if (create((uint8_t *)"iovfile") != 0) return FAIL;
+	fd = open((uint8_t *)"iovfile");
+	if (fd < 0) return FAIL;
+	iov[0].iov_base = ref;
+	iov[0].iov_len = FRAME0_INDEX;
+	iov[1].iov_base = ref + FRAME0_INDEX;
+	iov[1].iov_len = FRAME0_SIZE - FRAME0_INDEX;
+	if (writev(fd, iov, 2) != FRAME0_SIZE) result = FAIL;
+	if (pread(fd, buf, FRAME0_SIZE, 0) != FRAME0_SIZE) result = FAIL;
+	if (strncmp((int8_t *)buf, (int8_t *)ref, FRAME0_SIZE) != 0) result = FAIL;
+	close(fd);
+	if (unlink((uint8_t *)"iovfile") != 0) result = FAIL;
+
+	return result;
+}
+
+/* sendfile_test
+ *
+ * Sends frame0.txt into a new file from an offset, from in_fd's file_pos and past the end
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: creates and unlinks a file
+ * Coverage: sendfile, SENDFILE_USE_POS
+ * Files: sys_call.c/h
+ */
+int sendfile_test() {
+	TEST_HEADER;
+	uint8_t ref[FRAME0_SIZE];
+	uint8_t buf[FRAME0_SIZE];
+	int32_t in, out, dev, result = PASS;
+
+	in = open((uint8_t *)"frame0.txt");
+	if (in < 0) return FAIL;
+	if (read(in, ref, FRAME0_SIZE) != FRAME0_SIZE) return FAIL;
+	lseek(in, 0, SEEK_SET);
+
+	if (create((uint8_t *)"sendfile") != 0) return FAIL;
+	out = open((uint8_t *)"sendfile");
+	if (out < 0) return FAIL;
+
+	// an explicit offset: count is clipped at the end of the file, file_pos stays put
+	if (sendfile(out, in, FRAME0_INDEX, FRAME0_SIZE) != FRAME0_SIZE - FRAME0_INDEX) result = FAIL;
+	if (pread(out, buf, FRAME0_SIZE, 0) != FRAME0_SIZE - FRAME0_INDEX) result = FAIL;
+	if (strncmp((int8_t *)buf, (int8_t *)ref + FRAME0_INDEX, FRAME0_SIZE - FRAME0_INDEX) != 0) result = FAIL;
+	if (read(in, buf, FRAME0_INDEX) != FRAME0_INDEX) result = FAIL;
+	if (strncmp((int8_t *)buf, (int8_t *)ref, FRAME0_INDEX) != 0) result = FAIL;
+
+	// SENDFILE_USE_POS starts at file_pos and moves it past the bytes sent
+	if (sendfile(out, in, SENDFILE_USE_POS, FRAME0_INDEX) != FRAME0_INDEX) result = FAIL;
+	if (read(in, buf, FRAME0_INDEX) != FRAME0_INDEX) result = FAIL;
+	if (strncmp((int8_t *)buf, (int8_t *)ref + 2 * FRAME0_INDEX, FRAME0_INDEX) != 0) result = FAIL;
+	if (pread(out, buf, FRAME0_INDEX, FRAME0_SIZE - FRAME0_INDEX) != FRAME0_INDEX) result = FAIL;
+	if (strncmp((int8_t *)buf, (int8_t *)ref + FRAME0_INDEX, FRAME0_INDEX) != 0) result = FAIL;
+
+	// clipped to what is left after file_pos, then nothing at the end
+	if (sendfile(out, in, SENDFILE_USE_POS, FRAME0_SIZE) != FRAME0_SIZE - 3 * FRAME0_INDEX) result = FAIL;
+	if (sendfile(out, in, SENDFILE_USE_POS, FRAME0_SIZE) != 0) result = FAIL;
+	if (read(in, buf, FRAME0_SIZE) != 0) result = FAIL;
+	if (sendfile(out, in, FRAME0_SIZE, FRAME0_SIZE) != 0) result = FAIL;
+
+	// bad arguments, and the input has to be a regular file
+	if (sendfile(out, in, -2, FRAME0_SIZE) != -1 || sendfile(out, in, 0, -1) != -1) result = FAIL;
+	if (sendfile(out, -1, 0, FRAME0_SIZE) != -1 || sendfile(-1, in, 0, FRAME0_SIZE) != -1) result = FAIL;
+	dev = open((uint8_t *)"/dev/zero");
+	if (dev < 0 || sendfile(out, dev, 0, FRAME0_SIZE) != -1) result = FAIL;
+	close(dev);
+
+	close(in);
+	close(out);
+	if (unlink((uint8_t *)"sendfile") != 0) result = FAIL;
+	return result;
+}
+
+/* mmap_test
+ *
+ * Maps a two block file and checks the pages against read, that the partial last page
+ * is zero past the end of the file, and that the file can't be deleted while mapped
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: creates and unlinks a file, the window is left empty
+ * Coverage: mmap, munmap, hold_inode, delete_file
+ * Files: sys_call.c/h, filesystem.c/h
+ */
+int mmap_test() {
+	TEST_HEADER;
+	uint8_t ref[FRAME0_SIZE];
+	uint8_t * map;
+	uint32_t i, size, used;
+	int32_t fd, addr, result = PASS;
+
+	fd = open((uint8_t *)"frame0.txt");
+	if (fd < 0) return FAIL;
+	if (read(fd, ref, FRAME0_SIZE) != FRAME0_SIZE) return FAIL;
+	close(fd);
+
+	if (create((uint8_t *)"mmapfile") != 0) return FAIL;
+	fd = open((uint8_t *)"mmapfile");
+	if (fd < 0) return FAIL;
+	for (i = 0; i < MMAP_TEST_COPIES; i++) {
+		if (write(fd, ref, FRAME0_SIZE) != FRAME0_SIZE) result = FAIL;
+	}
+	size = MMAP_TEST_COPIES * FRAME0_SIZE;
+
+	// bad arguments
+	if (mmap(fd, 1, size) != -1 || mmap(fd, 0, 0) != -1) result = FAIL;
+	if (mmap(fd, 2 * FOUR_KB, FOUR_KB) != -1 || mmap(-1, 0, size) != -1) result = FAIL;
+
+	addr = mmap(fd, 0, size);
+	close(fd);
+	if (addr == -1) return FAIL;
+	map = (uint8_t *)addr;
+	used = frames_in_use();
+
+	// every byte of the file shows through, the rest of the tail page is zero
+	for (i = 0; i < size; i++) {
+		if (map[i] != ref[i % FRAME0_SIZE]) result = FAIL;
+	}
+	for (i = size; i < 2 * FOUR_KB; i++) {
+		if (map[i] != 0) result = FAIL;
+	}
+
+	// any mapped page keeps the file alive
+	if (unlink((uint8_t *)"mmapfile") != -1) result = FAIL;
+	if (munmap(addr + FOUR_KB, FOUR_KB) != 0) result = FAIL;
+	if (frames_in_use() != used - 1) result = FAIL;
+	if (unlink((uint8_t *)"mmapfile") != -1) result = FAIL;
+
+	// ranges outside the window
+	if (munmap(addr + 1, FOUR_KB) != -1 || munmap(MMAP_START - FOUR_KB, FOUR_KB) != -1) result = FAIL;
+	if (munmap(MMAP_START, (MMAP_PAGES + 1) * FOUR_KB) != -1) result = FAIL;
+
+	if (munmap(addr, FOUR_KB) != 0) result = FAIL;
+	if (unlink((uint8_t *)"mmapfile") != 0) result = FAIL;
+
+	return result;
+}
+
+/* write_file_test
+ *
+ * Creates a file, writes past a block boundary, reads it back and unlinks it once closed
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: leaves the free counts where they started
+ * Coverage: create, file_write, unlink, block allocation, hold_inode
+ * Files: filesystem.c/h, sys_call.c/h
+ */
+int write_file_test() {
+	TEST_HEADER;
+	uint8_t buf[WRITE_TEST_SIZE];
+	uint8_t check[WRITE_TEST_SIZE];
+	stat_t st;
+	uint32_t free_before = fs_stats.free_blocks;
+	int32_t fd, i, result = PASS;
+
+	// no zero bytes, so strncmp compares the whole buffer
+	for (i = 0; i < WRITE_TEST_SIZE; i++) buf[i] = 'a' + (i % 26);
+
+	if (create((uint8_t *)"newfile") != 0) return FAIL;
+	if (create((uint8_t *)"newfile") != -1) result = FAIL;
+
+	fd = open((uint8_t *)"newfile");
+	if (fd < 0) return FAIL;
+	if (write(fd, buf, WRITE_TEST_SIZE) != WRITE_TEST_SIZE) result = FAIL;
+	if (fstat(fd, &st) != 0 || st.size != WRITE_TEST_SIZE || st.blocks != 2) result = FAIL;
+
+	// overwrite the start, the size must not change
+	if (lseek(fd, 0, SEEK_SET) != 0 || write(fd, buf, FRAME0_INDEX) != FRAME0_INDEX) result = FAIL;
+	if (lseek(fd, 0, SEEK_SET) != 0 || read(fd, check, WRITE_TEST_SIZE) != WRITE_TEST_SIZE) result = FAIL;
+	if (strncmp((int8_t *)buf, (int8_t *)check, WRITE_TEST_SIZE) != 0) result = FAIL;
+
+	// an open file stays put, its inode can't be handed to another create
+	if (unlink((uint8_t *)"newfile") != -1) result = FAIL;
+	close(fd);
+
+	if (unlink((uint8_t *)"newfile") != 0) result = FAIL;
+	if (open((uint8_t *)"newfile") != -1) result = FAIL;
+	if (fs_stats.free_blocks != free_before) result = FAIL;
+
+	return result;
+}
+
+/* run_cache_test
+ *
+ * Writes a file several blocks long and checks read_data copies it one run of back to back
+ * blocks at a time, that the run list is cached, and that a write or an unlink drops it
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: creates and unlinks a file, uses RUN_TEST_BLOCKS frames and frees them
+ * Coverage: get_runs, build_runs, find_run, invalidate_runs, copy_blocks
+ * Files: filesystem.c/h
+ */
+int run_cache_test() {
+	TEST_HEADER;
+	uint8_t * buf;
+	uint32_t i, runs, addr, prev, misses, copies, size = RUN_TEST_BLOCKS * SIZE_OF_BLOCKS;
+	int32_t fd, result = PASS;
+	stat_t st;
+
+	buf = (uint8_t *)alloc_frames(RUN_TEST_BLOCKS);
+	if (buf == NULL) return FAIL;
+	for (i = 0; i < size; i++) buf[i] = (uint8_t)i;
+
+	if (create((uint8_t *)"runfile") != 0) return FAIL;
+	fd = open((uint8_t *)"runfile");
+	if (fd < 0 || write(fd, buf, size) != (int32_t)size || fstat(fd, &st) != 0) result = FAIL;
+
+	// one run per stretch of back to back blocks, however the allocator laid them out
+	runs = 0;
+	prev = 0;
+	for (i = 0; i < RUN_TEST_BLOCKS; i++) {
+		if (get_block_addr(st.inode, i, &addr) != 0) result = FAIL;
+		if (i == 0 || addr != prev + SIZE_OF_BLOCKS) runs++;
+		prev = addr;
+	}
+
+	misses = fs_stats.run_cache_misses;
+	copies = fs_stats.runs_copied;
+	memset(buf, 0, size);
+	if (read_data(st.inode, 0, buf, size) != (int32_t)size) result = FAIL;
+	for (i = 0; i < size; i++) {
+		if (buf[i] != (uint8_t)i) result = FAIL;
+	}
+	if (fs_stats.run_cache_misses != misses + 1 || fs_stats.runs_copied != copies + runs) result = FAIL;
+
+	// a second read, starting partway into a block, uses the cached list
+	misses = fs_stats.run_cache_misses;
+	if (read_data(st.inode, RUN_TEST_OFFSET, buf, size) != (int32_t)(size - RUN_TEST_OFFSET)) result = FAIL;
+	if (buf[0] != (uint8_t)RUN_TEST_OFFSET) result = FAIL;
+	if (fs_stats.run_cache_misses != misses) result = FAIL;
+
+	// a write drops the list even when no block moves
+	buf[0] = ~buf[0];
+	lseek(fd, 0, SEEK_SET);
+	if (write(fd, buf, 1) != 1) result = FAIL;
+	misses = fs_stats.run_cache_misses;
+	if (read_data(st.inode, 0, buf + 1, 1) != 1 || buf[1] != buf[0]) result = FAIL;
+	if (fs_stats.run_cache_misses != misses + 1) result = FAIL;
+	close(fd);
+
+	// so does an unlink, a new file in the same inode reads its own blocks
+	if (unlink((uint8_t *)"runfile") != 0) result = FAIL;
+	if (create((uint8_t *)"runfile") != 0) return FAIL;
+	fd = open((uint8_t *)"runfile");
+	memset(buf, RUN_TEST_BLOCKS, SIZE_OF_BLOCKS);
+	if (fd < 0 || write(fd, buf, SIZE_OF_BLOCKS) != SIZE_OF_BLOCKS || fstat(fd, &st) != 0) result = FAIL;
+	misses = fs_stats.run_cache_misses;
+	memset(buf, 0, size);
+	if (read_data(st.inode, 0, buf, size) != SIZE_OF_BLOCKS) result = FAIL;
+	for (i = 0; i < SIZE_OF_BLOCKS; i++) {
+		if (buf[i] != RUN_TEST_BLOCKS) result = FAIL;
+	}
+	if (fs_stats.run_cache_misses != misses + 1) result = FAIL;
+	close(fd);
+	if (unlink((uint8_t *)"runfile") != 0) result = FAIL;
+
+	for (i = 0; i < RUN_TEST_BLOCKS; i++) free_frame(buf + i * FOUR_KB);
+	return result;
+}
+
+/* indirect_test
+ *
+ * Writes across the first block behind the single and the double indirect block of a
+ * version 1 file and reads it back. The top layer has to be an image built with mkfs -1
+ * and at least IND_TEST_BLOCKS + IND_TEST_TABLES spare blocks (-b)
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: creates and unlinks a file, leaves the free counts where they started
+ * Coverage: inode_block, indirect_slot, indirect_table, append_block, indirect_blocks
+ * Files: filesystem.c/h, tools/mkfs.c
+ */
+int indirect_test() {
+	TEST_HEADER;
+	uint8_t buf[IND_TEST_SIZE];
+	uint8_t check[IND_TEST_SIZE];
+	uint32_t bounds[IND_TEST_BOUNDS] = { NUM_DIRECT_BLOCKS, NUM_DIRECT_BLOCKS + PTRS_PER_BLOCK };
+	uint32_t i, j, offset, free_before;
+	int32_t fd, result = PASS;
+	stat_t st;
+
+	if (fs_stats.version != FS_VERSION_1 || !(fs_stats.features & FS_FEATURE_INDIRECT)) return FAIL;
+	free_before = fs_stats.free_blocks;
+
+	if (create((uint8_t *)"indfile") != 0) return FAIL;
+	fd = open((uint8_t *)"indfile");
+	if (fd < 0) return FAIL;
+
+	for (i = 0; i < IND_TEST_BOUNDS; i++) {
+		// half the bytes in the last block before the boundary, half in the first behind it
+		offset = bounds[i] * SIZE_OF_BLOCKS - IND_TEST_SIZE / 2;
+		for (j = 0; j < IND_TEST_SIZE; j++) buf[j] = (uint8_t)(i + j + 1);
+		if (lseek(fd, offset, SEEK_SET) != (int32_t)offset) result = FAIL;
+		if (write(fd, buf, IND_TEST_SIZE) != IND_TEST_SIZE) result = FAIL;
+
+		if (pread(fd, check, IND_TEST_SIZE, offset) != IND_TEST_SIZE) result = FAIL;
+		if (strncmp((int8_t *)buf, (int8_t *)check, IND_TEST_SIZE) != 0) result = FAIL;
+	}
+
+	// the first boundary's bytes are still there once the double indirect block is in use
+	for (j = 0; j < IND_TEST_SIZE; j++) buf[j] = (uint8_t)(j + 1);
+	if (pread(fd, check, IND_TEST_SIZE, bounds[0] * SIZE_OF_BLOCKS - IND_TEST_SIZE / 2) != IND_TEST_SIZE) result = FAIL;
+	if (strncmp((int8_t *)buf, (int8_t *)check, IND_TEST_SIZE) != 0) result = FAIL;
+
+	// the gaps read as zeros, on both sides of the single indirect range
+	if (pread(fd, check, 1, SIZE_OF_BLOCKS) != 1 || check[0] != 0) result = FAIL;
+	if (pread(fd, check, 1, (bounds[0] + 1) * SIZE_OF_BLOCKS) != 1 || check[0] != 0) result = FAIL;
+
+	if (fstat(fd, &st) != 0 || st.blocks != IND_TEST_BLOCKS) result = FAIL;
+	if (free_before - fs_stats.free_blocks != IND_TEST_BLOCKS + IND_TEST_TABLES) result = FAIL;
+	close(fd);
+
+	// unlink gives back the indirect blocks along with the data
+	if (unlink((uint8_t *)"indfile") != 0) result = FAIL;
+	if (fs_stats.free_blocks != free_before) result = FAIL;
+
+	return result;
+}
+
+/* filled
+ *
+ * Checks every byte of a buffer holds one value
+ * Inputs: buf, len : the buffer ; value : the byte expected
+ * Outputs: 1 if they all match, 0 otherwise
+ * Side Effects: None
+ */
+static int32_t filled(const uint8_t * buf, uint32_t len, uint8_t value) {
+	uint32_t i;
+
+	for (i = 0; i < len; i++) {
+		if (buf[i] != value) return 0;
+	}
+	return 1;
+}
+
+/* top_layer_sorted
+ *
+ * Checks the top layer's root dentries are in strictly increasing name order. The union
+ * hands out the top layer's names first, in the order its boot block holds them
+ * Inputs: count : set to the number of top layer names
+ * Outputs: 1 if they are sorted, 0 otherwise
+ * Side Effects: None
+ */
+static int32_t top_layer_sorted(uint32_t * count) {
+	dentry_t prev, cur;
+	uint32_t i;
+
+	for (i = 0; read_dentry_by_index(i, &cur) == 0 && LAYER_OF(cur.inode_index) == fs_stats.layers - 1; i++) {
+		if (i > 0 && strncmp(prev.filename, cur.filename, MAX_ENTRY_LEN) >= 0) return 0;
+		prev = cur;
+	}
+	*count = i;
+	return 1;
+}
+
+/* v2_format_test
+ *
+ * Checks the top layer mounted as version 2 while the stock image below it stayed version 1,
+ * that created and unlinked names keep the directory sorted, and that a file grown one block
+ * per write maps each block to the data it wrote, with the last extent grown whenever the new
+ * block follows it. The top layer has to be an image built with mkfs (no -1) and at least
+ * V2_TEST_BLOCKS spare blocks (-b), mounted over the stock image
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: creates and unlinks V2_TEST_FILES files, uses a frame and frees it
+ * Coverage: mount_layer, create_file, delete_file, append_block, block_of, stat_file
+ * Files: filesystem.c/h, tools/mkfs.c
+ */
+int v2_format_test() {
+	TEST_HEADER;
+	uint8_t * names[V2_TEST_FILES] = { (uint8_t *)"v2file_b", (uint8_t *)"v2file_a", (uint8_t *)"v2file_c" };
+	uint8_t * buf;
+	uint32_t i, addr, prev, runs, count, count_before, free_before;
+	int32_t fd, result = PASS;
+	stat_t st;
+
+	if (fs_stats.version != FS_VERSION_2 || fs_stats.layers < 2) return FAIL;
+
+	// a layer without FS_MAGIC_V2 keeps block-number inodes
+	if (stat((uint8_t *)V2_TEST_STOCK_FILE, &st) != 0) return FAIL;
+	if (LAYER_OF(st.inode) == fs_stats.layers - 1 || st.blocks == 0 || st.extents != 0) result = FAIL;
+
+	// names go in out of order and come out sorted
+	if (!top_layer_sorted(&count_before)) result = FAIL;
+	for (i = 0; i < V2_TEST_FILES; i++) {
+		if (create(names[i]) != 0) return FAIL;
+	}
+	if (!top_layer_sorted(&count) || count != count_before + V2_TEST_FILES) result = FAIL;
+
+	buf = (uint8_t *)alloc_frame();
+	if (buf == NULL) return FAIL;
+	free_before = fs_stats.free_blocks;
+	fd = open(names[1]);
+	if (fd < 0) result = FAIL;
+	for (i = 0; i < V2_TEST_BLOCKS; i++) {
+		memset(buf, i + 1, SIZE_OF_BLOCKS);
+		if (write(fd, buf, SIZE_OF_BLOCKS) != SIZE_OF_BLOCKS) result = FAIL;
+	}
+	if (free_before - fs_stats.free_blocks != V2_TEST_BLOCKS) result = FAIL;
+
+	// every block holds what was written to it, and each run of back to back blocks is one extent
+	if (fstat(fd, &st) != 0 || st.blocks != V2_TEST_BLOCKS) result = FAIL;
+	runs = 0;
+	prev = 0;
+	for (i = 0; i < V2_TEST_BLOCKS; i++) {
+		if (get_block_addr(st.inode, i, &addr) != 0) {
+			result = FAIL;
+			break;
+		}
+		if (!filled((uint8_t *)addr, SIZE_OF_BLOCKS, i + 1)) result = FAIL;
+		if (i == 0 || addr != prev + SIZE_OF_BLOCKS) runs++;
+		prev = addr;
+	}
+	if (st.extents != runs) result = FAIL;
+	close(fd);
+	free_frame(buf);
+
+	// removing a name from the middle keeps the rest in order
+	if (unlink(names[0]) != 0) result = FAIL;
+	if (!top_layer_sorted(&count) || count != count_before + V2_TEST_FILES - 1) result = FAIL;
+	for (i = 1; i < V2_TEST_FILES; i++) {
+		if (unlink(names[i]) != 0) result = FAIL;
+	}
+	if (!top_layer_sorted(&count) || count != count_before) result = FAIL;
+	if (fs_stats.free_blocks != free_before) result = FAIL;
+
+	return result;
+}
+
+/* lz4_test
+ *
+ * Decodes a hand made LZ4 block and some broken ones, then reads a compressed file through
+ * the frame cache and checks which frames it keeps. Needs LZ4_TEST_FILE in a layer built by
+ * mkfs without -u, LZ4_TEST_SIZE bytes long with byte i 'a' + (i / LZ4_TEST_RUN) % 26
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: lz4_decompress, get_frame, read_frames, frame cache LRU
+ * Files: lz4.c/h, filesystem.c/h, tools/mkfs.c
+ */
+int lz4_test() {
+	TEST_HEADER;
+	// "ab", then a 6 byte match 2 back that overlaps its own output, then "c"
+	static const uint8_t block[] = { 0x22, 'a', 'b', 0x02, 0x00, 0x10, 'c' };
+	static const uint8_t far[] = { 0x22, 'a', 'b', 0x03, 0x00, 0x10, 'c' };
+	uint8_t buf[LZ4_TEST_CHUNK];
+	uint32_t i, pos, frames, hits, decoded;
+	int32_t got, result = PASS;
+	dentry_t dentry;
+	stat_t st;
+
+	if (lz4_decompress(block, sizeof(block), buf, sizeof(buf)) != 9) result = FAIL;
+	if (strncmp((int8_t *)buf, "ababababc", 9) != 0) result = FAIL;
+	if (lz4_decompress(block, sizeof(block), buf, 8) != -1) result = FAIL;
+	if (lz4_decompress(block, 4, buf, sizeof(buf)) != -1) result = FAIL;
+	if (lz4_decompress(far, sizeof(far), buf, sizeof(buf)) != -1) result = FAIL;
+
+	if (read_dentry_by_name((uint8_t *)LZ4_TEST_FILE, &dentry) != 0) return FAIL;
+	if (stat_file(dentry.filetype, dentry.inode_index, &st) != 0 || st.size != LZ4_TEST_SIZE) return FAIL;
+	frames = (LZ4_TEST_SIZE + SIZE_OF_BLOCKS - 1) / SIZE_OF_BLOCKS;
+	// stored compressed, so it takes fewer blocks than its length needs
+	if (st.blocks >= frames) return FAIL;
+
+	// every byte comes back, reads crossing frames and the short last one included
+	for (pos = 0; pos < LZ4_TEST_SIZE; pos += got) {
+		got = read_data(dentry.inode_index, pos, buf, LZ4_TEST_CHUNK);
+		if (got <= 0) return FAIL;
+		for (i = 0; i < (uint32_t)got; i++) {
+			if (buf[i] != 'a' + ((pos + i) / LZ4_TEST_RUN) % 26) result = FAIL;
+		}
+	}
+
+	// touch frames 0 .. FRAME_CACHE_SIZE - 1 so they fill the cache, frame 0 the oldest
+	for (i = 0; i < FRAME_CACHE_SIZE; i++) {
+		if (read_data(dentry.inode_index, i * SIZE_OF_BLOCKS, buf, 1) != 1) result = FAIL;
+	}
+	hits = fs_stats.frame_cache_hits;
+	decoded = fs_stats.frames_decompressed;
+
+	// a hit makes frame 0 the newest, so the next miss evicts frame 1 instead
+	if (read_data(dentry.inode_index, 0, buf, 1) != 1) result = FAIL;
+	if (fs_stats.frame_cache_hits != hits + 1 || fs_stats.frames_decompressed != decoded) result = FAIL;
+	if (read_data(dentry.inode_index, FRAME_CACHE_SIZE * SIZE_OF_BLOCKS, buf, 1) != 1) result = FAIL;
+	if (fs_stats.frames_decompressed != decoded + 1) result = FAIL;
+	if (read_data(dentry.inode_index, 0, buf, 1) != 1) result = FAIL;
+	if (fs_stats.frame_cache_hits != hits + 2) result = FAIL;
+	if (read_data(dentry.inode_index, SIZE_OF_BLOCKS, buf, 1) != 1) result = FAIL;
+	if (fs_stats.frames_decompressed != decoded + 2 || buf[0] != 'a' + (SIZE_OF_BLOCKS / LZ4_TEST_RUN) % 26) result = FAIL;
+
+	return result;
+}
+
+/* getdents_test
+ *
+ * Lists the root directory in one call and checks it against the dentries
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: getdents, per-descriptor directory cursor
+ * Files: filesystem.c/h, sys_call.c/h
+ */
+int getdents_test() {
+	TEST_HEADER;
+	uint8_t buf[GETDENTS_BUF_SIZE];
+	dentry_t dentry;
+	dirent_t * rec;
+	int32_t fd, ret, pos, count = 0, result = PASS;
+
+	fd = open((uint8_t *)".");
+	if (fd < 0) return FAIL;
+
+	// too small for even one record
+	if (getdents(fd, buf, DIRENT_HEADER) != -1) result = FAIL;
+
+	ret = getdents(fd, buf, GETDENTS_BUF_SIZE);
+	if (ret <= 0) result = FAIL;
+	for (pos = 0; pos < ret; pos += rec->d_reclen, count++) {
+		rec = (dirent_t *)(buf + pos);
+		if (read_dentry_by_index(count, &dentry) != 0) return FAIL;
+		if (rec->d_inode != dentry.inode_index || rec->d_type != dentry.filetype) result = FAIL;
+		if (strncmp(rec->d_name, dentry.filename, MAX_ENTRY_LEN) != 0) result = FAIL;
+		if (rec->d_type == FILE_TYPE && rec->d_size != get_file_size(rec->d_inode)) result = FAIL;
+	}
+
+	// everything came back in the first call
+	if (read_dentry_by_index(count, &dentry) == 0 && dentry.filename[0] != '\0') result = FAIL;
+	if (getdents(fd, buf, GETDENTS_BUF_SIZE) != 0) result = FAIL;
+
+	// rewinding restarts the listing
+	if (lseek(fd, 0, SEEK_SET) != 0 || getdents(fd, buf, GETDENTS_BUF_SIZE) != ret) result = FAIL;
+	close(fd);
+
+	return result;
+}
+
+/* path_lookup_test
+ *
+ * Resolves the same file through several spellings of its path and checks the dentry cache
+ * answers repeats, misses included
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: path walk, dentry cache
+ * Files: filesystem.c/h
+ */
+int path_lookup_test() {
+	TEST_HEADER;
+	dentry_t dentry, again;
+	uint32_t hits, negative_hits;
+	int result = PASS;
+
+	if (read_dentry_by_name((uint8_t *)"frame0.txt", &dentry) != 0) return FAIL;
+
+	// the second lookup of a name never searches the directory
+	hits = fs_stats.dcache_hits;
+	if (read_dentry_by_name((uint8_t *)"frame0.txt", &again) != 0) result = FAIL;
+	if (fs_stats.dcache_hits != hits + 1 || again.inode_index != dentry.inode_index) result = FAIL;
+
+	if (read_dentry_by_name((uint8_t *)"./frame0.txt", &again) != 0 || again.inode_index != dentry.inode_index) result = FAIL;
+	if (read_dentry_by_name((uint8_t *)"/frame0.txt", &again) != 0 || again.inode_index != dentry.inode_index) result = FAIL;
+	if (read_dentry_by_name((uint8_t *)"../frame0.txt", &again) != 0 || again.inode_index != dentry.inode_index) result = FAIL;
+
+	// a miss is remembered too
+	if (read_dentry_by_name((uint8_t *)"nosuchfile", &again) != -1) result = FAIL;
+	negative_hits = fs_stats.dcache_negative_hits;
+	if (read_dentry_by_name((uint8_t *)"nosuchfile", &again) != -1) result = FAIL;
+	if (fs_stats.dcache_negative_hits != negative_hits + 1) result = FAIL;
+
+	// a regular file has nothing under it
+	if (read_dentry_by_name((uint8_t *)"frame0.txt/frame0.txt", &again) != -1) result = FAIL;
+
+	if (read_dentry_by_name((uint8_t *)".", &again) != 0) result = FAIL;
+	if (again.filetype != FOLDER_TYPE || again.inode_index != ROOT_INODE) result = FAIL;
+
+	return result;
+}
+
+/* union_mount_test
+ *
+ * Every name the merged root lists resolves by name to the same layer and inode, and no name
+ * is listed twice however many modules share it
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: union mount, merged root index
+ * Files: filesystem.c/h, kernel.c
+ */
+int union_mount_test() {
+	TEST_HEADER;
+	dentry_t listed, found, other;
+	uint32_t i, j;
+	int result = PASS;
+
+	if (fs_stats.layers < 1) return FAIL;
+
+	for (i = 0; read_dentry_by_index(i, &listed) == 0; i++) {
+		if (read_dentry_by_name((uint8_t *)listed.filename, &found) != 0) {
+			result = FAIL;
+			continue;
+		}
+		// "." stands for the root, whichever layer's dentry the listing shows
+		if (strncmp(listed.filename, ".", 2) != 0 && found.inode_index != listed.inode_index) result = FAIL;
+		if (LAYER_OF(listed.inode_index) >= fs_stats.layers) result = FAIL;
+
+		for (j = 0; j < i; j++) {
+			if (read_dentry_by_index(j, &other) == 0 && strncmp(other.filename, listed.filename, MAX_ENTRY_LEN) == 0) result = FAIL;
+		}
+	}
+
+	return result;
+}
+
+
+/* ata_dma_test
+ *
+ * Reads the start of hda once straight into kernel memory and once through the bounce
+ * frames (an odd buffer the bus master can't use) and checks both land the same bytes
+ * Inputs: None
+ * Outputs: PASS/FAIL, PASS with nothing to check if QEMU has no IDE disk
+ * Side Effects: None
+ * Coverage: PCI probe, IDENTIFY, PRD tables, IRQ 14 completion, block device registry
+ * Files: ata.c/h, block.c/h, pci.c/h
+ */
+int ata_dma_test() {
+	TEST_HEADER;
+
+	static uint8_t direct[ATA_TEST_SECTORS * BLK_SECTOR_SIZE];
+	static uint8_t bounced[ATA_TEST_SECTORS * BLK_SECTOR_SIZE + 1];
+	blkdev_t * hda = lookup_blkdev((int8_t *)"hda");
+	uint32_t reads, i;
+	int result = PASS;
+
+	if (hda == NULL) return PASS;
+	reads = hda->reads;
+
+	if (blk_read(hda, 0, ATA_TEST_SECTORS, direct) != 0) result = FAIL;
+	if (blk_read(hda, 0, ATA_TEST_SECTORS, bounced + 1) != 0) result = FAIL;
+	for (i = 0; i < sizeof(direct); i++) {
+		if (direct[i] != bounced[i + 1]) result = FAIL;
+	}
+	if (hda->reads != reads + 2) result = FAIL;
+
+	// nothing past the end of the disk
+	if (blk_read(hda, hda->num_sectors, 1, direct) != -1) result = FAIL;
+
+	return result;
+}
+
+/* virtio_batch_test
+ *
+ * Reads enough of vda to need several requests, so they are queued together and kicked
+ * once, straight into kernel memory and again through the bounce frames
+ * Inputs: None
+ * Outputs: PASS/FAIL, PASS with nothing to check if QEMU has no virtio disk
+ * Side Effects: None
+ * Coverage: virtqueue setup, batched submission, used ring reaping, PCI interrupt line
+ * Files: virtio_blk.c/h, block.c/h, pci.c/h
+ */
+int virtio_batch_test() {
+	TEST_HEADER;
+
+	static uint8_t direct[VIRTIO_TEST_SECTORS * BLK_SECTOR_SIZE];
+	static uint8_t bounced[VIRTIO_TEST_SECTORS * BLK_SECTOR_SIZE + 1];
+	blkdev_t * vda = lookup_blkdev((int8_t *)"vda");
+	uint32_t reads, chunks, i;
+	int result = PASS;
+
+	if (vda == NULL) return PASS;
+	reads = vda->reads;
+	chunks = (VIRTIO_TEST_SECTORS + vda->max_sectors - 1) / vda->max_sectors;
+
+	if (blk_read(vda, 0, VIRTIO_TEST_SECTORS, direct) != 0) result = FAIL;
+	if (blk_read(vda, 0, VIRTIO_TEST_SECTORS, bounced + 1) != 0) result = FAIL;
+	for (i = 0; i < sizeof(direct); i++) {
+		if (direct[i] != bounced[i + 1]) result = FAIL;
+	}
+	if (vda->reads != reads + 2 * chunks) result = FAIL;
+
+	return result;
+}
+
+/* blk_merge_test
+ *
+ * Submits page sized reads of consecutive sectors in reverse order under a plug, so the
+ * queue has to sort and merge them, and checks they come back matching one big read
+ * Inputs: None
+ * Outputs: PASS/FAIL, PASS with nothing to check if there is no block device
+ * Side Effects: None
+ * Coverage: request queue, front/back merging, elevator dispatch, queue depth accounting
+ * Files: block.c/h
+ */
+int blk_merge_test() {
+	TEST_HEADER;
+
+	static uint8_t whole[MERGE_TEST_PAGES * ONEKB * 4];
+	static uint8_t pages[MERGE_TEST_PAGES][ONEKB * 4];
+	blk_request_t reqs[MERGE_TEST_PAGES];
+	blkdev_t * dev = get_blkdev(0);
+	uint32_t merges, dispatches, i, j;
+	int result = PASS;
+
+	if (dev == NULL) return PASS;
+	if (blk_read(dev, 0, sizeof(whole) / BLK_SECTOR_SIZE, whole) != 0) return FAIL;
+	merges = dev->merges;
+	dispatches = dev->dispatches;
+
+	blk_plug(dev);
+	for (i = MERGE_TEST_PAGES; i-- > 0; ) {
+		reqs[i].sector = i * sizeof(pages[0]) / BLK_SECTOR_SIZE;
+		reqs[i].count = sizeof(pages[0]) / BLK_SECTOR_SIZE;
+		reqs[i].buf = pages[i];
+		reqs[i].dir = BLK_READ;
+		if (blk_submit(dev, &reqs[i]) != 0) result = FAIL;
+	}
+	blk_unplug(dev);
+
+	for (i = 0; i < MERGE_TEST_PAGES; i++) {
+		if (blk_wait(dev, &reqs[i]) != 0) result = FAIL;
+		for (j = 0; j < sizeof(pages[0]); j++) {
+			if (pages[i][j] != whole[i * sizeof(pages[0]) + j]) result = FAIL;
+		}
+	}
+
+	// far fewer transfers than requests, and nothing left queued
+	if (dev->merges == merges) result = FAIL;
+	if (dev->dispatches - dispatches >= MERGE_TEST_PAGES) result = FAIL;
+	if (dev->depth != 0) result = FAIL;
+
+	return result;
+}
+
+/* bcache_test
+ *
+ * Reads the base layer's first block through the buffer cache twice, then streams twice
+ * as many blocks as the cache holds past it so the CLOCK sweep has to evict it
+ * Inputs: None
+ * Outputs: PASS/FAIL, PASS with nothing to check if no image is mounted
+ * Side Effects: None
+ * Coverage: (device, block) lookup, hit/miss/eviction accounting, refcounts, ramdisk reads
+ * Files: bcache.c/h, ramdisk.c/h, block.c/h
+ */
+int bcache_test() {
+	TEST_HEADER;
+
+	static uint8_t direct[BCACHE_BLOCK_SIZE];
+	blkdev_t * ram = lookup_blkdev((int8_t *)"ram0");
+	buf_t * first;
+	buf_t * again;
+	uint32_t hits, evictions, blocks, i;
+	int result = PASS;
+
+	if (ram == NULL) return PASS;
+	if (blk_read(ram, 0, BCACHE_BLOCK_SECTORS, direct) != 0) return FAIL;
+
+	first = bread(ram, 0);
+	if (first == NULL) return FAIL;
+	for (i = 0; i < BCACHE_BLOCK_SIZE; i++) {
+		if (first->data[i] != direct[i]) result = FAIL;
+	}
+
+	// a second holder shares the buffer instead of reading again
+	hits = bcache_stats.hits;
+	again = bread(ram, 0);
+	if (again != first || bcache_stats.hits != hits + 1 || first->refcount < 2) result = FAIL;
+	brelse(again);
+	brelse(first);
+
+	// two laps of the clock hand over fresh blocks push block 0 out
+	blocks = ram->num_sectors / BCACHE_BLOCK_SECTORS;
+	if (blocks <= 2 * bcache_stats.bufs) return result;
+	evictions = bcache_stats.evictions;
+	for (i = 1; i <= 2 * bcache_stats.bufs; i++) {
+		again = bread(ram, i);
+		if (again == NULL) {
+			result = FAIL;
+			break;
+		}
+		brelse(again);
+	}
+	if (bcache_stats.evictions == evictions) result = FAIL;
+
+	hits = bcache_stats.hits;
+	again = bread(ram, 0);
+	if (again == NULL || bcache_stats.hits != hits) result = FAIL;
+	brelse(again);
+
+	return result;
+}
+
+/* readahead_test
+ *
+ * Reads a file a small chunk at a time, checking the descriptor's readahead window ramps up
+ * to its cap while the reads are sequential and backs off after a seek
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: per-descriptor readahead state, window growth and shrink, breadahead
+ * Files: filesystem.c/h, bcache.c/h, sys_call.c/h
+ */
+int readahead_test() {
+	TEST_HEADER;
+	static uint8_t buf[RA_TEST_BLOCKS * SIZE_OF_BLOCKS];
+	uint8_t check[RA_TEST_CHUNK];
+	file_desc_t * desc;
+	uint32_t i;
+	int32_t fd, result = PASS;
+
+	for (i = 0; i < sizeof(buf); i++) buf[i] = 'a' + (i % 26);
+	if (create((uint8_t *)"rafile") != 0) return FAIL;
+	fd = open((uint8_t *)"rafile");
+	if (fd < 0) return FAIL;
+	if (write(fd, buf, sizeof(buf)) != sizeof(buf)) result = FAIL;
+	if (lseek(fd, 0, SEEK_SET) != 0) result = FAIL;
+	desc = get_fd(curr_pcb(), fd);
+
+	// sequential: every read doubles the window until it hits the cap
+	for (i = 0; i < RA_TEST_READS; i++) {
+		if (read(fd, check, RA_TEST_CHUNK) != RA_TEST_CHUNK) result = FAIL;
+		if (strncmp((int8_t *)check, (int8_t *)buf + i * RA_TEST_CHUNK, RA_TEST_CHUNK) != 0) result = FAIL;
+	}
+	if (desc->ra_window != RA_MAX_BLOCKS) result = FAIL;
+
+	// a jump backwards is random access
+	if (lseek(fd, RA_TEST_CHUNK, SEEK_SET) != RA_TEST_CHUNK) result = FAIL;
+	if (read(fd, check, RA_TEST_CHUNK) != RA_TEST_CHUNK) result = FAIL;
+	if (strncmp((int8_t *)check, (int8_t *)buf + RA_TEST_CHUNK, RA_TEST_CHUNK) != 0) result = FAIL;
+	if (desc->ra_window != RA_MAX_BLOCKS >> RA_SHRINK_SHIFT) result = FAIL;
+
+	close(fd);
+	if (unlink((uint8_t *)"rafile") != 0) result = FAIL;
+	return result;
+}
+
+/* writeback_test
+ *
+ * Writes a file and checks its blocks sit dirty in the buffer cache until fsync writes
+ * them back, and that the data reads back the same afterwards
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: dirty tracking, sorted batch writeback, fsync
+ * Files: bcache.c/h, filesystem.c/h, sys_call.c/h
+ */
+int writeback_test() {
+	TEST_HEADER;
+	static uint8_t buf[WB_TEST_BLOCKS * SIZE_OF_BLOCKS];
+	static uint8_t check[WB_TEST_BLOCKS * SIZE_OF_BLOCKS];
+	uint32_t writes, i;
+	int32_t fd, result = PASS;
+
+	for (i = 0; i < sizeof(buf); i++) buf[i] = 'a' + (i % 26);
+	if (create((uint8_t *)"wbfile") != 0) return FAIL;
+	fd = open((uint8_t *)"wbfile");
+	if (fd < 0) return FAIL;
+
+	// the blocks go no further than the cache, unless the timed writeback got to them already
+	writes = bcache_stats.writes;
+	if (write(fd, buf, sizeof(buf)) != sizeof(buf)) result = FAIL;
+	if (bcache_stats.dirty + (bcache_stats.writes - writes) < WB_TEST_BLOCKS) result = FAIL;
+
+	if (fsync(fd) != 0) result = FAIL;
+	if (bcache_stats.dirty != 0 || bcache_stats.writes < writes + WB_TEST_BLOCKS) result = FAIL;
+	if (fsync(WB_TEST_TTY_FD) != -1) result = FAIL;
+
+	if (lseek(fd, 0, SEEK_SET) != 0 || read(fd, check, sizeof(check)) != sizeof(check)) result = FAIL;
+	if (strncmp((int8_t *)buf, (int8_t *)check, sizeof(buf)) != 0) result = FAIL;
+
+	close(fd);
+	if (unlink((uint8_t *)"wbfile") != 0) result = FAIL;
+	return result;
+}
+
+/* journal_test
+ *
+ * Creates, writes and fsyncs a handful of files and checks their metadata updates went to
+ * the top layer's journal in fewer commits than there were operations. Needs a top layer
+ * built with mkfs -j
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: metadata journaling, group commit, fsync
+ * Files: journal.c/h, filesystem.c/h, sys_call.c/h
+ */
+int journal_test() {
+	TEST_HEADER;
+	uint8_t name[] = "jfile0";
+	uint8_t data[] = "journal";
+	uint32_t commits, ops;
+	int32_t fd, i, result = PASS;
+
+	commits = journal_stats.commits + journal_stats.checkpoints;
+	ops = journal_stats.ops;
+	for (i = 0; i < JOURNAL_TEST_FILES; i++) {
+		name[JOURNAL_TEST_DIGIT] = '0' + i;
+		if (create(name) != 0) return FAIL;
+		fd = open(name);
+		if (fd < 0) return FAIL;
+		if (write(fd, data, sizeof(data)) != sizeof(data)) result = FAIL;
+		// the last file's fsync commits whatever the others left running
+		if (i == JOURNAL_TEST_FILES - 1 && fsync(fd) != 0) result = FAIL;
+		close(fd);
+	}
+
+	// every create and write is an operation, and they shared commits
+	if (journal_stats.ops - ops < 2 * JOURNAL_TEST_FILES) result = FAIL;
+	if (journal_stats.commits + journal_stats.checkpoints == commits) result = FAIL;
+	if (journal_stats.commits + journal_stats.checkpoints - commits >= journal_stats.ops - ops) result = FAIL;
+	if (journal_stats.errors != 0) result = FAIL;
+
+	for (i = 0; i < JOURNAL_TEST_FILES; i++) {
+		name[JOURNAL_TEST_DIGIT] = '0' + i;
+		if (unlink(name) != 0) result = FAIL;
+	}
+	return result;
+}
+
+/* journal_replay_test
+ *
+ * Puts a journal on a ramdisk, commits a transaction carrying both bitmaps and a home block,
+ * then rewinds the bitmaps in memory as a reboot before the homes were written would, and
+ * checks journal_open and journal_replay bring the homes and bitmaps back. A transaction
+ * whose commit record is wiped must not be replayed. Needs no journaled image
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: registers a ramdisk, which keeps its JREPLAY_TEST_BLOCKS frames, and uses
+ *               one more frame and frees it
+ * Coverage: journal_open, journal_commit, journal_replay, journal_load_maps, journal_checkpoint
+ * Files: journal.c/h, ramdisk.c/h
+ */
+int journal_replay_test() {
+	TEST_HEADER;
+	static journal_t j;
+	static uint8_t inode_map[BLK_SECTOR_SIZE];
+	static uint8_t block_map[BLK_SECTOR_SIZE];
+	uint8_t * area;
+	uint8_t * image;
+	blkdev_t * dev;
+	uint32_t commits, replayed, head;
+	int32_t result = PASS;
+
+	area = (uint8_t *)alloc_frames(JREPLAY_TEST_BLOCKS);
+	if (area == NULL) return FAIL;
+	image = (uint8_t *)alloc_frame();
+	if (image == NULL) return FAIL;
+	dev = register_ramdisk(area, JREPLAY_TEST_BLOCKS * JOURNAL_BLOCK_SIZE);
+	if (dev == NULL) return FAIL;
+
+	// a fresh area, with the old bitmaps written home
+	if (journal_open(&j, dev, JREPLAY_TEST_HOMES, JOURNAL_MIN_BLOCKS, inode_map, 1, block_map, 1) != 0) return FAIL;
+	memset(inode_map, JREPLAY_TEST_OLD, BLK_SECTOR_SIZE);
+	memset(block_map, JREPLAY_TEST_OLD, BLK_SECTOR_SIZE);
+	if (journal_checkpoint(&j) != 0) return FAIL;
+
+	// one operation changes both bitmaps and the home block, and only the log sees it
+	commits = journal_stats.commits;
+	journal_begin(&j);
+	memset(inode_map, JREPLAY_TEST_NEW, BLK_SECTOR_SIZE);
+	memset(block_map, JREPLAY_TEST_NEW, BLK_SECTOR_SIZE);
+	journal_dirty_maps(&j);
+	memset(image, JREPLAY_TEST_NEW, JOURNAL_BLOCK_SIZE);
+	journal_dirty(&j, 0, image, JOURNAL_BLOCK_SECTORS);
+	if (journal_end(&j) != 0 || journal_commit(&j) != 0) result = FAIL;
+	if (journal_stats.commits != commits + 1) result = FAIL;
+	if (!filled(area, JOURNAL_BLOCK_SIZE, 0)) result = FAIL;
+
+	// reboot: memory holds what the homes do
+	memset(inode_map, JREPLAY_TEST_OLD, BLK_SECTOR_SIZE);
+	memset(block_map, JREPLAY_TEST_OLD, BLK_SECTOR_SIZE);
+	replayed = journal_stats.replayed;
+	if (journal_open(&j, dev, JREPLAY_TEST_HOMES, JOURNAL_MIN_BLOCKS, inode_map, 1, block_map, 1) != 0) return FAIL;
+	if (journal_replay(&j) != 1 || journal_stats.replayed != replayed + 1) result = FAIL;
+	if (!filled(area, JOURNAL_BLOCK_SIZE, JREPLAY_TEST_NEW)) result = FAIL;
+	if (journal_load_maps(&j) != 0) result = FAIL;
+	if (!filled(inode_map, BLK_SECTOR_SIZE, JREPLAY_TEST_NEW) || !filled(block_map, BLK_SECTOR_SIZE, JREPLAY_TEST_NEW)) {
+		result = FAIL;
+	}
+
+	// a transaction that lost its commit record stays out of the homes
+	if (journal_checkpoint(&j) != 0) result = FAIL;
+	journal_begin(&j);
+	memset(image, JREPLAY_TEST_OLD, JOURNAL_BLOCK_SIZE);
+	journal_dirty(&j, 0, image, JOURNAL_BLOCK_SECTORS);
+	head = j.head;
+	if (journal_end(&j) != 0 || journal_commit(&j) != 0) result = FAIL;
+	memset(area + (JREPLAY_TEST_HOMES + head + 2) * JOURNAL_BLOCK_SIZE, 0, BLK_SECTOR_SIZE);
+	if (journal_open(&j, dev, JREPLAY_TEST_HOMES, JOURNAL_MIN_BLOCKS, inode_map, 1, block_map, 1) != 0) return FAIL;
+	if (journal_replay(&j) != 0) result = FAIL;
+	if (!filled(area, JOURNAL_BLOCK_SIZE, JREPLAY_TEST_NEW)) result = FAIL;
+
+	free_frame(image);
+	return result;
+}
+
+/* slab_test
+ *
+ * Allocates enough kmalloc objects to span several slabs, checks they are zeroed, aligned
+ * and distinct, and that freeing them brings the size class's counters back
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: kmalloc size classes, slab growth and release, whole-frame allocations
+ * Files: slab.c/h, paging.c/h
+ */
+int slab_test() {
+	TEST_HEADER;
+	static uint8_t * objs[SLAB_TEST_OBJS];
+	kmem_cache_t * cache;
+	uint32_t active, i, j;
+	void * big;
+	int result = PASS;
+
+	// the size-128 class, created right after size-16, size-32 and size-64
+	cache = get_kmem_cache(SLAB_TEST_CLASS);
+	if (cache == NULL || cache->size < SLAB_TEST_SIZE) return FAIL;
+	active = cache->active;
+
+	for (i = 0; i < SLAB_TEST_OBJS; i++) {
+		objs[i] = (uint8_t *)kmalloc(SLAB_TEST_SIZE);
+		if (objs[i] == NULL) return FAIL;
+		if ((uint32_t)objs[i] % SLAB_ALIGN != 0) result = FAIL;
+		for (j = 0; j < SLAB_TEST_SIZE; j++) {
+			if (objs[i][j] != 0) result = FAIL;
+		}
+		memset(objs[i], i, SLAB_TEST_SIZE);
+	}
+	if (cache->active != active + SLAB_TEST_OBJS || cache->slabs < SLAB_TEST_OBJS / cache->per_slab) result = FAIL;
+
+	// nothing handed out twice, so every object still holds its own pattern
+	for (i = 0; i < SLAB_TEST_OBJS; i++) {
+		if (objs[i][0] != (uint8_t)i || objs[i][SLAB_TEST_SIZE - 1] != (uint8_t)i) result = FAIL;
+		kfree(objs[i]);
+	}
+	if (cache->active != active) result = FAIL;
+
+	if (kmalloc(0) != NULL || kmalloc(SLAB_SIZE + 1) != NULL) result = FAIL;
+	big = kmalloc(SLAB_SIZE);
+	if (big == NULL || (uint32_t)big % SLAB_SIZE != 0) result = FAIL;
+	kfree(big);
+	return result;
+}
+
+/* task_test
+ *
+ * Checks the running task is found without touching the kernel stack, that its scheduling
+ * fields fit one cache line, and that task structs come from the slab cache line aligned
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None
+ * Coverage: curr_pcb, get_parent_pcb, pcb_t layout, aligned slab caches
+ * Files: sys_call.c/h, slab.c/h
+ */
+int task_test() {
+	TEST_HEADER;
+	kmem_cache_t * cache = NULL;
+	pcb_t * task = curr_pcb();
+	void * obj;
+	uint32_t i, hot_end;
+	int result = PASS;
+
+	// before the first program this is the boot task, which still has stdin and stdout
+	if (task == NULL || task != current || task->args_buf == NULL) return FAIL;
+	if (get_fd(task, 0) == NULL || get_fd(task, 1) == NULL) result = FAIL;
+	if (get_parent_pcb(num_processes) != NULL) result = FAIL;
+
+	// everything before the descriptor table shares the first cache line
+	hot_end = (uint32_t)((uint8_t *)&task->fd_table - (uint8_t *)task);
+	if (hot_end > TASK_ALIGN) result = FAIL;
+	if ((uint32_t)task % TASK_ALIGN != 0) result = FAIL;
+
+	for (i = 0; get_kmem_cache(i) != NULL; i++) {
+		if (strncmp(get_kmem_cache(i)->name, (int8_t *)TASK_TEST_CACHE, KMEM_NAME_LEN) == 0) cache = get_kmem_cache(i);
+	}
+	if (cache == NULL || cache->size % TASK_ALIGN != 0 || cache->size < sizeof(pcb_t)) return FAIL;
+
+	obj = kmem_cache_alloc(cache);
+	if (obj == NULL || (uint32_t)obj % TASK_ALIGN != 0) result = FAIL;
+	kmem_cache_free(cache, obj);
+
+	// alignment has to be a power of two
+	if (kmem_cache_create((int8_t *)TASK_TEST_CACHE, sizeof(pcb_t), TASK_ALIGN + 1) != NULL) result = FAIL;
+	return result;
+}
+
+/* process_table_test
+ *
+ * Checks the process table was sized at boot, and drains the program pages to check they
+ * come out lowest first, 4MB aligned, clear of the kernel and the frame pool, and are handed
+ * out again once freed
+ * Inputs: None
+ * Outputs: PASS/FAIL
+ * Side Effects: None, every page taken is given back
+ * Coverage: init_program_pages, alloc_program_page, free_program_page, process table size
+ * Files: paging.c/h, sys_call.c/h
+ */
+int process_table_test() {
+	TEST_HEADER;
+	static uint32_t pages[MAX_PROGRAM_PAGES];
+	uint32_t i, count = 0, page;
+	int result = PASS;
+
+	if (num_processes == 0 || num_processes > MAX_PROCESSES) return FAIL;
+	if (pid_in_use(num_processes)) result = FAIL;
+
+	while (count < MAX_PROGRAM_PAGES && (page = alloc_program_page()) != 0) {
+		if (page % FOUR_MB != 0 || page < PROGRAM_PAGE_START || page == FRAME_POOL_START) result = FAIL;
+		if (count > 0 && page <= pages[count - 1]) result = FAIL;
+		pages[count++] = page;
+	}
+	// nothing runs before the shell, so every process the table allows has a page waiting
+	if (count < num_processes) result = FAIL;
+
+	for (i = 0; i < count; i++) free_program_page(pages[i]);
+	page = alloc_program_page();
+	if (count > 0 && page != pages[0]) result = FAIL;
+	free_program_page(page);
+	return result;
+}
 
 /* Test suite entry point */
 void launch_tests(){
@@ -818,6 +2201,7 @@ void launch_tests(){
 	//TEST_OUTPUT("dir_list_test", dir_list_test()); // PASS
 	//TEST_OUTPUT("read_large_file_test", read_large_file_test()); // PASS
 	//TEST_OUTPUT("rtc_write_test", rtc_write_test());
+	// TEST_OUTPUT("rtc_rate_test", rtc_rate_test());
 	// TEST_OUTPUT("kb_write_syscall_test", kb_write_syscall_test());
 	// TEST_OUTPUT("kb_long_write_syscall_test", kb_long_write_syscall_test());
 
@@ -830,4 +2214,30 @@ void launch_tests(){
 	 TEST_OUTPUT("test_shell", test_shell());
 	// TEST_OUTPUT("test_ls", test_ls());
 	// CP 4
+	// TEST_OUTPUT("many_open_files_test", many_open_files_test());
+	// TEST_OUTPUT("device_registry_test", device_registry_test());
+	// TEST_OUTPUT("procfs_test", procfs_test());
+	// TEST_OUTPUT("stat_test", stat_test());
+	// TEST_OUTPUT("write_file_test", write_file_test());
+	// TEST_OUTPUT("vector_io_test", vector_io_test());
+	// TEST_OUTPUT("mmap_test", mmap_test());
+	// TEST_OUTPUT("sendfile_test", sendfile_test());
+	// TEST_OUTPUT("run_cache_test", run_cache_test());
+	// TEST_OUTPUT("indirect_test", indirect_test());
+	// TEST_OUTPUT("v2_format_test", v2_format_test());
+	// TEST_OUTPUT("lz4_test", lz4_test());
+	// TEST_OUTPUT("getdents_test", getdents_test());
+	// TEST_OUTPUT("path_lookup_test", path_lookup_test());
+	// TEST_OUTPUT("union_mount_test", union_mount_test());
+	// TEST_OUTPUT("ata_dma_test", ata_dma_test());
+	// TEST_OUTPUT("virtio_batch_test", virtio_batch_test());
+	// TEST_OUTPUT("blk_merge_test", blk_merge_test());
+	// TEST_OUTPUT("bcache_test", bcache_test());
+	// TEST_OUTPUT("readahead_test", readahead_test());
+	// TEST_OUTPUT("writeback_test", writeback_test());
+	// TEST_OUTPUT("journal_test", journal_test());
+	// TEST_OUTPUT("journal_replay_test", journal_replay_test());
+	// TEST_OUTPUT("slab_test", slab_test());
+	// TEST_OUTPUT("task_test", task_test());
+	// TEST_OUTPUT("process_table_test", process_table_test());
 }
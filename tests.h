@@ -9,6 +9,8 @@
 #define DEREF_TEST 10 // dereference value
 #define BAD_PTR -100 // bad pointer value
 #define ONEKB 1024 // one kylobyte
+#define RTC_TEST_TICKS 16 // hardware ticks to wait for with program interrupts off
+#define RTC_TEST_SPINS 0x40000000 // gives up long after RTC_TEST_TICKS should have come
 #define PAGE_IN_BOUND 0xB8000 // ptr location for paging_in_bounds_test
 
 // the following macros are arbitrarily chosen - and are just used to read a certain number of bits at a given offset in a given file
@@ -21,6 +23,44 @@
 #define SHELL_OFFSET 5572
 #define KB_WRITE_SIZE 32
 #define KB_LONG_WRITE_SIZE 165
+#define MANY_FDS 40 // enough opens to spill past the inline descriptors
+#define DEV_TEST_SIZE 16 // bytes pushed through /dev/null and /dev/zero
+#define PROC_TEST_SIZE 512 // more than /proc/meminfo ever holds
+#define PROC_TEST_CHUNK 7 // small reads, so the report takes several
+#define MMAP_TEST_COPIES 22 // copies of frame0.txt, one full block and a partial second
+#define RUN_TEST_BLOCKS 3 // blocks in the run cache test's file
+#define RUN_TEST_OFFSET 100 // read start partway into the first block
+#define IND_TEST_SIZE 64 // bytes written across each indirect boundary
+#define IND_TEST_BOUNDS 2 // the single and the double indirect boundary
+#define IND_TEST_BLOCKS (NUM_DIRECT_BLOCKS + PTRS_PER_BLOCK + 1) // data blocks the test file ends with
+#define IND_TEST_TABLES 3 // single, double and one second level indirect block
+#define V2_TEST_FILES 3 // names created out of order
+#define V2_TEST_BLOCKS 4 // blocks the grown file ends with, one write each
+#define V2_TEST_STOCK_FILE "frame0.txt" // file only the stock version 1 image has
+#define LZ4_TEST_FILE "lz4test.txt" // compressible file the frame cache test reads
+#define LZ4_TEST_SIZE ((FRAME_CACHE_SIZE + 4) * SIZE_OF_BLOCKS + 100) // more frames than the cache holds
+#define LZ4_TEST_RUN 7 // byte i of the file is 'a' + (i / LZ4_TEST_RUN) % 26
+#define LZ4_TEST_CHUNK 1000 // read size, so reads straddle frames
+#define WRITE_TEST_SIZE 5000 // spills into a second data block
+#define GETDENTS_BUF_SIZE 4096 // room for every dentry in one call
+#define ATA_TEST_SECTORS 24 // 12KB, spans several bounce frames
+#define VIRTIO_TEST_SECTORS 200 // several virtio requests in one batch
+#define MERGE_TEST_PAGES 16 // 4KB requests that should collapse into a few transfers
+#define RA_TEST_BLOCKS 8 // file the readahead test streams through
+#define RA_TEST_CHUNK 512 // bytes per read, several reads per block
+#define RA_TEST_READS 8 // sequential reads, enough to double RA_MIN_BLOCKS past RA_MAX_BLOCKS
+#define WB_TEST_BLOCKS 4 // blocks the writeback test leaves dirty
+#define WB_TEST_TTY_FD 1 // stdout, which fsync has to refuse
+#define JOURNAL_TEST_FILES 8 // files created and written, more operations than one commit needs
+#define JOURNAL_TEST_DIGIT 5 // position of the number in the test's file names
+#define JREPLAY_TEST_HOMES 1 // home blocks ahead of the replay test's journal area
+#define JREPLAY_TEST_BLOCKS (JREPLAY_TEST_HOMES + JOURNAL_MIN_BLOCKS) // frames its ramdisk spans
+#define JREPLAY_TEST_OLD 0x5A // what the homes and bitmaps hold before the transaction
+#define JREPLAY_TEST_NEW 0xA5 // what the transaction changes them to
+#define SLAB_TEST_OBJS 100 // kmalloc objects, several slabs' worth
+#define SLAB_TEST_SIZE 100 // bytes each, served by the 128 byte class
+#define SLAB_TEST_CLASS 3 // that class's cache index
+#define TASK_TEST_CACHE "task" // slab cache task structs come from
 // test launcher
 void launch_tests();
 
@@ -0,0 +1,509 @@
+/* mkfs.c - builds a version 2 (extent) filesystem image on the host, or with -1
+ * a version 1 image whose inodes use indirect blocks (FS_FEATURE_INDIRECT)
+ *
+ * Build: cc -O2 -o mkfs tools/mkfs.c
+ * Usage: mkfs [-1] [-u] [-i spare_inodes] [-b spare_blocks] [-j journal_blocks] image path...
+ *
+ * Layout, in 4kB blocks:
+ *   0           boot block: fstats (magic in reserved) + dentries sorted by name
+ *   1           directory index: FNV-1a buckets over the dentries, as built
+ *               here ; the kernel neither reads it nor updates it
+ *   2 .. 2+N-1  inodes: length, extent count, extents
+ *   2+N ..      data blocks, every file in one contiguous extent
+ *   then        journal area with -j: superblock, free-inode and free-block
+ *               bitmaps, log ; left zeroed, the kernel fills it in at mount
+ *
+ * With -1 there is no directory index and the inodes start at block 1. An
+ * inode is a length and NUM_DATA_BLOCKS block numbers: the first
+ * NUM_DIRECT_BLOCKS point at data, the last two at a single and a double
+ * indirect block, which follow the file's data. Version 1 has no compressed
+ * files, so -1 implies -u.
+ *
+ * The directory always holds "." and "rtc" like the stock image. Spare inodes
+ * and blocks are left free for files created at run time.
+ *
+ * A directory argument is copied in as a subdirectory, recursively: a FOLDER
+ * dentry whose inode's data is its own dentries ("." first, all sorted by
+ * name) in the boot block's 64 byte format. Only the root is hashed.
+ *
+ * Files that shrink below COMPRESS_PCT of their size are stored compressed:
+ * an offset table followed by one LZ4 block per 4kB (raw when a block doesn't
+ * shrink), see frame_cache_t in filesystem.h. ELF executables are always
+ * stored plain so exec never waits on decompression; -u stores everything
+ * plain.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <dirent.h>
+#include <sys/stat.h>
+
+// must match filesystem.h
+#define SIZE_OF_BLOCKS 4096
+#define STATS_SIZE 64
+#define DENTRY_SIZE 64
+#define MAX_NUM_DENTRY 63
+#define MAX_ENTRY_LEN 32
+#define FS_MAGIC_V2 0x32565346
+#define DIR_HASH_SIZE 256
+#define DIR_HASH_END 0xFFFF
+#define RTC_TYPE 0
+#define FOLDER_TYPE 1
+#define FILE_TYPE 2
+#define INODE_COMPRESSED 0x1
+#define FS_FEATURE_INDIRECT 0x1
+#define NUM_DATA_BLOCKS (SIZE_OF_BLOCKS / 4 - 1)
+#define NUM_DIRECT_BLOCKS (NUM_DATA_BLOCKS - 2)
+#define SINGLE_INDIRECT NUM_DIRECT_BLOCKS
+#define DOUBLE_INDIRECT (NUM_DIRECT_BLOCKS + 1)
+#define PTRS_PER_BLOCK (SIZE_OF_BLOCKS / 4)
+#define MAX_V1_BLOCKS (NUM_DIRECT_BLOCKS + PTRS_PER_BLOCK + PTRS_PER_BLOCK * PTRS_PER_BLOCK)
+
+#define COMPRESS_PCT 75 // compress a file only if it ends up at most this big
+#define LZ4_MIN_MATCH 4
+#define LZ4_MFLIMIT 12 // no match may start in the last 12 bytes of a block
+#define LZ4_LAST_LITERALS 5 // the last 5 bytes of a block are always literals
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_HASH_BITS 12
+#define LZ4_BOUND(n) ((n) + (n) / 255 + 16)
+
+#define RESERVED_OFFSET 12 // fstats_t.reserved
+#define FEATURES_WORD 1 // FS_FEATURES_WORD, version 1 only
+#define JOURNAL_WORD 2 // FS_JOURNAL_WORD, first block of the journal area
+#define JOURNAL_LEN_WORD 3 // FS_JOURNAL_LEN_WORD
+#define JOURNAL_MIN_BLOCKS 69 // JOURNAL_MIN_BLOCKS in journal.h
+#define NUM_SPECIAL 2 // "." and "rtc"
+#define MAX_NODES 1024 // dentries in the whole tree
+#define ROOT -1 // parent of the boot block's dentries
+
+typedef struct {
+    char name[MAX_ENTRY_LEN];
+    uint32_t type;
+    uint32_t inode;
+    int32_t parent; // node of the directory holding the dentry, ROOT for the boot block
+    int32_t has_inode; // files and subdirectories, not "." or "rtc"
+    char * path; // host path, NULL for "." and "rtc"
+    uint32_t size; // length of the file
+    uint8_t * stored; // bytes that go in the data blocks
+    uint32_t stored_size;
+    uint32_t flags; // INODE_COMPRESSED
+} entry_t;
+
+static void put32(uint8_t * p, uint32_t v) {
+    p[0] = v; p[1] = v >> 8; p[2] = v >> 16; p[3] = v >> 24;
+}
+
+static void put16(uint8_t * p, uint16_t v) {
+    p[0] = v; p[1] = v >> 8;
+}
+
+// same as strhash in lib.c
+static uint32_t strhash(const char * s, uint32_t n) {
+    uint32_t i, hash = 2166136261U;
+    for (i = 0; i < n && s[i] != '\0'; i++) {
+        hash ^= (uint8_t)s[i];
+        hash *= 16777619U;
+    }
+    return hash;
+}
+
+static uint32_t get32(const uint8_t * p) {
+    return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// length nibble overflow: 255s then the remainder
+static uint8_t * put_length(uint8_t * op, uint32_t len) {
+    for (; len >= 255; len -= 255) *op++ = 255;
+    *op++ = len;
+    return op;
+}
+
+// one LZ4 sequence: literals, then a match unless mlen is 0
+static uint8_t * put_sequence(uint8_t * op, const uint8_t * lit, uint32_t nlit, uint32_t offset, uint32_t mlen) {
+    uint8_t * token = op++;
+    uint32_t mcode = mlen ? mlen - LZ4_MIN_MATCH : 0;
+
+    *token = ((nlit < 15 ? nlit : 15) << 4) | (mcode < 15 ? mcode : 15);
+    if (nlit >= 15) op = put_length(op, nlit - 15);
+    memcpy(op, lit, nlit);
+    op += nlit;
+    if (mlen == 0) return op;
+
+    *op++ = offset;
+    *op++ = offset >> 8;
+    if (mcode >= 15) op = put_length(op, mcode - 15);
+    return op;
+}
+
+// greedy LZ4 block compressor, returns the compressed size
+static uint32_t lz4_compress(const uint8_t * src, uint32_t n, uint8_t * dst) {
+    int32_t table[1 << LZ4_HASH_BITS];
+    uint32_t ip = 0, anchor = 0, ref, h, mlen;
+    uint8_t * op = dst;
+
+    memset(table, -1, sizeof(table));
+    while (n >= LZ4_MFLIMIT && ip <= n - LZ4_MFLIMIT) {
+        h = (get32(src + ip) * 2654435761U) >> (32 - LZ4_HASH_BITS);
+        ref = table[h];
+        table[h] = ip;
+        if (ref == (uint32_t)-1 || ip - ref > LZ4_MAX_OFFSET || get32(src + ref) != get32(src + ip)) {
+            ip++;
+            continue;
+        }
+
+        mlen = LZ4_MIN_MATCH;
+        while (ip + mlen < n - LZ4_LAST_LITERALS && src[ref + mlen] == src[ip + mlen]) mlen++;
+        op = put_sequence(op, src + anchor, ip - anchor, ip - ref, mlen);
+        ip += mlen;
+        anchor = ip;
+    }
+    op = put_sequence(op, src + anchor, n - anchor, 0, 0);
+    return op - dst;
+}
+
+// offset table + one frame per 4kB, returns the stream size or 0 if it doesn't pay off
+static uint32_t compress_file(entry_t * e) {
+    uint32_t frames = (e->size + SIZE_OF_BLOCKS - 1) / SIZE_OF_BLOCKS;
+    uint32_t i, pos, len, clen;
+    uint8_t * out = malloc((frames + 1) * 4 + frames * LZ4_BOUND(SIZE_OF_BLOCKS));
+    uint8_t * in = e->stored;
+
+    if (out == NULL) return 0;
+    pos = (frames + 1) * 4;
+    for (i = 0; i < frames; i++) {
+        put32(out + i * 4, pos);
+        len = e->size - i * SIZE_OF_BLOCKS;
+        if (len > SIZE_OF_BLOCKS) len = SIZE_OF_BLOCKS;
+        clen = lz4_compress(in + i * SIZE_OF_BLOCKS, len, out + pos);
+        // a frame that doesn't shrink is stored as is
+        if (clen >= len) {
+            memcpy(out + pos, in + i * SIZE_OF_BLOCKS, len);
+            clen = len;
+        }
+        pos += clen;
+    }
+    put32(out + frames * 4, pos);
+
+    if ((uint64_t)pos * 100 > (uint64_t)e->size * COMPRESS_PCT) {
+        free(out);
+        return 0;
+    }
+    e->stored = out;
+    e->stored_size = pos;
+    e->flags = INODE_COMPRESSED;
+    free(in);
+    return pos;
+}
+
+// indirect blocks a version 1 inode needs to reach blocks data blocks
+static uint32_t indirect_count(uint32_t blocks) {
+    if (blocks <= NUM_DIRECT_BLOCKS) return 0;
+    if (blocks <= NUM_DIRECT_BLOCKS + PTRS_PER_BLOCK) return 1;
+    blocks -= NUM_DIRECT_BLOCKS + PTRS_PER_BLOCK;
+    return 2 + (blocks + PTRS_PER_BLOCK - 1) / PTRS_PER_BLOCK;
+}
+
+// a version 1 inode's block numbers for data blocks first.., its indirect blocks right after
+static void put_block_numbers(uint8_t * inode, uint8_t * data, uint32_t first, uint32_t blocks) {
+    uint32_t i, j, next = first + blocks, single = 0, dbl = 0, table = 0;
+
+    for (i = 0; i < blocks; i++) {
+        if (i < NUM_DIRECT_BLOCKS) {
+            put32(inode + 4 + 4 * i, first + i);
+            continue;
+        }
+        j = i - NUM_DIRECT_BLOCKS;
+        if (j < PTRS_PER_BLOCK) {
+            if (j == 0) {
+                single = next++;
+                put32(inode + 4 + 4 * SINGLE_INDIRECT, single);
+            }
+            put32(data + single * SIZE_OF_BLOCKS + 4 * j, first + i);
+            continue;
+        }
+        j -= PTRS_PER_BLOCK;
+        if (j == 0) {
+            dbl = next++;
+            put32(inode + 4 + 4 * DOUBLE_INDIRECT, dbl);
+        }
+        if (j % PTRS_PER_BLOCK == 0) {
+            table = next++;
+            put32(data + dbl * SIZE_OF_BLOCKS + 4 * (j / PTRS_PER_BLOCK), table);
+        }
+        put32(data + table * SIZE_OF_BLOCKS + 4 * (j % PTRS_PER_BLOCK), first + i);
+    }
+}
+
+static entry_t nodes[MAX_NODES];
+static uint32_t num_nodes = 0, num_inodes = 0, plain = 0;
+static const char * prog;
+
+static int cmp_entry(const void * a, const void * b) {
+    return strncmp(((const entry_t *)a)->name, ((const entry_t *)b)->name, MAX_ENTRY_LEN);
+}
+
+static int cmp_node(const void * a, const void * b) {
+    return cmp_entry(*(entry_t * const *)a, *(entry_t * const *)b);
+}
+
+// dentries of one directory in name order, returns how many
+static uint32_t children(int32_t parent, entry_t ** out) {
+    uint32_t i, n = 0;
+
+    for (i = 0; i < num_nodes; i++) {
+        if (nodes[i].parent == parent) out[n++] = &nodes[i];
+    }
+    qsort(out, n, sizeof(entry_t *), cmp_node);
+    for (i = 1; i < n; i++) {
+        if (cmp_entry(out[i - 1], out[i]) == 0) {
+            fprintf(stderr, "%s: %.32s given twice\n", prog, out[i]->name);
+            exit(1);
+        }
+    }
+    return n;
+}
+
+// a dentry with no host file behind it
+static entry_t * add_special(const char * name, uint32_t type, uint32_t inode, int32_t parent) {
+    entry_t * e;
+
+    if (num_nodes == MAX_NODES) {
+        fprintf(stderr, "%s: more than %d entries\n", prog, MAX_NODES);
+        exit(1);
+    }
+    e = &nodes[num_nodes++];
+    strncpy(e->name, name, MAX_ENTRY_LEN);
+    e->type = type;
+    e->inode = inode;
+    e->parent = parent;
+    return e;
+}
+
+// reads the whole file into e->stored
+static int load_file(entry_t * e) {
+    FILE * f = fopen(e->path, "rb");
+    long size;
+
+    if (f == NULL) return -1;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    fseek(f, 0, SEEK_SET);
+    e->stored = malloc(size ? size : 1);
+    if (size < 0 || e->stored == NULL || fread(e->stored, 1, size, f) != (size_t)size) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    e->size = e->stored_size = size;
+    return 0;
+}
+
+// copies a host file, or a directory and everything under it, in under parent
+static void add_path(const char * path, int32_t parent) {
+    struct stat st;
+    struct dirent * d;
+    const char * base;
+    entry_t * e;
+    int32_t self;
+    DIR * dir;
+    char * child;
+
+    base = strrchr(path, '/');
+    base = (base == NULL || base[1] == '\0') ? path : base + 1;
+    if (strlen(base) > MAX_ENTRY_LEN) {
+        fprintf(stderr, "%s: name %s is longer than %d\n", prog, base, MAX_ENTRY_LEN);
+        exit(1);
+    }
+    if (stat(path, &st) < 0) {
+        fprintf(stderr, "%s: can't read %s\n", prog, path);
+        exit(1);
+    }
+
+    e = add_special(base, S_ISDIR(st.st_mode) ? FOLDER_TYPE : FILE_TYPE, num_inodes++, parent);
+    e->has_inode = 1;
+    e->path = strdup(path);
+    if (!S_ISDIR(st.st_mode)) {
+        if (load_file(e) < 0) {
+            fprintf(stderr, "%s: can't read %s\n", prog, path);
+            exit(1);
+        }
+        if (!plain && !(e->size >= 4 && memcmp(e->stored, "\177ELF", 4) == 0)) {
+            compress_file(e);
+        }
+        return;
+    }
+
+    self = e - nodes;
+    add_special(".", FOLDER_TYPE, e->inode, self);
+    dir = opendir(path);
+    if (dir == NULL) {
+        fprintf(stderr, "%s: can't read %s\n", prog, path);
+        exit(1);
+    }
+    while ((d = readdir(dir)) != NULL) {
+        if (strcmp(d->d_name, ".") == 0 || strcmp(d->d_name, "..") == 0) continue;
+        child = malloc(strlen(path) + strlen(d->d_name) + 2);
+        sprintf(child, "%s/%s", path, d->d_name);
+        add_path(child, self);
+        free(child);
+    }
+    closedir(dir);
+}
+
+// a subdirectory's data: its dentries, sorted
+static void build_dir(int32_t self) {
+    entry_t * list[MAX_NODES];
+    entry_t * e = &nodes[self];
+    uint32_t n, i;
+    uint8_t * p;
+
+    n = children(self, list);
+    e->stored = calloc(n ? n : 1, DENTRY_SIZE);
+    e->size = e->stored_size = n * DENTRY_SIZE;
+    for (i = 0; i < n; i++) {
+        p = e->stored + i * DENTRY_SIZE;
+        memcpy(p, list[i]->name, MAX_ENTRY_LEN);
+        put32(p + MAX_ENTRY_LEN, list[i]->type);
+        put32(p + MAX_ENTRY_LEN + 4, list[i]->inode);
+    }
+}
+
+int main(int argc, char ** argv) {
+    entry_t * entries[MAX_NODES];
+    uint32_t num_entries, spare_inodes = 0, spare_blocks = 0, journal_blocks = 0;
+    uint32_t total_inodes, total_data, total_blocks, next_block, blocks, i, v1 = 0, meta;
+    uint16_t buckets[DIR_HASH_SIZE];
+    uint16_t next[MAX_NUM_DENTRY];
+    const char * image;
+    uint8_t * img, * p;
+    entry_t * e;
+    FILE * f;
+    int arg = 1;
+
+    prog = argv[0];
+    while (arg < argc && argv[arg][0] == '-') {
+        if (strcmp(argv[arg], "-u") == 0 || strcmp(argv[arg], "-1") == 0) {
+            if (argv[arg][1] == '1') v1 = 1;
+            plain = 1;
+            arg++;
+            continue;
+        }
+        if (arg + 1 >= argc) break;
+        if (strcmp(argv[arg], "-i") == 0) spare_inodes = strtoul(argv[arg + 1], NULL, 0);
+        else if (strcmp(argv[arg], "-b") == 0) spare_blocks = strtoul(argv[arg + 1], NULL, 0);
+        else if (strcmp(argv[arg], "-j") == 0) journal_blocks = strtoul(argv[arg + 1], NULL, 0);
+        else break;
+        arg += 2;
+    }
+    if (arg >= argc || argv[arg][0] == '-') {
+        fprintf(stderr, "usage: %s [-1] [-u] [-i spare_inodes] [-b spare_blocks] [-j journal_blocks] image path...\n", argv[0]);
+        return 1;
+    }
+    if (journal_blocks != 0 && journal_blocks < JOURNAL_MIN_BLOCKS) {
+        fprintf(stderr, "%s: a journal needs at least %d blocks\n", argv[0], JOURNAL_MIN_BLOCKS);
+        return 1;
+    }
+    image = argv[arg++];
+
+    add_special(".", FOLDER_TYPE, 0, ROOT);
+    add_special("rtc", RTC_TYPE, 0, ROOT);
+    for (; arg < argc; arg++) {
+        add_path(argv[arg], ROOT);
+    }
+    for (i = 0; i < num_nodes; i++) {
+        if (nodes[i].has_inode && nodes[i].type == FOLDER_TYPE) build_dir(i);
+    }
+
+    // sorted names, then a name hash pointing into them
+    num_entries = children(ROOT, entries);
+    if (num_entries > MAX_NUM_DENTRY) {
+        fprintf(stderr, "%s: more than %d entries\n", argv[0], MAX_NUM_DENTRY);
+        return 1;
+    }
+    for (i = 0; i < DIR_HASH_SIZE; i++) buckets[i] = DIR_HASH_END;
+    for (i = num_entries; i-- > 0; ) {
+        uint32_t bucket = strhash(entries[i]->name, MAX_ENTRY_LEN) & (DIR_HASH_SIZE - 1);
+        next[i] = buckets[bucket];
+        buckets[bucket] = i;
+    }
+
+    total_inodes = num_inodes + spare_inodes;
+    total_data = spare_blocks;
+    for (i = 0; i < num_nodes; i++) {
+        blocks = (nodes[i].stored_size + SIZE_OF_BLOCKS - 1) / SIZE_OF_BLOCKS;
+        if (v1 && blocks > MAX_V1_BLOCKS) {
+            fprintf(stderr, "%s: %s is too big for a version 1 inode\n", argv[0], nodes[i].path);
+            return 1;
+        }
+        total_data += blocks + (v1 ? indirect_count(blocks) : 0);
+    }
+    // blocks ahead of the inodes: the boot block, and the directory index in version 2
+    meta = v1 ? 1 : 2;
+    total_blocks = meta + total_inodes + total_data + journal_blocks;
+
+    img = calloc(total_blocks, SIZE_OF_BLOCKS);
+    if (img == NULL) {
+        fprintf(stderr, "%s: out of memory\n", argv[0]);
+        return 1;
+    }
+
+    // boot block
+    put32(img, num_entries);
+    put32(img + 4, total_inodes);
+    put32(img + 8, total_data);
+    if (v1) put32(img + RESERVED_OFFSET + 4 * FEATURES_WORD, FS_FEATURE_INDIRECT);
+    else put32(img + RESERVED_OFFSET, FS_MAGIC_V2);
+    if (journal_blocks != 0) {
+        put32(img + RESERVED_OFFSET + 4 * JOURNAL_WORD, meta + total_inodes + total_data);
+        put32(img + RESERVED_OFFSET + 4 * JOURNAL_LEN_WORD, journal_blocks);
+    }
+    for (i = 0; i < num_entries; i++) {
+        p = img + STATS_SIZE + i * DENTRY_SIZE;
+        memcpy(p, entries[i]->name, MAX_ENTRY_LEN);
+        put32(p + MAX_ENTRY_LEN, entries[i]->type);
+        put32(p + MAX_ENTRY_LEN + 4, entries[i]->inode);
+    }
+
+    // directory index
+    if (!v1) {
+        p = img + SIZE_OF_BLOCKS;
+        for (i = 0; i < DIR_HASH_SIZE; i++) put16(p + 2 * i, buckets[i]);
+        for (i = 0; i < MAX_NUM_DENTRY; i++) put16(p + 2 * (DIR_HASH_SIZE + i), (i < num_entries) ? next[i] : DIR_HASH_END);
+    }
+
+    // inodes and data, one extent per file or subdirectory, or its block numbers in version 1
+    next_block = 0;
+    for (i = 0; i < num_nodes; i++) {
+        e = &nodes[i];
+        if (!e->has_inode) continue;
+
+        p = img + (meta + e->inode) * SIZE_OF_BLOCKS;
+        blocks = (e->stored_size + SIZE_OF_BLOCKS - 1) / SIZE_OF_BLOCKS;
+        put32(p, e->size);
+        if (v1) {
+            put_block_numbers(p, img + (meta + total_inodes) * SIZE_OF_BLOCKS, next_block, blocks);
+        } else {
+            put16(p + 4, blocks ? 1 : 0);
+            put16(p + 6, e->flags);
+            put32(p + 8, next_block);
+            put32(p + 12, blocks);
+        }
+
+        memcpy(img + (meta + total_inodes + next_block) * SIZE_OF_BLOCKS, e->stored, e->stored_size);
+        free(e->stored);
+        next_block += blocks + (v1 ? indirect_count(blocks) : 0);
+        if (e->flags & INODE_COMPRESSED) {
+            printf("%s: %u -> %u bytes\n", e->path, e->size, e->stored_size);
+        }
+    }
+
+    f = fopen(image, "wb");
+    if (f == NULL || fwrite(img, SIZE_OF_BLOCKS, total_blocks, f) != total_blocks) {
+        fprintf(stderr, "%s: can't write %s\n", argv[0], image);
+        return 1;
+    }
+    fclose(f);
+    free(img);
+    return 0;
+}
@@ -0,0 +1,283 @@
+#include "virtio_blk.h"
+#include "block.h"
+#include "pci.h"
+#include "lib.h"
+#include "i8259.h"
+#include "paging.h"
+#include "x86_desc.h"
+#include "interruptHandler.h"
+#include "idt.h"
+
+// one request's worth of device-visible state; the array lives in the identity-mapped kernel page
+typedef struct {
+    virtio_blk_hdr_t hdr;
+    volatile uint8_t status; // written by the device
+    uint32_t bounced; // data went through this slot's bounce frames
+    blk_request_t * req;
+} virtio_slot_t;
+
+static uint16_t vio; // legacy register base
+static uint32_t vio_irq;
+static uint16_t queue_size;
+static vring_desc_t * desc;
+static volatile vring_avail_t * avail;
+static volatile vring_used_t * used;
+static uint16_t last_used; // next used entry to reap
+static uint16_t last_kick; // avail->idx the device was last told about
+static uint32_t read_only;
+
+static virtio_slot_t slots[VIRTIO_SLOTS];
+static uint8_t * bounce[VIRTIO_SLOTS][VIRTIO_BOUNCE_FRAMES];
+static uint32_t busy_slots[BITMAP_WORDS(VIRTIO_SLOTS)];
+static uint32_t num_slots;
+static blkdev_t * vda;
+
+// IDT vector the PCI line landed on, so virtio_blk_INT can count it
+uint32_t virtio_blk_vector = OTHER_VECTOR;
+
+/* vring_used_offset
+* Inputs: - q : queue size
+* Outputs: offset of the used ring, which follows the descriptors and avail ring on a page boundary
+* Side Effects: none
+*/
+static uint32_t vring_used_offset(uint32_t q) {
+    uint32_t head = sizeof(vring_desc_t) * q + sizeof(uint16_t) * (3 + q);
+
+    return (head + VRING_ALIGN - 1) & ~(VRING_ALIGN - 1);
+}
+
+/* virtio_dispatch
+* Inputs: - dev : vda
+          - req : first request of a run of at most VIRTIO_MAX_SECTORS sectors
+* Outputs: BLK_STARTED ; BLK_BUSY if every slot is in flight ; -1 for a bad run
+* Side Effects: builds the header/data/status chain and publishes it on the avail ring,
+                the device only hears about it at the next unplug
+*/
+static int32_t virtio_dispatch(blkdev_t * dev, blk_request_t * req) {
+    virtio_slot_t * slot;
+    blk_request_t * seg;
+    uint32_t bytes = req->total << BLK_SECTOR_SHIFT;
+    uint32_t data_flags = VRING_DESC_F_NEXT | ((req->dir == BLK_READ) ? VRING_DESC_F_WRITE : 0);
+    uint32_t flags, off, d, head;
+    int32_t s;
+
+    if (req->total == 0 || req->total > VIRTIO_MAX_SECTORS) return -1;
+    if (req->segments > VIRTIO_MAX_SEGMENTS) return -1;
+    if (req->dir == BLK_WRITE && read_only) return -1;
+
+    cli_and_save(flags);
+    s = find_first_zero(busy_slots, num_slots);
+    if (s < 0) {
+        restore_flags(flags);
+        return BLK_BUSY;
+    }
+    bitmap_set(busy_slots, s);
+
+    slot = &slots[s];
+    slot->req = req;
+    slot->status = VIRTIO_BLK_S_UNSET;
+    slot->hdr.type = (req->dir == BLK_WRITE) ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
+    slot->hdr.reserved = 0;
+    slot->hdr.sector = req->sector;
+    slot->hdr.sector_hi = 0;
+
+    // every slot owns a fixed run of descriptors, so there is no free list to manage
+    head = s * VIRTIO_DESC_PER_SLOT;
+    d = head;
+    desc[d].addr = (uint32_t)&slot->hdr;
+    desc[d].addr_hi = 0;
+    desc[d].len = sizeof(virtio_blk_hdr_t);
+    desc[d].flags = VRING_DESC_F_NEXT;
+    desc[d].next = d + 1;
+    d++;
+
+    // one data descriptor per buffer of a merged run, or per bounce frame if any is out of reach
+    slot->bounced = !blk_run_reachable(req);
+    if (!slot->bounced) {
+        for (seg = req; seg != NULL; seg = seg->merged, d++) {
+            desc[d].addr = (uint32_t)seg->buf;
+            desc[d].len = seg->count << BLK_SECTOR_SHIFT;
+            desc[d].addr_hi = 0;
+            desc[d].flags = data_flags;
+            desc[d].next = d + 1;
+        }
+    } else {
+        if (req->dir == BLK_WRITE) blk_bounce(req, bounce[s], 1);
+        for (off = 0; off < bytes; off += FOUR_KB, d++) {
+            desc[d].addr = (uint32_t)bounce[s][off / FOUR_KB];
+            desc[d].len = (bytes - off < FOUR_KB) ? bytes - off : FOUR_KB;
+            desc[d].addr_hi = 0;
+            desc[d].flags = data_flags;
+            desc[d].next = d + 1;
+        }
+    }
+
+    desc[d].addr = (uint32_t)&slot->status;
+    desc[d].addr_hi = 0;
+    desc[d].len = sizeof(uint8_t);
+    desc[d].flags = VRING_DESC_F_WRITE;
+    desc[d].next = 0;
+
+    avail->ring[avail->idx % queue_size] = head;
+    // the chain has to be visible before the index that publishes it
+    asm volatile ("" ::: "memory");
+    avail->idx++;
+
+    restore_flags(flags);
+    return BLK_STARTED;
+}
+
+/* virtio_unplug
+* Inputs: - dev : vda
+* Outputs: none
+* Side Effects: one notify covers every chain published since the last one, and none is
+                sent while the device says it is still walking the ring on its own
+*/
+static void virtio_unplug(blkdev_t * dev) {
+    uint32_t flags;
+
+    cli_and_save(flags);
+    asm volatile ("" ::: "memory");
+    if (avail->idx != last_kick && !(used->flags & VRING_USED_F_NO_NOTIFY)) {
+        outw(0, vio + VIRTIO_QUEUE_NOTIFY);
+    }
+    last_kick = avail->idx;
+    restore_flags(flags);
+}
+
+/* virtio_reap
+* Inputs: none
+* Outputs: none
+* Side Effects: completes every chain the device has put on the used ring, copying
+                bounced reads out and freeing their slots
+*/
+static void virtio_reap() {
+    virtio_slot_t * slot;
+    blk_request_t * req;
+    uint32_t s;
+
+    while (last_used != used->idx) {
+        asm volatile ("" ::: "memory");
+        s = used->ring[last_used % queue_size].id / VIRTIO_DESC_PER_SLOT;
+        last_used++;
+
+        slot = &slots[s];
+        req = slot->req;
+        slot->req = NULL;
+        bitmap_clear(busy_slots, s);
+        if (req == NULL) continue;
+
+        if (slot->status != VIRTIO_BLK_S_OK) {
+            blk_complete(vda, req, BLK_ERROR);
+            continue;
+        }
+        if (slot->bounced && req->dir == BLK_READ) blk_bounce(req, bounce[s], 0);
+        blk_complete(vda, req, BLK_DONE);
+    }
+}
+
+/* virtio_poll
+* Inputs: - dev : vda
+* Outputs: none
+* Side Effects: acknowledges the interrupt status and reaps finished requests
+*/
+static void virtio_poll(blkdev_t * dev) {
+    inb(vio + VIRTIO_ISR);
+    virtio_reap();
+}
+
+/*
+virtio_blk_interrupt:
+functionality: the device's PIC line, reaps the used ring
+input: None
+output: None
+Effects: wakes whoever is sleeping on the finished requests
+*/
+void virtio_blk_interrupt() {
+    // reading ISR lowers the line, a clear queue bit means it was a config change
+    if (inb(vio + VIRTIO_ISR) & VIRTIO_ISR_QUEUE) virtio_reap();
+    send_eoi(vio_irq);
+}
+
+/* virtio_fail
+* Inputs: none
+* Outputs: none
+* Side Effects: tells the device the driver gave up on it
+*/
+static void virtio_fail() {
+    outb(VIRTIO_STATUS_FAILED, vio + VIRTIO_STATUS);
+}
+
+/*
+init_virtio_blk:
+functionality: finds a legacy virtio-blk function, negotiates features, lays queue 0
+out in contiguous pool frames and hooks the PCI interrupt line
+input: None
+output: None
+Effects: the disk is registered as the block device vda
+*/
+void init_virtio_blk() {
+    pci_dev_t pci;
+    uint8_t * ring;
+    uint32_t features, capacity, len, s, i;
+
+    pci = pci_find_device(VIRTIO_VENDOR, VIRTIO_BLK_DEVICE, PCI_DEV(0, 0, 0));
+    if (pci == PCI_NONE) return;
+    vio = pci_io_bar(pci, 0);
+    vio_irq = pci_read(pci, PCI_INTERRUPT_LINE) & 0xFF;
+    if (vio == 0 || vio_irq > HIGH_BOUND || vio_irq == PIC_IRQ) return;
+    pci_enable_master(pci);
+
+    // reset, then announce ourselves
+    outb(0, vio + VIRTIO_STATUS);
+    outb(VIRTIO_STATUS_ACK, vio + VIRTIO_STATUS);
+    outb(VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER, vio + VIRTIO_STATUS);
+
+    features = inl(vio + VIRTIO_DEVICE_FEATURES);
+    read_only = features & VIRTIO_BLK_F_RO;
+    outl(read_only, vio + VIRTIO_GUEST_FEATURES);
+
+    outw(0, vio + VIRTIO_QUEUE_SELECT);
+    queue_size = inw(vio + VIRTIO_QUEUE_SIZE);
+    if (queue_size < VIRTIO_DESC_PER_SLOT || queue_size > VIRTIO_MAX_QUEUE) {
+        virtio_fail();
+        return;
+    }
+
+    len = vring_used_offset(queue_size) + sizeof(uint16_t) * 3 + sizeof(vring_used_elem_t) * queue_size;
+    ring = (uint8_t *)alloc_frames((len + FOUR_KB - 1) / FOUR_KB);
+    if (ring == NULL) {
+        virtio_fail();
+        return;
+    }
+    desc = (vring_desc_t *)ring;
+    avail = (vring_avail_t *)(ring + sizeof(vring_desc_t) * queue_size);
+    used = (vring_used_t *)(ring + vring_used_offset(queue_size));
+    last_used = 0;
+    last_kick = 0;
+
+    num_slots = queue_size / VIRTIO_DESC_PER_SLOT;
+    if (num_slots > VIRTIO_SLOTS) num_slots = VIRTIO_SLOTS;
+    for (s = 0; s < num_slots; s++) {
+        for (i = 0; i < VIRTIO_BOUNCE_FRAMES; i++) {
+            bounce[s][i] = (uint8_t *)alloc_frame();
+            if (bounce[s][i] == NULL) {
+                virtio_fail();
+                return;
+            }
+        }
+    }
+    outl((uint32_t)ring / FOUR_KB, vio + VIRTIO_QUEUE_PFN);
+
+    // PIC vectors start at ICW2_MASTER and run straight on into the slave's
+    virtio_blk_vector = ICW2_MASTER + vio_irq;
+    SET_IDT_ENTRY(idt[virtio_blk_vector], virtio_blk_INT);
+    enable_irq(vio_irq);
+
+    outb(VIRTIO_STATUS_ACK | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK, vio + VIRTIO_STATUS);
+
+    capacity = inl(vio + VIRTIO_BLK_CAPACITY);
+    if (inl(vio + VIRTIO_BLK_CAPACITY + 4) != 0) capacity = 0xFFFFFFFF;
+    vda = register_blkdev((int8_t *)"vda", capacity, VIRTIO_MAX_SECTORS, VIRTIO_MAX_SEGMENTS,
+                          virtio_dispatch, virtio_unplug, virtio_poll, NULL);
+}
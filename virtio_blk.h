@@ -0,0 +1,86 @@
+#ifndef VIRTIO_BLK_H
+#define VIRTIO_BLK_H
+
+#include "types.h"
+
+// PCI ids of a transitional (legacy capable) virtio block device
+#define VIRTIO_VENDOR 0x1AF4
+#define VIRTIO_BLK_DEVICE 0x1001
+
+// legacy register layout, offsets from BAR0
+#define VIRTIO_DEVICE_FEATURES 0x00
+#define VIRTIO_GUEST_FEATURES 0x04
+#define VIRTIO_QUEUE_PFN 0x08 // physical page number of the selected queue
+#define VIRTIO_QUEUE_SIZE 0x0C
+#define VIRTIO_QUEUE_SELECT 0x0E
+#define VIRTIO_QUEUE_NOTIFY 0x10
+#define VIRTIO_STATUS 0x12
+#define VIRTIO_ISR 0x13 // reading acknowledges the interrupt
+#define VIRTIO_BLK_CAPACITY 0x14 // 64-bit sector count, first field of the device config
+
+// device status bits
+#define VIRTIO_STATUS_ACK 0x01
+#define VIRTIO_STATUS_DRIVER 0x02
+#define VIRTIO_STATUS_DRIVER_OK 0x04
+#define VIRTIO_STATUS_FAILED 0x80
+#define VIRTIO_ISR_QUEUE 0x01
+
+#define VIRTIO_BLK_F_RO 0x20 // feature bit 5, the disk is read-only
+
+// descriptor flags
+#define VRING_DESC_F_NEXT 0x1
+#define VRING_DESC_F_WRITE 0x2 // device writes this buffer
+#define VRING_USED_F_NO_NOTIFY 0x1 // device is already polling the avail ring
+#define VRING_ALIGN 4096 // the used ring starts on its own page
+
+// request header types and status codes
+#define VIRTIO_BLK_T_IN 0
+#define VIRTIO_BLK_T_OUT 1
+#define VIRTIO_BLK_S_OK 0
+#define VIRTIO_BLK_S_UNSET 0xFF // placeholder until the device writes a real status
+
+#define VIRTIO_MAX_SECTORS 128 // 64KB per merged run
+#define VIRTIO_BOUNCE_FRAMES (VIRTIO_MAX_SECTORS * 512 / 4096) // staging frames per slot
+#define VIRTIO_MAX_SEGMENTS VIRTIO_BOUNCE_FRAMES // buffers per run, so either layout fits the slot
+#define VIRTIO_SLOTS 8 // runs in flight at once
+#define VIRTIO_DESC_PER_SLOT (VIRTIO_MAX_SEGMENTS + 2) // header, data segments, status
+#define VIRTIO_MAX_QUEUE 1024 // largest ring this driver lays out
+
+typedef struct {
+    uint32_t addr; // physical address, the high half is always 0
+    uint32_t addr_hi;
+    uint32_t len;
+    uint16_t flags;
+    uint16_t next;
+} __attribute__((packed)) vring_desc_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx; // next slot the driver fills, free running
+    uint16_t ring[];
+} __attribute__((packed)) vring_avail_t;
+
+typedef struct {
+    uint32_t id; // head descriptor of the finished chain
+    uint32_t len;
+} __attribute__((packed)) vring_used_elem_t;
+
+typedef struct {
+    uint16_t flags;
+    uint16_t idx; // next slot the device fills, free running
+    vring_used_elem_t ring[];
+} __attribute__((packed)) vring_used_t;
+
+typedef struct {
+    uint32_t type; // VIRTIO_BLK_T_IN or VIRTIO_BLK_T_OUT
+    uint32_t reserved;
+    uint32_t sector; // 64-bit on the wire
+    uint32_t sector_hi;
+} __attribute__((packed)) virtio_blk_hdr_t;
+
+// find a legacy virtio-blk function over PCI and register it as vda
+extern void init_virtio_blk();
+// the device's PIC line, reached from interruptHandler.S
+extern void virtio_blk_interrupt();
+
+#endif